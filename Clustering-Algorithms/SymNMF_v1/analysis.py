@@ -59,21 +59,22 @@ def calculateKmeansLabels(vectors, k):
 """
 Calculate SymNMF labels for the given vectors.
 
-This function converts the input vectors to a list of lists, performs Symmetric Non-negative Matrix Factorization (SymNMF),
+This function converts the input vectors to a float64 array, performs Symmetric Non-negative Matrix Factorization (SymNMF),
 and returns the cluster assignments.
 
 Parameters:
 vectors (pd.DataFrame): A pandas DataFrame containing the input vectors.
 k (int): The number of clusters to form.
+precision (str): "double", or "single" to run the engine with W in float32.
 
 Returns:
 list: A list representing the cluster assignment for each vector.
 """
-def calculateSymnmfLabels(vectors, k):
-    vectors = vectors.values.tolist() # Convert data to list of lists
-    symnmfMatrix = symnmf.doSymnmf(vectors, k)
+def calculateSymnmfLabels(vectors, k, precision="double"):
+    vectors = np.ascontiguousarray(vectors.values, dtype=np.float64) # Convert data to a C-contiguous float64 array
+    symnmfMatrix = symnmf.doSymnmf(vectors, k, precision=precision)
 
-    return np.array(symnmfMatrix).argmax(axis=1)
+    return symnmfMatrix.argmax(axis=1)
 
 def main():
     try:
@@ -81,6 +82,18 @@ def main():
         input_data = sys.argv
         k, input_file = int(input_data[1]), input_data[2]
 
+        # --precision=single (the form symnmf.py takes, or a bare --precision) also scores the single precision engine
+        precision = "double"
+        for option in input_data[3:]:
+            if option == "--precision":
+                precision = "single"
+            elif option.startswith("--precision="):
+                precision = option[len("--precision="):]
+            else:
+                raise ValueError(option)
+        if precision not in symnmf.PRECISIONS:
+            raise ValueError(precision)
+
         # Create Vectors dataframe from csv file
         vectors = pd.read_csv(input_file, header=None)
 
@@ -95,6 +108,14 @@ def main():
         print("nmf: " + format(scoreSymnmf, ".4f"))
         print("kmeans: " + format(scoreKmeans, ".4f"))
 
+        # With single precision, compare its labels against the double precision ones
+        if precision == "single":
+            singleLabels = calculateSymnmfLabels(vectors, k, "single")
+            scoreSingle = silhouette_score(vectors, singleLabels)
+            agreement = np.mean(np.asarray(singleLabels) == np.asarray(symnmfLabels))
+            print("nmf (float32): " + format(scoreSingle, ".4f"))
+            print("labels matching float64: " + format(100 * agreement, ".2f") + "%")
+
     except Exception:
         print("An Error Has Occurred")
 
@@ -0,0 +1,1222 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "symnmf.h"
+#include "gemm.h"
+#include "simd.h"
+#include "stream.h"
+#include "csv.h"
+#include "output.h"
+#include "incremental.h"
+#include "stats.h"
+
+/*
+benchmarks for the symnmf engine
+usage: ./bench gemm [N ...]
+       ./bench sym [N ...]
+       ./bench exp [N ...]
+       ./bench stream [N ...]
+       ./bench symnmf [N ...]
+       ./bench solvers [N ...]
+       ./bench restarts [N ...]
+       ./bench incremental [N ...]
+       ./bench precision [N ...]
+       ./bench csv [N ...]
+       ./bench print [N ...]
+*/
+
+/*
+reads the monotonic clock
+@return double: the current time in seconds
+*/
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+allocates a matrix filled with uniform random values in [0, 1)
+@param n: the number of rows
+@param m: the number of columns
+@return matrix*: the allocated matrix
+*/
+static matrix* random_matrix(int n, int m)
+{
+    int i,j;
+    matrix* mat;
+    if((mat = matrix_malloc(n, m)) == NULL) return NULL; /* Memory allocation failed */
+    for(i=0;i<n;i++)
+    {
+        for(j=0;j<m;j++)
+        {
+            MATRIX_AT(mat, i, j) = rand() / (RAND_MAX + 1.0);
+        }
+    }
+    return mat;
+}
+
+/*
+the textbook triple loop that gemm replaced, kept as the baseline
+@param matrix1: the first matrix (n*m)
+@param matrix2: the second matrix (m*p)
+@param result_matrix: the result matrix (n*p)
+@return void
+*/
+static void naive_multiplication(const matrix* matrix1, const matrix* matrix2, matrix* result_matrix)
+{
+    int i,j,k;
+    double sum;
+    for(i=0;i<matrix1->rows;i++)
+    {
+        for(j=0;j<matrix2->cols;j++)
+        {
+            sum = 0;
+            for(k=0;k<matrix1->cols;k++)
+            {
+                sum += MATRIX_AT(matrix1, i, k) * MATRIX_AT(matrix2, k, j);
+            }
+            MATRIX_AT(result_matrix, i, j) = sum;
+        }
+    }
+}
+
+/*
+calculates the largest absolute difference between two matrices of the same dimensions
+@param matrix1: the first matrix
+@param matrix2: the second matrix
+@return double: the largest absolute difference
+*/
+static double max_abs_diff(const matrix* matrix1, const matrix* matrix2)
+{
+    int i,j;
+    double diff, max = 0;
+    for(i=0;i<matrix1->rows;i++)
+    {
+        for(j=0;j<matrix1->cols;j++)
+        {
+            diff = fabs(MATRIX_AT(matrix1, i, j) - MATRIX_AT(matrix2, i, j));
+            if(diff > max) max = diff;
+        }
+    }
+    return max;
+}
+
+/*
+copies the upper triangle of a square matrix into packed storage
+@param mat: the square matrix
+@return packed_matrix*: the packed upper triangle
+*/
+static packed_matrix* pack_upper_triangle(const matrix* mat)
+{
+    int i;
+    packed_matrix* packed;
+    if((packed = packed_malloc(mat->rows)) == NULL) return NULL; /* Memory allocation failed */
+    for(i=0;i<mat->rows;i++)
+    {
+        memcpy(PACKED_ROW(packed, i), MATRIX_ROW(mat, i) + i, (mat->rows - i) * sizeof(double));
+    }
+    return packed;
+}
+
+/*
+times W*H for an N*N matrix W and an N*k matrix H with the naive loop, with gemm and with
+symm_packed on the upper triangle of W (W is random, so symm_packed is only timed,
+including the allocation of its scratch space)
+@param sizes: the values of N to benchmark
+@param count: the number of sizes
+@return int: 0 on success, 1 if memory allocation failed
+*/
+static int bench_gemm(const int* sizes, int count)
+{
+    static const int ks[] = {2, 5, 10, 20, 50};
+    int s,t;
+    double start, naive_time, gemm_time, symm_time;
+    double* buffer;
+
+    if((buffer = malloc(gemm_buffer_size(ks[sizeof(ks)/sizeof(ks[0]) - 1]) * sizeof(double))) == NULL) return 1;
+    printf("%8s %4s %12s %12s %8s %10s %12s %12s\n", "N", "k", "naive [s]", "gemm [s]", "speedup", "GFLOP/s", "max |diff|",
+           "symm [s]");
+    for(s=0;s<count;s++)
+    {
+        int N = sizes[s];
+        matrix* W = random_matrix(N, N);
+        packed_matrix* P = (W != NULL) ? pack_upper_triangle(W) : NULL;
+        if(W == NULL || P == NULL)
+        {
+            matrix_free(W);
+            free(buffer);
+            return 1;
+        }
+        for(t=0;t<(int)(sizeof(ks)/sizeof(ks[0]));t++)
+        {
+            int k = ks[t];
+            matrix* H = random_matrix(N, k);
+            matrix* naive_result = matrix_malloc(N, k);
+            matrix* gemm_result = matrix_malloc(N, k);
+            if(H == NULL || naive_result == NULL || gemm_result == NULL)
+            {
+                matrix_free(H);
+                matrix_free(naive_result);
+                matrix_free(gemm_result);
+                matrix_free(W);
+                packed_free(P);
+                free(buffer);
+                return 1;
+            }
+
+            start = now_seconds();
+            naive_multiplication(W, H, naive_result);
+            naive_time = now_seconds() - start;
+
+            start = now_seconds();
+            gemm(W, H, gemm_result, buffer);
+            gemm_time = now_seconds() - start;
+
+            printf("%8d %4d %12.4f %12.4f %8.2f %10.2f %12.3e", N, k, naive_time, gemm_time,
+                   naive_time / gemm_time, 2.0 * N * N * k / gemm_time * 1e-9,
+                   max_abs_diff(naive_result, gemm_result));
+
+            start = now_seconds();
+            symm_packed(P, H, naive_result, NULL, 1);
+            symm_time = now_seconds() - start;
+            printf(" %12.4f\n", symm_time);
+            fflush(stdout);
+
+            matrix_free(H);
+            matrix_free(naive_result);
+            matrix_free(gemm_result);
+        }
+        matrix_free(W);
+        packed_free(P);
+    }
+    free(buffer);
+    return 0;
+}
+
+/*
+times sym() with a given configuration
+@param vectors: the matrix of vectors
+@param config: the engine settings
+@param elapsed: set to the elapsed time in seconds
+@return int: 0 on success, 1 if memory allocation failed
+*/
+static int time_sym(const matrix* vectors, const symnmf_config* config, double* elapsed)
+{
+    double start = now_seconds();
+    matrix* sym_matrix = sym(vectors, config);
+    *elapsed = now_seconds() - start;
+    matrix_free(sym_matrix);
+    return sym_matrix == NULL;
+}
+
+/*
+times sym() for N random vectors of dimension d = 10 and 50 at 1, 2, 4, ..., 32 threads
+with both distance backends, the speedup is relative to the single threaded scalar run
+@param sizes: the values of N to benchmark
+@param count: the number of sizes
+@return int: 0 on success, 1 if memory allocation failed
+*/
+static int bench_sym(const int* sizes, int count)
+{
+    static const int thread_counts[] = {1, 2, 4, 8, 16, 32};
+    static const int dims[] = {10, 50};
+    int s,d,t;
+    double scalar_time, gram_time, serial_time = 0;
+    symnmf_config scalar_config = {0, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+    symnmf_config gram_config = {0, SYM_BACKEND_GRAM, EXP_LIBM, 0, 0, 0, 0};
+    matrix* vectors;
+
+    printf("simd level: %s\n", simd_level_name(simd_level()));
+    printf("%8s %4s %8s %12s %8s %12s %8s\n", "N", "d", "threads", "scalar [s]", "speedup", "gram [s]", "speedup");
+    for(s=0;s<count;s++)
+    {
+        for(d=0;d<(int)(sizeof(dims)/sizeof(dims[0]));d++)
+        {
+            int N = sizes[s];
+            if((vectors = random_matrix(N, dims[d])) == NULL) return 1;
+            for(t=0;t<(int)(sizeof(thread_counts)/sizeof(thread_counts[0]));t++)
+            {
+                scalar_config.threads = gram_config.threads = thread_counts[t];
+                if(time_sym(vectors, &scalar_config, &scalar_time) != 0 ||
+                   time_sym(vectors, &gram_config, &gram_time) != 0)
+                {
+                    matrix_free(vectors);
+                    return 1;
+                }
+                if(t == 0) serial_time = scalar_time;
+                printf("%8d %4d %8d %12.4f %8.2f %12.4f %8.2f\n", N, dims[d], thread_counts[t],
+                       scalar_time, serial_time / scalar_time, gram_time, serial_time / gram_time);
+                fflush(stdout);
+            }
+            matrix_free(vectors);
+        }
+    }
+    return 0;
+}
+
+/*
+times simd_exp over N arguments drawn uniformly from [low, 0] in the given mode
+and reports its error relative to libm
+@param args: the arguments
+@param reference: their exponentials from libm
+@param values: scratch space for N values
+@param N: the number of arguments
+@param mode: one of the EXP_ values
+@param elapsed: set to the best time of a pass in seconds
+@param max_error: set to the largest relative error
+@param mean_error: set to the mean relative error
+@return void
+*/
+static void time_exp(const double* args, const double* reference, double* values, int N, int mode,
+                     double* elapsed, double* max_error, double* mean_error)
+{
+    int i,rep;
+    double start, error, sum = 0;
+    *elapsed = 0;
+    for(rep=0;rep<5;rep++)
+    {
+        memcpy(values, args, N * sizeof(double));
+        start = now_seconds();
+        simd_exp(values, N, mode);
+        start = now_seconds() - start;
+        if(rep == 0 || start < *elapsed) *elapsed = start;
+    }
+    *max_error = 0;
+    for(i=0;i<N;i++)
+    {
+        error = (reference[i] > 0) ? fabs(values[i] - reference[i]) / reference[i] : fabs(values[i]);
+        if(error > *max_error) *max_error = error;
+        sum += error;
+    }
+    *mean_error = sum / N;
+}
+
+/*
+times the batched exp of the similarity kernel in every accuracy mode and at every
+instruction set level, against libm, for arguments in [-20, 0] (the typical range of -d/2)
+and [-700, 0] (almost the whole range of normal results)
+@param sizes: the numbers of arguments to benchmark
+@param count: the number of sizes
+@return int: 0 on success, 1 if memory allocation failed
+*/
+static int bench_exp(const int* sizes, int count)
+{
+    static const double lows[] = {-20, -700};
+    static const int modes[] = {EXP_PRECISE, EXP_FAST};
+    static const char* mode_names[] = {"precise", "fast"};
+    int s,r,m,i,level;
+    int top = simd_level();
+    double libm_time, elapsed, max_error, mean_error;
+
+    printf("%10s %6s %8s %8s %12s %8s %12s %12s\n", "N", "range", "level", "mode", "Mexp/s", "speedup",
+           "max rel err", "mean rel err");
+    for(s=0;s<count;s++)
+    {
+        int N = sizes[s];
+        double* args = malloc(N * sizeof(double));
+        double* reference = malloc(N * sizeof(double));
+        double* values = malloc(N * sizeof(double));
+        if(args == NULL || reference == NULL || values == NULL)
+        {
+            free(args);
+            free(reference);
+            free(values);
+            return 1;
+        }
+        for(r=0;r<(int)(sizeof(lows)/sizeof(lows[0]));r++)
+        {
+            for(i=0;i<N;i++)
+            {
+                args[i] = lows[r] * (rand() / (RAND_MAX + 1.0));
+                reference[i] = exp(args[i]);
+            }
+            time_exp(args, reference, values, N, EXP_LIBM, &libm_time, &max_error, &mean_error);
+            printf("%10d %6.0f %8s %8s %12.1f %8.2f %12.3e %12.3e\n", N, lows[r], "-", "libm",
+                   N / libm_time * 1e-6, 1.0, max_error, mean_error);
+            for(level=top;level>=SIMD_SCALAR;level--)
+            {
+                simd_set_level(level);
+                for(m=0;m<(int)(sizeof(modes)/sizeof(modes[0]));m++)
+                {
+                    time_exp(args, reference, values, N, modes[m], &elapsed, &max_error, &mean_error);
+                    printf("%10d %6.0f %8s %8s %12.1f %8.2f %12.3e %12.3e\n", N, lows[r], simd_level_name(level),
+                           mode_names[m], N / elapsed * 1e-6, libm_time / elapsed, max_error, mean_error);
+                }
+            }
+            simd_set_level(-1);
+            fflush(stdout);
+        }
+        free(args);
+        free(reference);
+        free(values);
+    }
+    return 0;
+}
+
+/*
+times one product W*H with the streaming operator of N random vectors (d = 10, k = 10)
+against gemm on the stored norm matrix, with no tile cached, a quarter of them and all of them,
+and reports the memory W takes in each case
+@param sizes: the values of N to benchmark
+@param count: the number of sizes
+@return int: 0 on success, 1 if memory allocation failed
+*/
+static int bench_stream(const int* sizes, int count)
+{
+    static const int fractions[] = {0, 25, 100};
+    int s,f;
+    int k = 10;
+    double start, elapsed, err;
+    size_t tile_bytes = (size_t)STREAM_TILE * STREAM_TILE * sizeof(double);
+    symnmf_config config = {0, SYM_BACKEND_GRAM, EXP_LIBM, 0, 0, 0, 0};
+
+    printf("simd level: %s\n", simd_level_name(simd_level()));
+    printf("%8s %10s %12s %12s %10s\n", "N", "W", "memory [MB]", "W*H [s]", "max err");
+    for(s=0;s<count;s++)
+    {
+        int N = sizes[s];
+        int blocks = (N + STREAM_TILE - 1) / STREAM_TILE;
+        matrix* vectors = random_matrix(N, 10);
+        matrix* H = random_matrix(N, k);
+        matrix* dense_product = matrix_malloc(N, k);
+        matrix* stream_product = matrix_malloc(N, k);
+        matrix* W = (vectors != NULL) ? norm(vectors, &config) : NULL;
+        stream_operator* op;
+
+        if(vectors == NULL || H == NULL || dense_product == NULL || stream_product == NULL || W == NULL ||
+           gemm(W, H, dense_product, NULL) != 0)
+        {
+            matrix_free(vectors);
+            matrix_free(H);
+            matrix_free(dense_product);
+            matrix_free(stream_product);
+            matrix_free(W);
+            return 1;
+        }
+        start = now_seconds();
+        gemm(W, H, dense_product, NULL);
+        elapsed = now_seconds() - start;
+        printf("%8d %10s %12.1f %12.4f %10s\n", N, "stored", (double)N * W->stride * sizeof(double) / (1 << 20), elapsed, "-");
+        matrix_free(W);
+
+        for(f=0;f<(int)(sizeof(fractions)/sizeof(fractions[0]));f++)
+        {
+            size_t tiles = (size_t)blocks * (blocks + 1) / 2 * fractions[f] / 100;
+            char label[16];
+            if((op = stream_create(vectors, &config, tiles * tile_bytes)) == NULL ||
+               stream_multiply(op, H, stream_product, NULL, 1) != 0)
+            {
+                stream_free(op);
+                matrix_free(vectors);
+                matrix_free(H);
+                matrix_free(dense_product);
+                matrix_free(stream_product);
+                return 1;
+            }
+            start = now_seconds();
+            stream_multiply(op, H, stream_product, NULL, 1);
+            elapsed = now_seconds() - start;
+            err = max_abs_diff(dense_product, stream_product);
+            sprintf(label, "stream %d%%", fractions[f]);
+            printf("%8d %10s %12.1f %12.4f %10.2e\n", N, label, (double)op->cached_tiles * tile_bytes / (1 << 20), elapsed, err);
+            fflush(stdout);
+            stream_free(op);
+        }
+        matrix_free(vectors);
+        matrix_free(H);
+        matrix_free(dense_product);
+        matrix_free(stream_product);
+    }
+    return 0;
+}
+
+/*
+times the symnmf iterations on the norm matrix of N random vectors (d = 10, k = 10) at
+1, 2, 4, 8, 16 and 32 threads, with W stored dense and packed, the speedup is relative to one thread
+@param sizes: the values of N to benchmark
+@param count: the number of sizes
+@return int: 0 on success, 1 if memory allocation failed
+*/
+static int bench_symnmf(const int* sizes, int count)
+{
+    static const int thread_counts[] = {1, 2, 4, 8, 16, 32};
+    int s,t,i,kind;
+    int k = 10, iterations = 20;
+    double start, times[2], serial_times[2] = {0, 0};
+    matrix* H;
+    matrix* new_H;
+    matrix* vectors;
+    matrix* W;
+    packed_matrix* P;
+    symnmf_workspace* ws;
+    w_operator op;
+
+    printf("%8s %8s %14s %8s %14s %8s\n", "N", "threads", "dense [s/it]", "speedup", "packed [s/it]", "speedup");
+    for(s=0;s<count;s++)
+    {
+        int N = sizes[s];
+        vectors = random_matrix(N, 10);
+        H = random_matrix(N, k);
+        new_H = matrix_malloc(N, k);
+        W = (vectors != NULL) ? norm(vectors, NULL) : NULL;
+        P = (vectors != NULL) ? norm_packed(vectors, NULL) : NULL;
+        if(vectors == NULL || H == NULL || new_H == NULL || W == NULL || P == NULL)
+        {
+            matrix_free(vectors);
+            matrix_free(H);
+            matrix_free(new_H);
+            matrix_free(W);
+            packed_free(P);
+            return 1;
+        }
+        op.dense = W;
+        op.packed = P;
+        op.sparse = NULL;
+        op.stream = NULL;
+        op.dense_f32 = NULL;
+        op.packed_f32 = NULL;
+        for(t=0;t<(int)(sizeof(thread_counts)/sizeof(thread_counts[0]));t++)
+        {
+            for(kind=W_DENSE;kind<=W_PACKED;kind++)
+            {
+                op.kind = kind;
+                if((ws = symnmf_workspace_malloc(&op, N, k, thread_counts[t])) == NULL)
+                {
+                    matrix_free(vectors);
+                    matrix_free(H);
+                    matrix_free(new_H);
+                    matrix_free(W);
+                    packed_free(P);
+                    return 1;
+                }
+                start = now_seconds();
+                for(i=0;i<iterations;i++)
+                {
+                    symnmf_iterate(&op, H, new_H, ws);
+                }
+                times[kind] = (now_seconds() - start) / iterations;
+                if(t == 0) serial_times[kind] = times[kind];
+                symnmf_workspace_free(ws);
+            }
+            printf("%8d %8d %14.5f %8.2f %14.5f %8.2f\n", N, thread_counts[t], times[0], serial_times[0] / times[0],
+                   times[1], serial_times[1] / times[1]);
+            fflush(stdout);
+        }
+        matrix_free(vectors);
+        matrix_free(H);
+        matrix_free(new_H);
+        matrix_free(W);
+        packed_free(P);
+    }
+    return 0;
+}
+
+/*
+draws N points around k random centers in d dimensions, 5 units apart on average
+@param N: the number of points
+@param d: the dimension
+@param k: the number of centers
+@return matrix*: the points (N*d)
+*/
+static matrix* clustered_vectors(int N, int d, int k)
+{
+    int i,j;
+    matrix* centers = random_matrix(k, d);
+    matrix* vectors = random_matrix(N, d);
+
+    if(centers == NULL || vectors == NULL)
+    {
+        matrix_free(centers);
+        matrix_free(vectors);
+        return NULL;
+    }
+    for(i=0;i<N;i++)
+    {
+        for(j=0;j<d;j++)
+        {
+            MATRIX_AT(vectors, i, j) += 5 * MATRIX_AT(centers, i % k, j);
+        }
+    }
+    matrix_free(centers);
+    return vectors;
+}
+
+/*
+calculates the relative residual of a symnmf factorization
+@param W: the norm matrix (N*N)
+@param H: the symnmf matrix (N*k)
+@return double: ||W - H*H^T||_F / ||W||_F
+*/
+static double relative_residual(const matrix* W, const matrix* H)
+{
+    int i,j,l;
+    double product, diff, residual = 0, total = 0;
+    for(i=0;i<W->rows;i++)
+    {
+        for(j=0;j<W->cols;j++)
+        {
+            product = 0;
+            for(l=0;l<H->cols;l++)
+            {
+                product += MATRIX_AT(H, i, l) * MATRIX_AT(H, j, l);
+            }
+            diff = MATRIX_AT(W, i, j) - product;
+            residual += diff * diff;
+            total += MATRIX_AT(W, i, j) * MATRIX_AT(W, i, j);
+        }
+    }
+    return sqrt(residual / total);
+}
+
+/*
+runs every solver of symnmf_solve to the default tolerance on the norm matrix of N points drawn
+around 10 random centers (d = 10, k = 10), from the same initial H, reporting the iterations needed
+(up to 20000), the wall time and the relative residual ||W - H*H^T||_F / ||W||_F reached
+@param sizes: the values of N to benchmark
+@param count: the number of sizes
+@return int: 0 on success, 1 if memory allocation failed
+*/
+static int bench_solvers(const int* sizes, int count)
+{
+    static const char* names[] = {"mu", "nesterov", "pg"};
+    int s,i,j,solver,iterations;
+    int d = 10, k = 10;
+    double start, elapsed, mean;
+    matrix* vectors;
+    matrix* W;
+    matrix* H;
+    matrix* result;
+    symnmf_options options;
+    w_operator op;
+
+    symnmf_default_options(&options);
+    options.max_iter = 20000;
+    printf("%8s %10s %10s %10s %12s %12s\n", "N", "solver", "iterations", "time [s]", "time/it [s]", "residual");
+    for(s=0;s<count;s++)
+    {
+        int N = sizes[s];
+        vectors = clustered_vectors(N, d, k);
+        W = (vectors != NULL) ? norm(vectors, NULL) : NULL;
+        matrix_free(vectors);
+        if(W == NULL) return 1;
+        mean = 0;
+        for(i=0;i<N;i++)
+        {
+            for(j=0;j<N;j++)
+            {
+                mean += MATRIX_AT(W, i, j);
+            }
+        }
+        mean /= (double)N * N;
+        op.kind = W_DENSE;
+        op.dense = W;
+        op.packed = NULL;
+        op.sparse = NULL;
+        op.stream = NULL;
+        op.dense_f32 = NULL;
+        op.packed_f32 = NULL;
+        for(solver=SOLVER_MU;solver<=SOLVER_PG;solver++)
+        {
+            options.solver = solver;
+            if((H = symnmf_init_H(mean, N, k, 1234)) == NULL)
+            {
+                matrix_free(W);
+                return 1;
+            }
+            start = now_seconds();
+            result = symnmf_solve(&op, H, 0, &options, &iterations);
+            elapsed = now_seconds() - start;
+            matrix_free(H);
+            if(result == NULL)
+            {
+                matrix_free(W);
+                return 1;
+            }
+            printf("%8d %10s %10d %10.4f %12.2e %12.6f\n", N, names[solver], iterations, elapsed,
+                   elapsed / (iterations ? iterations : 1), relative_residual(W, result));
+            fflush(stdout);
+            matrix_free(result);
+        }
+        matrix_free(W);
+    }
+    return 0;
+}
+
+/*
+compares 8 restarts of symnmf on N clustered points (d = 10, k = 10) run as separate pipelines, each
+building W again, against symnmf_restarts on a single W, reporting the wall time, the lowest relative
+residual ||W - H*H^T||_F / ||W||_F found and the number of restarts abandoned
+@param sizes: the values of N to benchmark
+@param count: the number of sizes
+@return int: 0 on success, 1 if memory allocation failed
+*/
+static int bench_restarts(const int* sizes, int count)
+{
+    int s,r,abandoned;
+    int d = 10, k = 10, restarts = 8;
+    double start, separate_time, shared_time, residual, best_residual, objective;
+    matrix* vectors;
+    matrix* W;
+    matrix* H;
+
+    printf("%8s %9s %14s %14s %14s %14s %10s\n", "N", "restarts", "separate [s]", "residual", "shared [s]", "residual", "abandoned");
+    for(s=0;s<count;s++)
+    {
+        int N = sizes[s];
+        if((vectors = clustered_vectors(N, d, k)) == NULL || (W = norm(vectors, NULL)) == NULL)
+        {
+            matrix_free(vectors);
+            return 1;
+        }
+
+        separate_time = 0;
+        best_residual = -1;
+        for(r=0;r<restarts;r++)
+        {
+            start = now_seconds();
+            H = symnmf_from_vectors(vectors, k, 1234 + r, NULL, NULL, 1);
+            separate_time += now_seconds() - start;
+            if(H == NULL)
+            {
+                matrix_free(vectors);
+                matrix_free(W);
+                return 1;
+            }
+            residual = relative_residual(W, H);
+            if(best_residual < 0 || residual < best_residual) best_residual = residual;
+            matrix_free(H);
+        }
+        matrix_free(W);
+
+        start = now_seconds();
+        W = norm(vectors, NULL);
+        H = (W != NULL) ? symnmf_restarts(W, k, 1234, restarts, 0, NULL, &objective, &abandoned) : NULL;
+        shared_time = now_seconds() - start;
+        if(H == NULL)
+        {
+            matrix_free(vectors);
+            matrix_free(W);
+            return 1;
+        }
+        printf("%8d %9d %14.3f %14.6f %14.3f %14.6f %10d\n", N, restarts, separate_time, best_residual, shared_time,
+               relative_residual(W, H), abandoned);
+        fflush(stdout);
+        matrix_free(vectors);
+        matrix_free(W);
+        matrix_free(H);
+    }
+    return 0;
+}
+
+/*
+compares factorizing N clustered points (d = 10, k = 10) from scratch against extending the factorization
+of their first N - N/10 with the last N/10: the cold run builds W of all the points and starts from a
+random H, the warm run extends the W, degrees and H kept from the first points (built outside the timing)
+with norm_extend and warm_start_H, reporting the wall time, the iterations and the relative residual
+||W - H*H^T||_F / ||W||_F of both
+@param sizes: the values of N to benchmark
+@param count: the number of sizes
+@return int: 0 on success, 1 if memory allocation failed
+*/
+static int bench_incremental(const int* sizes, int count)
+{
+    int s,i,j,cold_iterations,warm_iterations;
+    int d = 10, k = 10;
+    double start, cold_time, warm_time, mean;
+    matrix old;
+    matrix* vectors;
+    matrix* W;
+    matrix* H;
+    matrix* cold;
+    matrix* W_old;
+    matrix* degrees_old;
+    matrix* H_old;
+    matrix* degrees;
+    matrix* warm;
+    w_operator op;
+
+    op.kind = W_DENSE;
+    op.packed = NULL;
+    op.sparse = NULL;
+    op.stream = NULL;
+    op.dense_f32 = NULL;
+    op.packed_f32 = NULL;
+    printf("%8s %6s %10s %10s %12s %10s %10s %12s\n", "N", "new", "cold [s]", "iterations", "residual", "warm [s]",
+           "iterations", "residual");
+    for(s=0;s<count;s++)
+    {
+        int N = sizes[s];
+        if((vectors = clustered_vectors(N, d, k)) == NULL) return 1;
+        old = *vectors;
+        old.rows = N - N / 10;
+
+        /* cold: W of all the points and a random H */
+        start = now_seconds();
+        if((W = norm(vectors, NULL)) == NULL)
+        {
+            matrix_free(vectors);
+            return 1;
+        }
+        mean = 0;
+        for(i=0;i<N;i++)
+        {
+            for(j=0;j<N;j++)
+            {
+                mean += MATRIX_AT(W, i, j);
+            }
+        }
+        mean /= (double)N * N;
+        H = symnmf_init_H(mean, N, k, 1234);
+        op.dense = W;
+        cold = (H != NULL) ? symnmf_solve(&op, H, 0, NULL, &cold_iterations) : NULL;
+        cold_time = now_seconds() - start;
+        matrix_free(W);
+        matrix_free(H);
+
+        /* warm: extend what the first points left */
+        W_old = norm(&old, NULL);
+        degrees_old = ddg_diagonal(&old, NULL);
+        H_old = symnmf_from_vectors(&old, k, 1234, NULL, NULL, 1);
+        degrees = NULL;
+        H = NULL;
+        warm = NULL;
+        start = now_seconds();
+        if(W_old != NULL && degrees_old != NULL && H_old != NULL &&
+           (W = norm_extend(W_old, degrees_old, vectors, &degrees, NULL)) != NULL)
+        {
+            op.dense = W;
+            if((H = warm_start_H(W, degrees_old, degrees, H_old, 0)) != NULL) warm = symnmf_solve(&op, H, 0, NULL, &warm_iterations);
+        }
+        else W = NULL;
+        warm_time = now_seconds() - start;
+        matrix_free(vectors);
+        matrix_free(W_old);
+        matrix_free(degrees_old);
+        matrix_free(H_old);
+        matrix_free(degrees);
+        matrix_free(H);
+        if(cold == NULL || warm == NULL)
+        {
+            matrix_free(W);
+            matrix_free(cold);
+            matrix_free(warm);
+            return 1;
+        }
+        printf("%8d %6d %10.3f %10d %12.6f %10.3f %10d %12.6f\n", N, N / 10, cold_time, cold_iterations,
+               relative_residual(W, cold), warm_time, warm_iterations, relative_residual(W, warm));
+        fflush(stdout);
+        matrix_free(W);
+        matrix_free(cold);
+        matrix_free(warm);
+    }
+    return 0;
+}
+
+/*
+calculates the fraction of points assigned the same cluster (the argmax of their row) by two symnmf matrices
+@param H: the first symnmf matrix (N*k)
+@param reference: the second symnmf matrix (N*k)
+@return double: the fraction of rows with the same argmax
+*/
+static double label_agreement(const matrix* H, const matrix* reference)
+{
+    int i,j,same = 0;
+    for(i=0;i<H->rows;i++)
+    {
+        int label = 0, reference_label = 0;
+        for(j=1;j<H->cols;j++)
+        {
+            if(MATRIX_AT(H, i, j) > MATRIX_AT(H, i, label)) label = j;
+            if(MATRIX_AT(reference, i, j) > MATRIX_AT(reference, i, reference_label)) reference_label = j;
+        }
+        same += (label == reference_label);
+    }
+    return (double)same / H->rows;
+}
+
+/*
+runs the symnmf pipeline on N clustered points (d = 10, k = 10) with W stored dense and packed, in double and in single
+precision, reporting the wall time, the iterations, the memory W takes, the fraction of points given the same cluster
+as the dense double run and the largest difference of H from it
+@param sizes: the values of N to benchmark
+@param count: the number of sizes
+@return int: 0 on success, 1 if memory allocation failed
+*/
+static int bench_precision(const int* sizes, int count)
+{
+    static const char* names[] = {"dense", "dense32", "packed", "packed32"};
+    int s,p;
+    int d = 10, k = 10;
+    int was_enabled = stats_enabled();
+    double start, elapsed, megabytes;
+    symnmf_config config = {0, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+    symnmf_stats stats;
+    matrix* vectors;
+    matrix* reference;
+    matrix* H;
+
+    stats_enable(1);
+    printf("%8s %8s %10s %10s %10s %10s %12s\n", "N", "W", "time [s]", "iterations", "W [MB]", "labels", "max diff");
+    for(s=0;s<count;s++)
+    {
+        int N = sizes[s];
+        if((vectors = clustered_vectors(N, d, k)) == NULL) return 1;
+        reference = NULL;
+        for(p=0;p<4;p++)
+        {
+            config.single = p % 2;
+            config.packed = p / 2;
+            stats_reset();
+            start = now_seconds();
+            H = symnmf_from_vectors(vectors, k, 1234, &config, NULL, 1);
+            elapsed = now_seconds() - start;
+            if(H == NULL)
+            {
+                matrix_free(vectors);
+                matrix_free(reference);
+                stats_enable(was_enabled);
+                return 1;
+            }
+            if(p == 0) reference = H;
+            stats_get(&stats);
+            megabytes = (config.packed ? (double)N * (N + 1) / 2 : (double)N * N) *
+                        (config.single ? sizeof(float) : sizeof(double)) / (1 << 20);
+            printf("%8d %8s %10.3f %10d %10.1f %10.4f %12.2e\n", N, names[p], elapsed, stats.iterations, megabytes,
+                   label_agreement(H, reference), max_abs_diff(H, reference));
+            fflush(stdout);
+            if(p != 0) matrix_free(H);
+        }
+        matrix_free(vectors);
+        matrix_free(reference);
+    }
+    stats_enable(was_enabled);
+    return 0;
+}
+
+/*
+the reader read_vectors_from_file used before csv_read, kept as the baseline of bench_csv:
+two passes with fgets into a fixed line buffer, strtok and atof
+@param filename: the name of the file
+@return matrix*: the matrix of vectors
+*/
+static matrix* legacy_read_vectors(const char* filename)
+{
+    char line[1024];
+    char temp[1024];
+    char* token;
+    int i,j;
+    int row_count = 0;
+    int col_count = 0;
+    matrix* vectors;
+
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) return NULL;
+    while (fgets(line, sizeof(line), file)) {
+        row_count++;
+        if (row_count == 1) {
+            strcpy(temp, line);
+            token = strtok(temp, ",");
+            while (token != NULL) {
+                col_count++;
+                token = strtok(NULL, ",");
+            }
+        }
+    }
+    if((vectors = matrix_malloc(row_count, col_count)) == NULL)
+    {
+        fclose(file);
+        return NULL;
+    }
+    rewind(file);
+    i = 0;
+    while (fgets(line, sizeof(line), file)) {
+        j = 0;
+        token = strtok(line, ",");
+        while (token != NULL) {
+            MATRIX_AT(vectors, i, j++) = atof(token);
+            token = strtok(NULL, ",");
+        }
+        i++;
+    }
+    fclose(file);
+    return vectors;
+}
+
+/*
+measures the throughput of the legacy reader and of csv_read (on 1 thread and on all of them)
+in MB/s on a file of N random 10 dimensional vectors printed with 4 decimals, like the inputs
+@param sizes: the values of N to benchmark
+@param count: the number of sizes
+@return int: 0 on success, 1 if memory allocation or the temporary file failed
+*/
+static int bench_csv(const int* sizes, int count)
+{
+    static const char* filename = "bench_csv.tmp";
+    int s,i,j,r;
+    int d = 10;
+    double start, mb, times[3];
+    matrix* vectors;
+    matrix* parsed[3];
+    FILE* file;
+
+    printf("%8s %10s %14s %14s %14s %8s\n", "N", "size [MB]", "legacy [MB/s]", "csv 1 [MB/s]", "csv T [MB/s]", "match");
+    for(s=0;s<count;s++)
+    {
+        int N = sizes[s];
+        if((vectors = random_matrix(N, d)) == NULL || (file = fopen(filename, "w")) == NULL)
+        {
+            matrix_free(vectors);
+            return 1;
+        }
+        for(i=0;i<N;i++)
+        {
+            for(j=0;j<d;j++)
+            {
+                fprintf(file, j ? ",%.4f" : "%.4f", 20 * MATRIX_AT(vectors, i, j) - 10);
+            }
+            fputc('\n', file);
+        }
+        mb = ftell(file) / 1048576.0;
+        fclose(file);
+        matrix_free(vectors);
+
+        for(r=0;r<3;r++)
+        {
+            start = now_seconds();
+            parsed[r] = (r == 0) ? legacy_read_vectors(filename) : csv_read(filename, (r == 1) ? 1 : config_threads(NULL));
+            times[r] = now_seconds() - start;
+        }
+        printf("%8d %10.1f %14.1f %14.1f %14.1f %8s\n", N, mb, mb / times[0], mb / times[1], mb / times[2],
+               (parsed[0] != NULL && parsed[1] != NULL && parsed[2] != NULL && max_abs_diff(parsed[0], parsed[1]) == 0 &&
+                max_abs_diff(parsed[0], parsed[2]) == 0) ? "yes" : "no");
+        fflush(stdout);
+        for(r=0;r<3;r++)
+        {
+            matrix_free(parsed[r]);
+        }
+    }
+    remove(filename);
+    return 0;
+}
+
+/*
+the printf loop print_matrix used before fprint_matrix, kept as the baseline of bench_print
+@param file: the destination
+@param mat: the matrix to be printed
+@return void
+*/
+static void legacy_print_matrix(FILE* file, const matrix* mat)
+{
+    int i,j;
+    for(i=0;i<mat->rows;i++)
+    {
+        const double* row = MATRIX_ROW(mat, i);
+        for(j=0;j<mat->cols;j++)
+        {
+            fprintf(file, "%.4f ", row[j]);
+            if(j != mat->cols-1)
+            {
+                fprintf(file, ",");
+            }
+        }
+        fprintf(file, "\n");
+    }
+}
+
+/*
+compares the files written by two runs byte for byte
+@param first: the name of the first file
+@param second: the name of the second file
+@return int: 1 if the files are identical, 0 otherwise
+*/
+static int same_contents(const char* first, const char* second)
+{
+    int a, b, same = 1;
+    FILE* file1 = fopen(first, "rb");
+    FILE* file2 = fopen(second, "rb");
+    if(file1 == NULL || file2 == NULL) same = 0;
+    while(same)
+    {
+        a = getc(file1);
+        b = getc(file2);
+        if(a != b) same = 0;
+        if(a == EOF) break;
+    }
+    if(file1 != NULL) fclose(file1);
+    if(file2 != NULL) fclose(file2);
+    return same;
+}
+
+/*
+measures the throughput of the printf loop and of fprint_matrix (on 1 thread and on all of them)
+in MB/s, printing the norm matrix of N random vectors to a file
+@param sizes: the values of N to benchmark
+@param count: the number of sizes
+@return int: 0 on success, 1 if memory allocation or the temporary files failed
+*/
+static int bench_print(const int* sizes, int count)
+{
+    static const char* filenames[3] = {"bench_print_0.tmp", "bench_print_1.tmp", "bench_print_2.tmp"};
+    int s,r;
+    double start, mb = 0, times[3];
+    matrix* vectors;
+    matrix* W;
+    FILE* file;
+
+    printf("%8s %10s %14s %16s %16s %8s\n", "N", "size [MB]", "printf [MB/s]", "fprint 1 [MB/s]", "fprint T [MB/s]", "match");
+    for(s=0;s<count;s++)
+    {
+        int N = sizes[s];
+        vectors = random_matrix(N, 10);
+        if(vectors == NULL || (W = norm(vectors, NULL)) == NULL)
+        {
+            matrix_free(vectors);
+            return 1;
+        }
+        for(r=0;r<3;r++)
+        {
+            if((file = fopen(filenames[r], "wb")) == NULL)
+            {
+                matrix_free(vectors);
+                matrix_free(W);
+                return 1;
+            }
+            start = now_seconds();
+            if(r == 0) legacy_print_matrix(file, W);
+            else fprint_matrix(file, W, (r == 1) ? 1 : config_threads(NULL));
+            fflush(file);
+            times[r] = now_seconds() - start;
+            mb = ftell(file) / 1048576.0;
+            fclose(file);
+        }
+        printf("%8d %10.1f %14.1f %16.1f %16.1f %8s\n", N, mb, mb / times[0], mb / times[1], mb / times[2],
+               (same_contents(filenames[0], filenames[1]) && same_contents(filenames[0], filenames[2])) ? "yes" : "no");
+        fflush(stdout);
+        matrix_free(vectors);
+        matrix_free(W);
+    }
+    for(r=0;r<3;r++)
+    {
+        remove(filenames[r]);
+    }
+    return 0;
+}
+
+/*
+parses the sizes given on the command line, falling back to the defaults
+@param argc: the number of command line arguments left
+@param argv: the command line arguments left
+@param defaults: the default sizes
+@param default_count: the number of default sizes
+@param count: set to the number of sizes returned
+@return int*: the sizes (to be freed by the caller)
+*/
+static int* parse_sizes(int argc, char* argv[], const int* defaults, int default_count, int* count)
+{
+    int i;
+    int* sizes;
+    *count = (argc > 0) ? argc : default_count;
+    if((sizes = malloc(*count * sizeof(int))) == NULL) return NULL;
+    for(i=0;i<*count;i++)
+    {
+        sizes[i] = (argc > 0) ? atoi(argv[i]) : defaults[i];
+    }
+    return sizes;
+}
+
+int main(int argc, char* argv[])
+{
+    static const int gemm_sizes[] = {1000, 5000, 20000};
+    static const int sym_sizes[] = {5000, 10000, 30000};
+    static const int exp_sizes[] = {1000, 1000000};
+    static const int stream_sizes[] = {2000, 5000, 10000};
+    static const int symnmf_sizes[] = {2000, 5000, 10000};
+    static const int solvers_sizes[] = {500, 2000, 5000};
+    static const int restarts_sizes[] = {1000, 2000, 4000};
+    static const int incremental_sizes[] = {1000, 2000, 4000};
+    static const int precision_sizes[] = {1000, 2000, 4000};
+    static const int csv_sizes[] = {10000, 100000, 1000000};
+    static const int print_sizes[] = {1000, 3000, 6000};
+    int* sizes;
+    int count, status = 1;
+
+    srand(1234);
+    simd_level(); /* detect the instruction set once, before the parallel regions that dispatch on it */
+    if(argc >= 2 && !strcmp(argv[1], "gemm"))
+    {
+        if((sizes = parse_sizes(argc - 2, argv + 2, gemm_sizes, 3, &count)) == NULL) return 1;
+        status = bench_gemm(sizes, count);
+        free(sizes);
+    }
+    else if(argc >= 2 && !strcmp(argv[1], "sym"))
+    {
+        if((sizes = parse_sizes(argc - 2, argv + 2, sym_sizes, 3, &count)) == NULL) return 1;
+        status = bench_sym(sizes, count);
+        free(sizes);
+    }
+    else if(argc >= 2 && !strcmp(argv[1], "exp"))
+    {
+        if((sizes = parse_sizes(argc - 2, argv + 2, exp_sizes, 2, &count)) == NULL) return 1;
+        status = bench_exp(sizes, count);
+        free(sizes);
+    }
+    else if(argc >= 2 && !strcmp(argv[1], "stream"))
+    {
+        if((sizes = parse_sizes(argc - 2, argv + 2, stream_sizes, 3, &count)) == NULL) return 1;
+        status = bench_stream(sizes, count);
+        free(sizes);
+    }
+    else if(argc >= 2 && !strcmp(argv[1], "symnmf"))
+    {
+        if((sizes = parse_sizes(argc - 2, argv + 2, symnmf_sizes, 3, &count)) == NULL) return 1;
+        status = bench_symnmf(sizes, count);
+        free(sizes);
+    }
+    else if(argc >= 2 && !strcmp(argv[1], "solvers"))
+    {
+        if((sizes = parse_sizes(argc - 2, argv + 2, solvers_sizes, 3, &count)) == NULL) return 1;
+        status = bench_solvers(sizes, count);
+        free(sizes);
+    }
+    else if(argc >= 2 && !strcmp(argv[1], "restarts"))
+    {
+        if((sizes = parse_sizes(argc - 2, argv + 2, restarts_sizes, 3, &count)) == NULL) return 1;
+        status = bench_restarts(sizes, count);
+        free(sizes);
+    }
+    else if(argc >= 2 && !strcmp(argv[1], "incremental"))
+    {
+        if((sizes = parse_sizes(argc - 2, argv + 2, incremental_sizes, 3, &count)) == NULL) return 1;
+        status = bench_incremental(sizes, count);
+        free(sizes);
+    }
+    else if(argc >= 2 && !strcmp(argv[1], "precision"))
+    {
+        if((sizes = parse_sizes(argc - 2, argv + 2, precision_sizes, 3, &count)) == NULL) return 1;
+        status = bench_precision(sizes, count);
+        free(sizes);
+    }
+    else if(argc >= 2 && !strcmp(argv[1], "csv"))
+    {
+        if((sizes = parse_sizes(argc - 2, argv + 2, csv_sizes, 3, &count)) == NULL) return 1;
+        status = bench_csv(sizes, count);
+        free(sizes);
+    }
+    else if(argc >= 2 && !strcmp(argv[1], "print"))
+    {
+        if((sizes = parse_sizes(argc - 2, argv + 2, print_sizes, 3, &count)) == NULL) return 1;
+        status = bench_print(sizes, count);
+        free(sizes);
+    }
+    else
+    {
+        printf("usage: %s gemm|sym|exp|stream|symnmf|solvers|restarts|incremental|precision|csv|print [N ...]\n", argv[0]);
+    }
+    if(status != 0 && argc >= 2) printf("An Error Has Occured\n");
+    return status;
+}
@@ -0,0 +1,366 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define CSV_MMAP
+#endif
+#include "csv.h"
+#include "stats.h"
+
+#define CSV_MIN_CHUNK (1 << 20)  /* bytes of input below which another parsing thread does not pay off */
+#define CSV_TOKEN_LENGTH 64      /* tokens shorter than this are copied to the stack for strtod */
+#define CSV_FIRST_ROWS 64        /* rows a chunk reserves before it starts doubling */
+#define MANTISSA_LIMIT 900719925474099.0 /* (2^53 - 9) / 10: below it, mantissa * 10 + digit stays exact */
+
+/* the powers of ten that are exact doubles */
+static const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+the rows parsed by one chunk of the file, grown by doubling since the number of rows
+is only known once the chunk is parsed
+*/
+typedef struct csv_rows
+{
+    double* values; /* rows*cols values, row by row */
+    size_t rows;
+    size_t capacity;
+    int failed;     /* 1 if memory allocation failed, 2 if a row has the wrong number of values */
+} csv_rows;
+
+/*
+parses a token with strtod, for the numbers the fast path of csv_parse_double cannot round exactly
+the token is copied since it is not null terminated in the file
+@param begin: the first character of the token
+@param end: the end of the data
+@param value: set to the parsed value
+@return const char*: the delimiter ending the token (or end), NULL if memory allocation failed
+*/
+static const char* parse_double_slow(const char* begin, const char* end, double* value)
+{
+    char local[CSV_TOKEN_LENGTH];
+    char* token = local;
+    const char* token_end = begin;
+    size_t length;
+
+    while(token_end < end && *token_end != ',' && *token_end != '\n') token_end++;
+    length = token_end - begin;
+    if(length >= CSV_TOKEN_LENGTH)
+    {
+        if((token = malloc(length + 1)) == NULL)
+        {
+            printf("An Error Has Occured");
+            return NULL;
+        }
+        stats_allocated(length + 1);
+    }
+    memcpy(token, begin, length);
+    token[length] = '\0';
+    *value = strtod(token, NULL);
+    if(token != local) free(token);
+    return token_end;
+}
+
+/*
+parses one value of a CSV file, with the result strtod would give
+a decimal with at most 15-16 significant digits and an exponent of at most 22 in magnitude is
+exactly mantissa * 10^e or mantissa / 10^-e of two exact doubles, a single correctly rounded
+operation (Clinger's fast path); any other token (more digits, large exponents, nan, inf, hex
+or garbage) goes to strtod
+@param p: the first character of the value, leading spaces are skipped
+@param end: the end of the data
+@param value: set to the parsed value
+@return const char*: the delimiter (',' or '\n') ending the value, or end; NULL if memory allocation failed
+*/
+const char* csv_parse_double(const char* p, const char* end, double* value)
+{
+    const char* start;
+    double mantissa = 0;
+    int negative = 0, exact = 1, digits = 0;
+    int exponent = 0, exp_value = 0, exp_negative = 0;
+
+    while(p < end && (*p == ' ' || *p == '\t')) p++;
+    start = p;
+    if(p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        p++;
+    }
+    for(;p<end && *p >= '0' && *p <= '9';p++,digits++)
+    {
+        if(mantissa < MANTISSA_LIMIT) mantissa = mantissa * 10 + (*p - '0');
+        else
+        {
+            exponent++; /* a dropped integer digit still scales the value */
+            if(*p != '0') exact = 0;
+        }
+    }
+    if(p < end && *p == '.')
+    {
+        for(p++;p<end && *p >= '0' && *p <= '9';p++,digits++)
+        {
+            if(mantissa < MANTISSA_LIMIT)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+            else if(*p != '0') exact = 0;
+        }
+    }
+    if(digits > 0 && p + 1 < end && (*p == 'e' || *p == 'E'))
+    {
+        const char* q = p + 1;
+        if(*q == '-' || *q == '+')
+        {
+            exp_negative = (*q == '-');
+            q++;
+        }
+        if(q < end && *q >= '0' && *q <= '9')
+        {
+            for(p=q;p<end && *p >= '0' && *p <= '9';p++)
+            {
+                if(exp_value < 10000) exp_value = exp_value * 10 + (*p - '0');
+            }
+        }
+    }
+    exponent += exp_negative ? -exp_value : exp_value;
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+
+    if(digits == 0 || (p < end && *p != ',' && *p != '\n')) return parse_double_slow(start, end, value);
+    if(mantissa != 0 && (!exact || exponent < -22 || exponent > 22)) return parse_double_slow(start, end, value);
+    if(mantissa != 0 && exponent < 0) mantissa /= powers_of_ten[-exponent];
+    else if(mantissa != 0) mantissa *= powers_of_ten[exponent];
+    *value = negative ? -mantissa : mantissa;
+    return p;
+}
+
+/*
+checks whether a line holds no value
+@param p: the first character of the line
+@param end: the end of the data
+@return const char*: the character after the line if it is blank, NULL otherwise
+*/
+static const char* skip_blank_line(const char* p, const char* end)
+{
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    if(p == end) return p;
+    return (*p == '\n') ? p + 1 : NULL;
+}
+
+/*
+parses the lines starting in [begin, limit) into rows of cols values
+the last line may run past limit, up to the end of the data
+@param begin: the first character of the chunk, at the start of a line
+@param limit: the end of the chunk
+@param end: the end of the data
+@param cols: the number of values per row
+@param out: the rows to fill, failed is set on error
+@return void
+*/
+static void parse_chunk(const char* begin, const char* limit, const char* end, int cols, csv_rows* out)
+{
+    const char* p = begin;
+    const char* next;
+    double* row;
+    double* grown;
+    int j;
+
+    while(p < limit)
+    {
+        if((next = skip_blank_line(p, end)) != NULL)
+        {
+            p = next;
+            continue;
+        }
+        if(out->rows == out->capacity)
+        {
+            out->capacity = out->capacity ? 2 * out->capacity : CSV_FIRST_ROWS;
+            if((grown = realloc(out->values, out->capacity * cols * sizeof(double))) == NULL)
+            {
+                printf("An Error Has Occured");
+                out->failed = 1;
+                return;
+            }
+            stats_allocated(out->capacity * cols * sizeof(double)); /* every size the chunk grows to */
+            out->values = grown;
+        }
+        row = out->values + out->rows * cols;
+        for(j=0;j<cols;j++)
+        {
+            if((p = csv_parse_double(p, end, &row[j])) == NULL)
+            {
+                out->failed = 1;
+                return;
+            }
+            if(j < cols - 1 && (p == end || *p++ != ',')) /* too few values */
+            {
+                out->failed = 2;
+                return;
+            }
+        }
+        if(p < end && *p++ != '\n') /* too many values */
+        {
+            out->failed = 2;
+            return;
+        }
+        out->rows++;
+    }
+}
+
+/*
+finds the start of the first line beginning at or after an offset
+@param data: the data
+@param size: the size of the data
+@param offset: the offset
+@return size_t: the offset of the line
+*/
+static size_t line_start(const char* data, size_t size, size_t offset)
+{
+    if(offset == 0) return 0;
+    while(offset < size && data[offset - 1] != '\n') offset++;
+    return offset;
+}
+
+/*
+parses CSV data into a matrix in a single pass, one row per non blank line
+the data is split at line boundaries into one chunk per thread (at least CSV_MIN_CHUNK bytes each),
+every chunk grows its own rows and the rows are copied into the matrix in chunk order
+@param data: the data, not necessarily null terminated
+@param size: the size of the data
+@param threads: the number of threads to use
+@return matrix*: the matrix of values, NULL on error (rows of different lengths or memory allocation)
+*/
+matrix* csv_parse(const char* data, size_t size, int threads)
+{
+    const char* end = data + size;
+    const char* p = data;
+    const char* next;
+    int c,chunks,cols = 1;
+    size_t i,rows = 0;
+    int failed = 0;
+    csv_rows* parts;
+    matrix* result;
+
+    /* the columns are counted on the first non blank line */
+    while((next = skip_blank_line(p, end)) != NULL && next != p) p = next;
+    if(p == end) return matrix_malloc(0, 0);
+    for(;p<end && *p != '\n';p++)
+    {
+        if(*p == ',') cols++;
+    }
+
+    chunks = (size / CSV_MIN_CHUNK < (size_t)threads) ? (int)(size / CSV_MIN_CHUNK) : threads;
+    if(chunks < 1) chunks = 1;
+    if((parts = calloc(chunks, sizeof(csv_rows))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    stats_allocated(chunks * sizeof(csv_rows));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(chunks) schedule(static, 1)
+#endif
+    for(c=0;c<chunks;c++)
+    {
+        size_t begin = line_start(data, size, size / chunks * c);
+        size_t limit = (c == chunks - 1) ? size : line_start(data, size, size / chunks * (c + 1));
+        if(begin < limit) parse_chunk(data + begin, data + limit, end, cols, &parts[c]);
+    }
+    for(c=0;c<chunks;c++)
+    {
+        if(parts[c].failed > failed) failed = parts[c].failed;
+        rows += parts[c].rows;
+    }
+    if(failed == 2) printf("An Error Has Occured");
+
+    result = failed ? NULL : matrix_malloc((int)rows, cols);
+    for(c=0,rows=0;result!=NULL && c<chunks;c++)
+    {
+        for(i=0;i<parts[c].rows;i++,rows++)
+        {
+            memcpy(MATRIX_ROW(result, rows), parts[c].values + i * cols, cols * sizeof(double));
+        }
+    }
+    for(c=0;c<chunks;c++)
+    {
+        free(parts[c].values);
+    }
+    free(parts);
+    return result;
+}
+
+/*
+reads a CSV file of vectors into a matrix with csv_parse
+the file is mapped into memory where mmap is available and read whole otherwise
+@param filename: the name of the file
+@param threads: the number of threads to use
+@return matrix*: the matrix of vectors, NULL on error
+*/
+matrix* csv_read(const char* filename, int threads)
+{
+    matrix* result;
+    size_t size;
+#ifdef CSV_MMAP
+    struct stat info;
+    void* data;
+    int fd = open(filename, O_RDONLY);
+
+    if(fd < 0 || fstat(fd, &info) != 0)
+    {
+        perror("Error opening file");
+        if(fd >= 0) close(fd);
+        return NULL;
+    }
+    size = (size_t)info.st_size;
+    if(size == 0)
+    {
+        close(fd);
+        return csv_parse("", 0, threads);
+    }
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+    {
+        perror("Error opening file");
+        return NULL;
+    }
+    posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+    result = csv_parse(data, size, threads);
+    munmap(data, size);
+#else
+    char* data;
+    long length;
+    FILE* file = fopen(filename, "rb");
+
+    if(file == NULL || fseek(file, 0, SEEK_END) != 0 || (length = ftell(file)) < 0)
+    {
+        perror("Error opening file");
+        if(file != NULL) fclose(file);
+        return NULL;
+    }
+    size = (size_t)length;
+    rewind(file);
+    if((data = malloc(size + 1)) == NULL)
+    {
+        printf("An Error Has Occured");
+        fclose(file);
+        return NULL;
+    }
+    stats_allocated(size + 1);
+    size = fread(data, 1, size, file);
+    fclose(file);
+    result = csv_parse(data, size, threads);
+    free(data);
+#endif
+    return result;
+}
@@ -0,0 +1,11 @@
+/* C header file for the CSV reader */
+#ifndef CSV_H
+#define CSV_H
+
+#include "symnmf.h"
+
+const char* csv_parse_double(const char* p, const char* end, double* value);
+matrix* csv_parse(const char* data, size_t size, int threads);
+matrix* csv_read(const char* filename, int threads);
+
+#endif
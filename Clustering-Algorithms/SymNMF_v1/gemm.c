@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gemm.h"
+#include "simd.h"
+#include "stats.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/*
+calculates the number of elements needed for the packing buffers of gemm, doubles for gemm and floats
+for gemm_f32
+@param p: the number of columns of B (and C)
+@return size_t: the size of the A block plus the size of the B panel
+*/
+size_t gemm_buffer_size(int p)
+{
+    int nc = MIN(GEMM_NC, p);
+    size_t a_size = (size_t)GEMM_MC * GEMM_KC;
+    size_t b_size = (size_t)GEMM_KC * ((nc + GEMM_NR - 1) / GEMM_NR * GEMM_NR);
+    return a_size + b_size;
+}
+
+/*
+calculates the gram matrix G = A^T*A of a tall matrix without forming the transpose
+G is accumulated as the sum of the outer products of the rows of A, so A is read once
+row by row, and only the upper triangle is computed before being mirrored
+@param A: the matrix (n*k)
+@param G: the result matrix (k*k)
+@return void
+*/
+void gram(const matrix* A, matrix* G)
+{
+    int i,a,b;
+    int k = A->cols;
+
+    for(a=0;a<k;a++)
+    {
+        memset(MATRIX_ROW(G, a), 0, k * sizeof(double));
+    }
+    for(i=0;i<A->rows;i++)
+    {
+        const double* row = MATRIX_ROW(A, i);
+        for(a=0;a<k;a++)
+        {
+            double* g_row = MATRIX_ROW(G, a);
+            double value = row[a];
+            for(b=a;b<k;b++)
+            {
+                g_row[b] += value * row[b];
+            }
+        }
+    }
+    for(a=0;a<k;a++)
+    {
+        for(b=0;b<a;b++)
+        {
+            MATRIX_AT(G, a, b) = MATRIX_AT(G, b, a);
+        }
+    }
+}
+
+/*
+finds where a chunk of block rows of a symmetric matrix starts so that all chunks hold about the
+same part of its upper triangle, for kernels that sweep the triangle one block row at a time
+the rows before r hold r*(2n-r+1)/2 elements, the start is rounded up to a multiple of block
+@param n: the order of the matrix
+@param chunk: the index of the chunk
+@param chunks: the number of chunks
+@param block: the number of rows in a block row
+@return int: the first row of the chunk (n for chunk == chunks)
+*/
+int symm_chunk_row(int n, int chunk, int chunks, int block)
+{
+    double target = 0.5 * n * (n + 1.0) * chunk / chunks;
+    int low = 0, high = n, mid;
+    if(chunk >= chunks) return n;
+    while(low < high) /* smallest row whose preceding rows hold at least target elements */
+    {
+        mid = low + (high - low) / 2;
+        if(0.5 * mid * (2.0 * n - mid + 1) < target) low = mid + 1;
+        else high = mid;
+    }
+    return MIN(n, (low + block - 1) / block * block);
+}
+
+/* the number of doubles taking the space of count elements of the instantiated type */
+#define REAL_DOUBLES(count) (((count) * sizeof(REAL) + sizeof(double) - 1) / sizeof(double))
+
+/* gemm_accumulate, gemm, symm_buffer_size and symm_packed on matrices of doubles */
+#define REAL double
+#define REAL_MATRIX matrix
+#define REAL_PACKED packed_matrix
+#define REAL_NAME(name) name
+#define REAL_KERNEL micro_kernel_fn
+#include "gemm_template.h"
+#undef REAL
+#undef REAL_MATRIX
+#undef REAL_PACKED
+#undef REAL_NAME
+#undef REAL_KERNEL
+
+/* the same kernels on matrices of floats, named with an _f32 suffix */
+#define REAL float
+#define REAL_MATRIX matrix_f32
+#define REAL_PACKED packed_matrix_f32
+#define REAL_NAME(name) name##_f32
+#define REAL_KERNEL micro_kernel_f32_fn
+#include "gemm_template.h"
+#undef REAL
+#undef REAL_MATRIX
+#undef REAL_PACKED
+#undef REAL_NAME
+#undef REAL_KERNEL
@@ -0,0 +1,37 @@
+/* C header file for the blocked matrix multiplication kernels */
+#ifndef GEMM_H
+#define GEMM_H
+
+#include "symnmf.h"
+
+/* register tile computed by the micro-kernel (GEMM_MR rows of A times GEMM_NR columns of B) */
+#define GEMM_MR 4
+#define GEMM_NR 4
+
+/*
+cache blocking: a GEMM_MC*GEMM_KC block of A is packed to stay in L2,
+a GEMM_KC*GEMM_NR sliver of the packed B panel streams through L1
+and the whole GEMM_KC*GEMM_NC panel of B is sized for L3
+*/
+#define GEMM_MC 64
+#define GEMM_KC 256
+#define GEMM_NC 2048
+
+/* rows of a packed symmetric matrix processed together by symm_packed, copied into a dense block for gemm */
+#define SYMM_BLOCK 64
+
+size_t gemm_buffer_size(int p);
+void gemm_accumulate(const matrix* A, const matrix* B, matrix* C, double* buffer);
+int gemm(const matrix* A, const matrix* B, matrix* C, double* buffer);
+void gram(const matrix* A, matrix* G);
+int symm_chunk_row(int n, int chunk, int chunks, int block);
+size_t symm_buffer_size(int n, int k, int threads);
+int symm_packed(const packed_matrix* A, const matrix* B, matrix* C, double* buffer, int threads);
+
+/* the same kernels on matrices of floats, the products are still added to matrices of doubles */
+void gemm_accumulate_f32(const matrix_f32* A, const matrix_f32* B, matrix* C, float* buffer);
+int gemm_f32(const matrix_f32* A, const matrix_f32* B, matrix* C, float* buffer);
+size_t symm_buffer_size_f32(int n, int k, int threads);
+int symm_packed_f32(const packed_matrix_f32* A, const matrix_f32* B, matrix* C, double* buffer, int threads);
+
+#endif
@@ -0,0 +1,359 @@
+/*
+the gemm and symm kernels written once for the element type of their inputs, included by gemm.c once per precision with
+REAL: the element type of A and B (and of the packed matrix of symm_packed)
+REAL_MATRIX: the matrix type holding REAL, laid out like matrix
+REAL_PACKED: the packed symmetric matrix type holding REAL, laid out like packed_matrix
+REAL_NAME(name): the name of a function in that precision
+REAL_KERNEL: the micro-kernel type of that precision, see simd.h
+the products are always added to a matrix of doubles: in float the micro-kernel sums every GEMM_KC deep slice in
+float and the slices are added up in double, so the rounding error is that of a float sum of GEMM_KC terms
+there is deliberately no include guard
+*/
+
+/*
+packs an mc*kc block of A into micro-panels of GEMM_MR rows
+inside a micro-panel the GEMM_MR values of each column are contiguous, rows past mc are zero padded
+@param A: the source matrix
+@param ic: the first row of the block
+@param pc: the first column of the block
+@param mc: the number of rows in the block
+@param kc: the number of columns in the block
+@param packed: the destination buffer
+@return void
+*/
+static void REAL_NAME(pack_A)(const REAL_MATRIX* A, int ic, int pc, int mc, int kc, REAL* packed)
+{
+    int ir,i,p;
+    for(ir=0;ir<mc;ir+=GEMM_MR)
+    {
+        int mr = MIN(GEMM_MR, mc - ir);
+        for(i=0;i<GEMM_MR;i++)
+        {
+            const REAL* row = (i < mr) ? MATRIX_ROW(A, ic + ir + i) + pc : NULL;
+            for(p=0;p<kc;p++)
+            {
+                packed[p*GEMM_MR + i] = (row != NULL) ? row[p] : 0;
+            }
+        }
+        packed += (size_t)GEMM_MR * kc;
+    }
+}
+
+/*
+packs a kc*nc panel of B into micro-panels of GEMM_NR columns
+inside a micro-panel the GEMM_NR values of each row are contiguous, columns past nc are zero padded
+@param B: the source matrix
+@param pc: the first row of the panel
+@param jc: the first column of the panel
+@param kc: the number of rows in the panel
+@param nc: the number of columns in the panel
+@param packed: the destination buffer
+@return void
+*/
+static void REAL_NAME(pack_B)(const REAL_MATRIX* B, int pc, int jc, int kc, int nc, REAL* packed)
+{
+    int jr,j,p;
+    for(jr=0;jr<nc;jr+=GEMM_NR)
+    {
+        int nr = MIN(GEMM_NR, nc - jr);
+        for(p=0;p<kc;p++)
+        {
+            const REAL* row = MATRIX_ROW(B, pc + p) + jc + jr;
+            for(j=0;j<nr;j++)
+            {
+                packed[j] = row[j];
+            }
+            for(;j<GEMM_NR;j++)
+            {
+                packed[j] = 0;
+            }
+            packed += GEMM_NR;
+        }
+    }
+}
+
+/*
+adds the product of two matrices to a preallocated matrix of doubles, C += A*B
+the product is computed in GEMM_NC column panels and GEMM_KC deep slices of B,
+each slice is packed once and reused by every GEMM_MC row block of A
+@param A: the first matrix (n*m)
+@param B: the second matrix (m*p)
+@param C: the result matrix (n*p), must not alias A or B
+@param buffer: packing space of gemm_buffer_size(p) elements
+@return void
+*/
+void REAL_NAME(gemm_accumulate)(const REAL_MATRIX* A, const REAL_MATRIX* B, matrix* C, REAL* buffer)
+{
+    int jc,pc,ic,jr,ir;
+    int n = A->rows, m = A->cols, p = B->cols;
+    REAL* packed_A = buffer;
+    REAL* packed_B = buffer + (size_t)GEMM_MC * GEMM_KC;
+    REAL_KERNEL micro_kernel = REAL_NAME(simd_micro_kernel)();
+
+    for(jc=0;jc<p;jc+=GEMM_NC)
+    {
+        int nc = MIN(GEMM_NC, p - jc);
+        for(pc=0;pc<m;pc+=GEMM_KC)
+        {
+            int kc = MIN(GEMM_KC, m - pc);
+            REAL_NAME(pack_B)(B, pc, jc, kc, nc, packed_B);
+            for(ic=0;ic<n;ic+=GEMM_MC)
+            {
+                int mc = MIN(GEMM_MC, n - ic);
+                REAL_NAME(pack_A)(A, ic, pc, mc, kc, packed_A);
+                for(jr=0;jr<nc;jr+=GEMM_NR)
+                {
+                    for(ir=0;ir<mc;ir+=GEMM_MR)
+                    {
+                        micro_kernel(kc, packed_A + (size_t)ir*kc, packed_B + (size_t)jr*kc,
+                                     MATRIX_ROW(C, ic + ir) + jc + jr, C->stride,
+                                     MIN(GEMM_MR, mc - ir), MIN(GEMM_NR, nc - jr));
+                    }
+                }
+            }
+        }
+    }
+}
+
+/*
+multiplies two matrices into a preallocated matrix of doubles, C = A*B
+@param A: the first matrix (n*m)
+@param B: the second matrix (m*p)
+@param C: the result matrix (n*p), must not alias A or B
+@param buffer: packing space of gemm_buffer_size(p) elements, or NULL to allocate it here
+@return int: 0 on success, 1 if memory allocation failed
+*/
+int REAL_NAME(gemm)(const REAL_MATRIX* A, const REAL_MATRIX* B, matrix* C, REAL* buffer)
+{
+    int i;
+    REAL* own_buffer = NULL;
+
+    if(buffer == NULL)
+    {
+        if((own_buffer = malloc(gemm_buffer_size(B->cols) * sizeof(REAL))) == NULL)
+        {
+            printf("An Error Has Occured");
+            return 1;
+        }
+        stats_allocated(gemm_buffer_size(B->cols) * sizeof(REAL));
+        buffer = own_buffer;
+    }
+
+    for(i=0;i<A->rows;i++)
+    {
+        memset(MATRIX_ROW(C, i), 0, B->cols * sizeof(double));
+    }
+    REAL_NAME(gemm_accumulate)(A, B, C, buffer);
+
+    free(own_buffer);
+    return 0;
+}
+
+/*
+calculates the number of doubles one chunk of symm_packed needs for its scratch space
+@param n: the order of the packed matrix
+@param k: the number of columns of B (and C)
+@return size_t: the size of the dense copy of a block row, of the transposed block of B,
+of the transposed product (in double) and of the gemm packing space
+*/
+static size_t REAL_NAME(symm_chunk_size)(int n, int k)
+{
+    return REAL_DOUBLES((size_t)SYMM_BLOCK * n) + REAL_DOUBLES((size_t)k * SYMM_BLOCK) + (size_t)k * n +
+           REAL_DOUBLES(gemm_buffer_size(n > k ? n : k));
+}
+
+/*
+calculates the number of doubles needed for the scratch space of symm_packed
+@param n: the order of the packed matrix
+@param k: the number of columns of B (and C)
+@param threads: the number of threads symm_packed is called with
+@return size_t: the scratch space of every chunk, plus one partial result per chunk when threaded
+*/
+size_t REAL_NAME(symm_buffer_size)(int n, int k, int threads)
+{
+    if(threads < 1) threads = 1;
+    return threads * REAL_NAME(symm_chunk_size)(n, k) + (threads > 1 ? (size_t)threads * n * k : 0);
+}
+
+/*
+adds the block rows [begin, end) of a packed symmetric matrix times a tall matrix to C
+each block row adds to its own rows of C and, through the mirrored lower triangle, to the rows below it
+@param A: the packed symmetric matrix (n*n)
+@param B: the tall matrix (n*k)
+@param C: the result matrix (n*k), must not alias B
+@param buffer: scratch space of symm_chunk_size(n, k) doubles
+@param begin: the first row, a multiple of SYMM_BLOCK
+@param end: one past the last row, a multiple of SYMM_BLOCK or n
+@return void
+*/
+static void REAL_NAME(symm_packed_blocks)(const REAL_PACKED* A, const REAL_MATRIX* B, matrix* C, double* buffer,
+                                          int begin, int end)
+{
+    int bi,i,j,c,block_end,m;
+    int n = A->n, k = B->cols;
+    double a;
+    REAL* gemm_space;
+    REAL_MATRIX rect, b_rest, b_block_t;
+    matrix c_block, product_t;
+
+    rect.data = (REAL*)buffer;
+    b_block_t.data = (REAL*)(buffer + REAL_DOUBLES((size_t)SYMM_BLOCK * n));
+    product_t.data = buffer + REAL_DOUBLES((size_t)SYMM_BLOCK * n) + REAL_DOUBLES((size_t)k * SYMM_BLOCK);
+    gemm_space = (REAL*)(product_t.data + (size_t)k * n);
+
+    for(bi=begin;bi<end;bi+=SYMM_BLOCK)
+    {
+        block_end = MIN(n, bi + SYMM_BLOCK);
+        m = n - block_end;
+
+        /* the triangle on the diagonal of the block */
+        for(i=bi;i<block_end;i++)
+        {
+            const REAL* a_row = PACKED_ROW(A, i) - i; /* indexed by column */
+            const REAL* b_i = MATRIX_ROW(B, i);
+            double* c_i = MATRIX_ROW(C, i);
+            for(c=0;c<k;c++)
+            {
+                c_i[c] += (double)a_row[i] * b_i[c];
+            }
+            for(j=i+1;j<block_end;j++)
+            {
+                const REAL* b_j = MATRIX_ROW(B, j);
+                double* c_j = MATRIX_ROW(C, j);
+                a = a_row[j];
+                for(c=0;c<k;c++)
+                {
+                    c_i[c] += a * b_j[c];
+                    c_j[c] += a * b_i[c];
+                }
+            }
+        }
+        if(m == 0) continue;
+
+        /* the rectangle right of the block, as a dense (block_end-bi)*m matrix */
+        rect.rows = block_end - bi;
+        rect.cols = rect.stride = m;
+        for(i=bi;i<block_end;i++)
+        {
+            memcpy(MATRIX_ROW(&rect, i - bi), PACKED_ROW(A, i) + (block_end - i), m * sizeof(REAL));
+        }
+
+        /* C_block += R*B_rest */
+        b_rest.data = MATRIX_ROW(B, block_end);
+        b_rest.rows = m;
+        b_rest.cols = k;
+        b_rest.stride = B->stride;
+        c_block.data = MATRIX_ROW(C, bi);
+        c_block.rows = block_end - bi;
+        c_block.cols = k;
+        c_block.stride = C->stride;
+        REAL_NAME(gemm_accumulate)(&rect, &b_rest, &c_block, gemm_space);
+
+        /* C_rest += R^T*B_block, from the k*m product B_block^T*R */
+        b_block_t.rows = k;
+        b_block_t.cols = b_block_t.stride = block_end - bi;
+        for(i=bi;i<block_end;i++)
+        {
+            for(c=0;c<k;c++)
+            {
+                MATRIX_AT(&b_block_t, c, i - bi) = MATRIX_AT(B, i, c);
+            }
+        }
+        product_t.rows = k;
+        product_t.cols = product_t.stride = m;
+        REAL_NAME(gemm)(&b_block_t, &rect, &product_t, gemm_space);
+        for(j=0;j<m;j++)
+        {
+            double* c_j = MATRIX_ROW(C, block_end + j);
+            for(c=0;c<k;c++)
+            {
+                c_j[c] += MATRIX_AT(&product_t, c, j);
+            }
+        }
+    }
+}
+
+/*
+multiplies a symmetric matrix stored as a packed upper triangle by a tall matrix into a matrix of doubles, C = A*B
+the triangle is swept in blocks of SYMM_BLOCK rows: the small triangle on the diagonal is
+applied directly, the rectangle R right of it is copied into a dense matrix and used twice
+through gemm, once for its rows (C_block += R*B_rest) and once as the mirrored lower
+triangle (C_rest += R^T*B_block, computed as (B_block^T*R)^T), so the triangle is read once
+with several threads the block rows are split into chunks of equal work, each chunk adds into
+its own partial result and the partials are summed in chunk order, so the result only depends
+on the thread count
+@param A: the packed symmetric matrix (n*n)
+@param B: the tall matrix (n*k)
+@param C: the result matrix (n*k), must not alias B
+@param buffer: scratch space of symm_buffer_size(n, k, threads) doubles, or NULL to allocate it here
+@param threads: the number of threads to use
+@return int: 0 on success, 1 if memory allocation failed
+*/
+int REAL_NAME(symm_packed)(const REAL_PACKED* A, const REAL_MATRIX* B, matrix* C, double* buffer, int threads)
+{
+    int i,c,t;
+    int n = A->n, k = B->cols;
+    size_t chunk_size = REAL_NAME(symm_chunk_size)(n, k);
+    double* own_buffer = NULL;
+    double* partials;
+    matrix partial;
+
+    if(threads < 1) threads = 1;
+    if(buffer == NULL)
+    {
+        if((own_buffer = malloc(REAL_NAME(symm_buffer_size)(n, k, threads) * sizeof(double))) == NULL)
+        {
+            printf("An Error Has Occured");
+            return 1;
+        }
+        stats_allocated(REAL_NAME(symm_buffer_size)(n, k, threads) * sizeof(double));
+        buffer = own_buffer;
+    }
+
+    if(threads <= 1)
+    {
+        for(i=0;i<n;i++)
+        {
+            memset(MATRIX_ROW(C, i), 0, k * sizeof(double));
+        }
+        REAL_NAME(symm_packed_blocks)(A, B, C, buffer, 0, n);
+        free(own_buffer);
+        return 0;
+    }
+
+    partials = buffer + threads * chunk_size;
+    memset(partials, 0, (size_t)threads * n * k * sizeof(double));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 1) private(partial)
+#endif
+    for(t=0;t<threads;t++)
+    {
+        partial.data = partials + (size_t)t * n * k;
+        partial.rows = n;
+        partial.cols = partial.stride = k;
+        REAL_NAME(symm_packed_blocks)(A, B, &partial, buffer + t * chunk_size,
+                                      symm_chunk_row(n, t, threads, SYMM_BLOCK),
+                                      symm_chunk_row(n, t + 1, threads, SYMM_BLOCK));
+    }
+
+    /* C is the sum of the partials, taken in chunk order */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) private(c, t)
+#endif
+    for(i=0;i<n;i++)
+    {
+        double* c_i = MATRIX_ROW(C, i);
+        memcpy(c_i, partials + (size_t)i * k, k * sizeof(double));
+        for(t=1;t<threads;t++)
+        {
+            const double* p_i = partials + ((size_t)t * n + i) * k;
+            for(c=0;c<k;c++)
+            {
+                c_i[c] += p_i[c];
+            }
+        }
+    }
+
+    free(own_buffer);
+    return 0;
+}
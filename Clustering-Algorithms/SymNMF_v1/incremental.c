@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "incremental.h"
+#include "simd.h"
+#include "stats.h"
+
+#define WARM_NEIGHBOURS 10 /* old points whose memberships initialize the H row of a new point */
+
+/*
+extends the norm matrix of N points with the M points appended after them, computing only the
+similarities of the pairs with a new point: the degree of an old point grows by its similarities to
+the new ones, d'_i = d_i + sum_m a_im, so an old entry becomes w_ij*sqrt(d_i*d_j/(d'_i*d'_j)) and the
+new rows and columns are a_ij/sqrt(d'_i*d'_j)
+the similarities cost O(M*(N+M)*vecdim) instead of the O((N+M)^2*vecdim) of norm on all the points,
+the rest is one pass over the (N+M)^2 result
+@param W: the norm matrix of the old points (N*N)
+@param degrees: the degrees of the old points, as ddg_diagonal returns them (N*1)
+@param vectors: the old points followed by the new ones ((N+M)*vecdim)
+@param new_degrees: set to the degrees of all the points ((N+M)*1)
+@param config: the engine settings (may be NULL for the defaults)
+@return matrix*: the norm matrix of all the points ((N+M)*(N+M))
+*/
+matrix* norm_extend(const matrix* W, const matrix* degrees, const matrix* vectors, matrix** new_degrees,
+                    const symnmf_config* config)
+{
+    int i;
+    int N = W->rows, total = vectors->rows, vecdim = vectors->cols;
+    int threads = config_threads(config);
+    int exp_mode = (config != NULL) ? config->exp_mode : EXP_LIBM;
+    double* scale;
+    matrix* extended;
+    matrix* d;
+    (void)threads;
+
+    extended = matrix_malloc(total, total);
+    d = matrix_malloc(total, 1);
+    scale = malloc((N + 1) * sizeof(double));
+    if(extended == NULL || d == NULL || scale == NULL) /* Memory allocation failed */
+    {
+        if(scale == NULL) printf("An Error Has Occured");
+        matrix_free(extended);
+        matrix_free(d);
+        free(scale);
+        return NULL;
+    }
+    stats_allocated((N + 1) * sizeof(double));
+
+    /* the similarities of the new points to all the points, and their degrees */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 16)
+#endif
+    for(i=N;i<total;i++)
+    {
+        int j;
+        double sum = 0;
+        double* row = MATRIX_ROW(extended, i);
+        const double* vec_i = MATRIX_ROW(vectors, i);
+        for(j=0;j<total;j++)
+        {
+            row[j] = -euclidean_distance(vec_i, MATRIX_ROW(vectors, j), vecdim, 1) / 2;
+        }
+        simd_exp(row, total, exp_mode);
+        row[i] = 0;
+        for(j=0;j<total;j++)
+        {
+            sum += row[j];
+        }
+        MATRIX_AT(d, i, 0) = sum;
+    }
+
+    /* the old degrees grow by the similarities to the new points */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads)
+#endif
+    for(i=0;i<N;i++)
+    {
+        int m;
+        double sum = MATRIX_AT(degrees, i, 0);
+        for(m=N;m<total;m++)
+        {
+            sum += MATRIX_AT(extended, m, i);
+        }
+        MATRIX_AT(d, i, 0) = sum;
+        scale[i] = sqrt(MATRIX_AT(degrees, i, 0) / sum);
+    }
+
+    /* rescale the old entries and normalize the new columns of the old rows, which read the new rows unscaled */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads)
+#endif
+    for(i=0;i<N;i++)
+    {
+        int j;
+        const double* old_row = MATRIX_ROW(W, i);
+        double* row = MATRIX_ROW(extended, i);
+        double d_i = MATRIX_AT(d, i, 0);
+        for(j=0;j<N;j++)
+        {
+            row[j] = old_row[j] * scale[i] * scale[j];
+        }
+        for(j=N;j<total;j++)
+        {
+            row[j] = MATRIX_AT(extended, j, i) / sqrt(d_i * MATRIX_AT(d, j, 0));
+        }
+    }
+
+    /* normalize the new rows */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads)
+#endif
+    for(i=N;i<total;i++)
+    {
+        int j;
+        double* row = MATRIX_ROW(extended, i);
+        double d_i = MATRIX_AT(d, i, 0);
+        for(j=0;j<total;j++)
+        {
+            row[j] /= sqrt(d_i * MATRIX_AT(d, j, 0));
+        }
+    }
+
+    free(scale);
+    *new_degrees = d;
+    return extended;
+}
+
+/*
+builds the initial H of the extended points from the H factorizing the old ones, for a warm started symnmf:
+an old row is scaled by sqrt(d_i/d'_i), like its entries of W, so that H*H^T keeps tracking W, and the row
+of a new point is the average of the scaled rows of its WARM_NEIGHBOURS most similar old points weighted by
+their entries of W (the plain average of the old rows when it is similar to none of them)
+@param W: the extended norm matrix, from norm_extend ((N+M)*(N+M))
+@param degrees: the degrees of the old points (N*1)
+@param new_degrees: the degrees of all the points, from norm_extend ((N+M)*1)
+@param H: the symnmf matrix of the old points (N*k, N >= 1)
+@param threads: the number of threads to use (0 for all available cores)
+@return matrix*: the initial H of all the points ((N+M)*k)
+*/
+matrix* warm_start_H(const matrix* W, const matrix* degrees, const matrix* new_degrees, const matrix* H,
+                     int threads)
+{
+    int i,l;
+    int N = H->rows, k = H->cols, total = W->rows;
+    matrix* result;
+
+    threads = (threads > 0) ? threads : config_threads(NULL);
+    (void)threads;
+
+    if((result = matrix_malloc(total, k)) == NULL) return NULL; /* Memory allocation failed */
+    for(i=0;i<N;i++)
+    {
+        double scale = sqrt(MATRIX_AT(degrees, i, 0) / MATRIX_AT(new_degrees, i, 0));
+        for(l=0;l<k;l++)
+        {
+            MATRIX_AT(result, i, l) = MATRIX_AT(H, i, l) * scale;
+        }
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 16)
+#endif
+    for(i=N;i<total;i++)
+    {
+        int j,n,c,count = 0;
+        int nearest[WARM_NEIGHBOURS];
+        double weights[WARM_NEIGHBOURS];
+        double weight_sum = 0;
+        const double* w_row = MATRIX_ROW(W, i);
+        double* row = MATRIX_ROW(result, i);
+
+        /* the old points with the largest entries, in decreasing order */
+        for(j=0;j<N;j++)
+        {
+            if(!(w_row[j] > 0) || (count == WARM_NEIGHBOURS && w_row[j] <= weights[count - 1])) continue;
+            n = (count < WARM_NEIGHBOURS) ? count++ : count - 1;
+            while(n > 0 && weights[n - 1] < w_row[j])
+            {
+                weights[n] = weights[n - 1];
+                nearest[n] = nearest[n - 1];
+                n--;
+            }
+            weights[n] = w_row[j];
+            nearest[n] = j;
+        }
+
+        memset(row, 0, k * sizeof(double));
+        for(n=0;n<count;n++)
+        {
+            weight_sum += weights[n];
+            for(c=0;c<k;c++)
+            {
+                row[c] += weights[n] * MATRIX_AT(result, nearest[n], c);
+            }
+        }
+        if(count == 0) /* isolated from the old points */
+        {
+            for(j=0;j<N;j++)
+            {
+                for(c=0;c<k;c++)
+                {
+                    row[c] += MATRIX_AT(result, j, c);
+                }
+            }
+            weight_sum = N;
+        }
+        for(c=0;c<k;c++)
+        {
+            row[c] /= weight_sum;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,12 @@
+/* C header file for extending a symnmf factorization with appended points */
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "symnmf.h"
+
+matrix* norm_extend(const matrix* W, const matrix* degrees, const matrix* vectors, matrix** new_degrees,
+                    const symnmf_config* config);
+matrix* warm_start_H(const matrix* W, const matrix* degrees, const matrix* new_degrees, const matrix* H,
+                     int threads);
+
+#endif
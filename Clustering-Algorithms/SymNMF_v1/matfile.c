@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matfile.h"
+#include "stats.h"
+
+static const unsigned char matfile_magic[8] = {0x89, 'S', 'Y', 'M', 'N', 'M', 'F', '\n'};
+
+/*
+checks the byte order of the host, doubles are assumed to follow the byte order of integers
+@return int: 1 if the host is little endian, 0 otherwise
+*/
+static int host_little_endian(void)
+{
+    unsigned long one = 1;
+    return *(unsigned char*)&one == 1;
+}
+
+/*
+stores an unsigned integer as little endian bytes
+@param bytes: the destination
+@param value: the value
+@param size: the number of bytes to store, the bytes beyond the width of unsigned long are zero
+@return void
+*/
+static void put_le(unsigned char* bytes, unsigned long value, int size)
+{
+    int b;
+    for(b=0;b<size;b++)
+    {
+        bytes[b] = (b < (int)sizeof(unsigned long)) ? (unsigned char)(value >> (8 * b) & 0xff) : 0;
+    }
+}
+
+/*
+reads a little endian unsigned integer that must fit in an int
+@param bytes: the source
+@param size: the number of bytes
+@param value: set to the value
+@return int: 0 on success, 1 if the value does not fit in an int
+*/
+static int get_le_int(const unsigned char* bytes, int size, int* value)
+{
+    int b;
+    unsigned long result = 0;
+    for(b=size-1;b>=0;b--)
+    {
+        if(b >= 4 && bytes[b] != 0) return 1;
+        result = (result << 8) | bytes[b];
+    }
+    if(result > 0x7fffffffUL) return 1;
+    *value = (int)result;
+    return 0;
+}
+
+/*
+writes the header of a binary matrix file
+@param file: the destination
+@param rows: the number of rows
+@param cols: the number of columns
+@return int: 0 on success, 1 if writing failed
+*/
+static int write_header(FILE* file, int rows, int cols)
+{
+    unsigned char header[MATFILE_HEADER_SIZE];
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, matfile_magic, sizeof(matfile_magic));
+    put_le(header + 8, MATFILE_VERSION, 4);
+    put_le(header + 12, MATFILE_FLOAT64, 4);
+    put_le(header + 16, (unsigned long)rows, 8);
+    put_le(header + 24, (unsigned long)cols, 8);
+    put_le(header + 32, MATFILE_HEADER_SIZE, 8);
+    return fwrite(header, 1, sizeof(header), file) != sizeof(header);
+}
+
+/*
+reverses the bytes of every double, converting between the host and the file byte order
+on big endian hosts
+@param values: the values to convert in place
+@param count: the number of values
+@return void
+*/
+static void swap_doubles(double* values, int count)
+{
+    int i,b;
+    unsigned char* bytes = (unsigned char*)values;
+    unsigned char swap;
+    for(i=0;i<count;i++,bytes+=sizeof(double))
+    {
+        for(b=0;b<(int)sizeof(double)/2;b++)
+        {
+            swap = bytes[b];
+            bytes[b] = bytes[sizeof(double) - 1 - b];
+            bytes[sizeof(double) - 1 - b] = swap;
+        }
+    }
+}
+
+/*
+writes a row of the payload
+@param file: the destination
+@param row: the values of the row
+@param count: the number of values
+@param scratch: space for count doubles, used to convert the byte order on big endian hosts
+@return int: 0 on success, 1 if writing failed
+*/
+static int write_row(FILE* file, const double* row, int count, double* scratch)
+{
+    if(!host_little_endian())
+    {
+        memcpy(scratch, row, count * sizeof(double));
+        swap_doubles(scratch, count);
+        row = scratch;
+    }
+    return fwrite(row, sizeof(double), count, file) != (size_t)count;
+}
+
+/*
+writes a matrix as a binary matrix file, see matfile.h for the format
+@param file: the destination, opened in binary mode
+@param mat: the matrix
+@return int: 0 on success, 1 if writing or memory allocation failed
+*/
+int matfile_write(FILE* file, const matrix* mat)
+{
+    int i, failed;
+    double* scratch;
+
+    if((scratch = malloc((mat->cols + 1) * sizeof(double))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return 1;
+    }
+    stats_allocated((mat->cols + 1) * sizeof(double));
+    failed = write_header(file, mat->rows, mat->cols);
+    for(i=0;i<mat->rows && !failed;i++)
+    {
+        failed = write_row(file, MATRIX_ROW(mat, i), mat->cols, scratch);
+    }
+    free(scratch);
+    return failed;
+}
+
+/*
+writes a packed symmetric matrix in full as a binary matrix file, like print_packed prints it
+@param file: the destination, opened in binary mode
+@param mat: the matrix
+@return int: 0 on success, 1 if writing or memory allocation failed
+*/
+int matfile_write_packed(FILE* file, const packed_matrix* mat)
+{
+    int i,j, failed;
+    double* row;
+
+    if((row = malloc((2 * mat->n + 1) * sizeof(double))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return 1;
+    }
+    stats_allocated((2 * mat->n + 1) * sizeof(double));
+    failed = write_header(file, mat->n, mat->n);
+    for(i=0;i<mat->n && !failed;i++)
+    {
+        for(j=0;j<i;j++)
+        {
+            row[j] = PACKED_ROW(mat, j)[i - j];
+        }
+        memcpy(row + i, PACKED_ROW(mat, i), (mat->n - i) * sizeof(double));
+        failed = write_row(file, row, mat->n, row + mat->n);
+    }
+    free(row);
+    return failed;
+}
+
+/*
+writes the entries of a sparse matrix as a binary matrix file of nnz rows (row, column, value),
+like print_sparse prints them
+@param file: the destination, opened in binary mode
+@param mat: the matrix
+@return int: 0 on success, 1 if writing failed
+*/
+int matfile_write_sparse(FILE* file, const csr_matrix* mat)
+{
+    int i,p;
+    int failed = write_header(file, mat->nnz, 3);
+    double entry[3], scratch[3];
+
+    for(i=0;i<mat->n && !failed;i++)
+    {
+        for(p=mat->row_ptr[i];p<mat->row_ptr[i + 1] && !failed;p++)
+        {
+            entry[0] = i;
+            entry[1] = mat->col[p];
+            entry[2] = mat->val[p];
+            failed = write_row(file, entry, 3, scratch);
+        }
+    }
+    return failed;
+}
+
+/*
+writes a matrix to a binary matrix file through a temporary file renamed over it once complete,
+so an interrupted write never leaves a truncated file (e.g. a checkpoint) behind
+@param filename: the name of the file
+@param mat: the matrix
+@return int: 0 on success, 1 if writing or memory allocation failed
+*/
+int matfile_save(const char* filename, const matrix* mat)
+{
+    int failed;
+    char* temporary;
+    FILE* file;
+
+    if((temporary = malloc(strlen(filename) + 5)) == NULL)
+    {
+        printf("An Error Has Occured");
+        return 1;
+    }
+    stats_allocated(strlen(filename) + 5);
+    sprintf(temporary, "%s.tmp", filename);
+    if((file = fopen(temporary, "wb")) == NULL)
+    {
+        perror("Error opening file");
+        free(temporary);
+        return 1;
+    }
+    failed = matfile_write(file, mat);
+    failed = (fclose(file) != 0) || failed;
+    if(!failed && rename(temporary, filename) != 0)
+    {
+        perror("Error renaming file");
+        failed = 1;
+    }
+    if(failed) remove(temporary);
+    free(temporary);
+    return failed;
+}
+
+/*
+reads a binary matrix file, see matfile.h for the format
+@param filename: the name of the file
+@return matrix*: the matrix, NULL if the file cannot be read, is not a version 1 float64
+matrix file or is truncated (checked against the file size before the matrix is allocated)
+*/
+matrix* matfile_read(const char* filename)
+{
+    unsigned char header[MATFILE_HEADER_SIZE];
+    int i, rows, cols, version, dtype, offset;
+    long size;
+    matrix* mat;
+    FILE* file = fopen(filename, "rb");
+
+    if(file == NULL)
+    {
+        perror("Error opening file");
+        return NULL;
+    }
+    if(fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, matfile_magic, sizeof(matfile_magic)) != 0 ||
+       get_le_int(header + 8, 4, &version) || version != MATFILE_VERSION || get_le_int(header + 12, 4, &dtype) ||
+       dtype != MATFILE_FLOAT64 || get_le_int(header + 16, 8, &rows) || get_le_int(header + 24, 8, &cols) ||
+       get_le_int(header + 32, 8, &offset) || offset < MATFILE_HEADER_SIZE || fseek(file, 0, SEEK_END) != 0 ||
+       (size = ftell(file)) < 0 || (double)offset + (double)rows * cols * sizeof(double) > (double)size ||
+       fseek(file, offset, SEEK_SET) != 0) /* a payload past the end of the file is not allocated */
+    {
+        printf("An Error Has Occured");
+        fclose(file);
+        return NULL;
+    }
+    if((mat = matrix_malloc(rows, cols)) == NULL) /* Memory allocation failed */
+    {
+        fclose(file);
+        return NULL;
+    }
+    for(i=0;i<rows;i++)
+    {
+        if(fread(MATRIX_ROW(mat, i), sizeof(double), cols, file) != (size_t)cols) /* truncated payload */
+        {
+            printf("An Error Has Occured");
+            matrix_free(mat);
+            fclose(file);
+            return NULL;
+        }
+        if(!host_little_endian()) swap_doubles(MATRIX_ROW(mat, i), cols);
+    }
+    fclose(file);
+    return mat;
+}
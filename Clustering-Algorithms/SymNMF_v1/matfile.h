@@ -0,0 +1,31 @@
+/* C header file for the binary matrix file format */
+#ifndef MATFILE_H
+#define MATFILE_H
+
+#include <stdio.h>
+#include "symnmf.h"
+
+/*
+a binary matrix file is a MATFILE_HEADER_SIZE byte header followed by the payload:
+  bytes  0-7   magic "\x89SYMNMF\n"
+  bytes  8-11  format version (MATFILE_VERSION), unsigned 32 bit
+  bytes 12-15  dtype of the values (MATFILE_FLOAT64), unsigned 32 bit
+  bytes 16-23  rows, unsigned 64 bit
+  bytes 24-31  columns, unsigned 64 bit
+  bytes 32-39  offset of the payload from the start of the file, unsigned 64 bit
+  bytes 40-63  reserved, zero
+all integers are little endian; the payload holds rows*columns values row by row with no
+padding, as little endian IEEE 754 doubles, so the file can be mapped directly, e.g.
+numpy.memmap(path, dtype='<f8', mode='r', offset=64, shape=(rows, columns))
+*/
+#define MATFILE_HEADER_SIZE 64
+#define MATFILE_VERSION 1
+#define MATFILE_FLOAT64 1
+
+int matfile_write(FILE* file, const matrix* mat);
+int matfile_write_packed(FILE* file, const packed_matrix* mat);
+int matfile_write_sparse(FILE* file, const csr_matrix* mat);
+int matfile_save(const char* filename, const matrix* mat);
+matrix* matfile_read(const char* filename);
+
+#endif
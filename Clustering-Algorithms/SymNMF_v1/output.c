@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "output.h"
+#include "stats.h"
+
+#define OUTPUT_BUFFER_SIZE (1 << 20) /* bytes collected before each fwrite */
+#define OUTPUT_TASK_ROWS 16          /* rows formatted by one thread at a time in parallel mode */
+#define OUTPUT_PARALLEL_MIN (1 << 18) /* values below which formatting on several threads does not pay off */
+#define FIXED4_LIMIT 1e9             /* magnitude from which format_fixed4 leaves the digits to sprintf */
+
+/*
+text collected for one fwrite: flushed to file when full, or grown when there is no file
+(the per thread buffers of the parallel mode are written out by the caller in order)
+*/
+typedef struct text_buffer
+{
+    FILE* file;
+    char* data;
+    size_t used;
+    size_t capacity;
+    int failed; /* set by the threads of the parallel mode when memory allocation failed */
+} text_buffer;
+
+/*
+formats a double like printf("%.4f"), byte for byte
+the value is scaled by 10^4 and rounded to an integer, whose digits are written directly;
+when the scaled value is within its rounding error of a tie (where the exact decimal value of the
+double decides the rounding), and for NaN, infinities and magnitudes from FIXED4_LIMIT, sprintf
+formats the value instead
+@param value: the value
+@param dest: the destination, with room for FIXED4_MAX_LENGTH + 1 characters
+@return size_t: the number of characters written, the null terminator excluded
+*/
+size_t format_fixed4(double value, char* dest)
+{
+    char digits[16];
+    double magnitude, scaled, whole, fraction, integer_part;
+    unsigned long integer;
+    int remainder, count = 0;
+    int negative;
+    char* p = dest;
+
+    if(!(value > -FIXED4_LIMIT && value < FIXED4_LIMIT)) return (size_t)sprintf(dest, "%.4f", value);
+    negative = value < 0 || (value == 0 && 1 / value < 0);
+    magnitude = negative ? -value : value;
+    scaled = magnitude * 10000;
+    whole = floor(scaled);
+    fraction = scaled - whole;
+    if(fabs(fraction - 0.5) <= scaled * 4.5e-16) return (size_t)sprintf(dest, "%.4f", value); /* too close to a tie */
+    if(fraction > 0.5) whole += 1;
+
+    integer_part = floor(whole / 10000);
+    integer = (unsigned long)integer_part;
+    remainder = (int)(whole - integer_part * 10000);
+    if(negative) *p++ = '-';
+    do
+    {
+        digits[count++] = (char)('0' + integer % 10);
+        integer /= 10;
+    } while(integer != 0);
+    while(count > 0)
+    {
+        *p++ = digits[--count];
+    }
+    p[0] = '.';
+    p[1] = (char)('0' + remainder / 1000);
+    p[2] = (char)('0' + remainder / 100 % 10);
+    p[3] = (char)('0' + remainder / 10 % 10);
+    p[4] = (char)('0' + remainder % 10);
+    p[5] = '\0';
+    return (size_t)(p + 5 - dest);
+}
+
+/*
+makes room for some bytes in a text buffer, writing out its contents if it has a file
+and growing it otherwise (or if the contents alone do not leave enough room)
+@param tb: the buffer
+@param bytes: the number of bytes needed
+@return int: 0 on success, 1 if writing or memory allocation failed
+*/
+static int reserve(text_buffer* tb, size_t bytes)
+{
+    char* grown;
+    size_t capacity;
+
+    if(tb->used + bytes <= tb->capacity) return 0;
+    if(tb->file != NULL)
+    {
+        if(tb->used > 0 && fwrite(tb->data, 1, tb->used, tb->file) != tb->used) return 1;
+        tb->used = 0;
+        if(bytes <= tb->capacity) return 0;
+    }
+    capacity = tb->capacity ? tb->capacity : OUTPUT_BUFFER_SIZE;
+    while(capacity < tb->used + bytes) capacity *= 2;
+    if((grown = realloc(tb->data, capacity)) == NULL)
+    {
+        printf("An Error Has Occured");
+        return 1;
+    }
+    stats_allocated(capacity); /* every size the buffer grows to */
+    tb->data = grown;
+    tb->capacity = capacity;
+    return 0;
+}
+
+/*
+appends a row in the format of the text output: every value as "%.4f " and a "," between them
+@param tb: the buffer
+@param row: the values of the row
+@param count: the number of values
+@return int: 0 on success, 1 if writing or memory allocation failed
+*/
+static int append_row(text_buffer* tb, const double* row, int count)
+{
+    int j;
+    for(j=0;j<count;j++)
+    {
+        if(reserve(tb, FIXED4_MAX_LENGTH + 3) != 0) return 1;
+        tb->used += format_fixed4(row[j], tb->data + tb->used);
+        tb->data[tb->used++] = ' ';
+        tb->data[tb->used++] = (j != count - 1) ? ',' : '\n';
+    }
+    if(count == 0)
+    {
+        if(reserve(tb, 1) != 0) return 1;
+        tb->data[tb->used++] = '\n';
+    }
+    return 0;
+}
+
+/*
+writes out what is left in a text buffer with a file and frees it
+@param tb: the buffer
+@param failed: whether an earlier write failed, in which case nothing is written
+@return int: 0 on success, 1 if this or an earlier write failed
+*/
+static int finish(text_buffer* tb, int failed)
+{
+    if(!failed && tb->used > 0 && fwrite(tb->data, 1, tb->used, tb->file) != tb->used) failed = 1;
+    free(tb->data);
+    return failed;
+}
+
+/*
+formats the rows [first, last) of a matrix into a buffer without a file, replacing its contents
+@param mat: the matrix
+@param first: the first row
+@param last: the end of the rows (may be before first, for no rows)
+@param tb: the buffer, failed is set if memory allocation failed
+@return void
+*/
+static void format_rows(const matrix* mat, int first, int last, text_buffer* tb)
+{
+    int i;
+    tb->used = 0;
+    for(i=first;i<last && !tb->failed;i++)
+    {
+        tb->failed = append_row(tb, MATRIX_ROW(mat, i), mat->cols);
+    }
+}
+
+/*
+prints a matrix of doubles, one line per row with every value as "%.4f " and a "," between them
+the text is collected in large buffers written with fwrite; for large matrices and threads > 1,
+blocks of rows are formatted on all threads at once, OUTPUT_TASK_ROWS rows per thread,
+and written out in order
+@param file: the destination
+@param mat: the matrix to be printed
+@param threads: the number of threads to format on
+@return int: 0 on success, 1 if writing or memory allocation failed
+*/
+int fprint_matrix(FILE* file, const matrix* mat, int threads)
+{
+    int i,t,first,failed = 0;
+    text_buffer tb = {NULL, NULL, 0, 0, 0};
+    text_buffer* parts;
+
+    if(threads <= 1 || (double)mat->rows * mat->cols < OUTPUT_PARALLEL_MIN)
+    {
+        tb.file = file;
+        for(i=0;i<mat->rows && !failed;i++)
+        {
+            failed = append_row(&tb, MATRIX_ROW(mat, i), mat->cols);
+        }
+        return finish(&tb, failed);
+    }
+
+    if((parts = calloc(threads, sizeof(text_buffer))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return 1;
+    }
+    stats_allocated(threads * sizeof(text_buffer));
+    for(first=0;first<mat->rows && !failed;first+=threads*OUTPUT_TASK_ROWS)
+    {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static, 1)
+#endif
+        for(t=0;t<threads;t++)
+        {
+            int begin = first + t * OUTPUT_TASK_ROWS;
+            int end = (begin + OUTPUT_TASK_ROWS < mat->rows) ? begin + OUTPUT_TASK_ROWS : mat->rows;
+            format_rows(mat, begin, end, &parts[t]);
+        }
+        for(t=0;t<threads && !failed;t++)
+        {
+            failed = parts[t].failed || (parts[t].used > 0 && fwrite(parts[t].data, 1, parts[t].used, file) != parts[t].used);
+        }
+    }
+    for(t=0;t<threads;t++)
+    {
+        free(parts[t].data);
+    }
+    free(parts);
+    return failed;
+}
+
+/*
+prints a packed symmetric matrix in full, in the same format as fprint_matrix
+@param file: the destination
+@param mat: the matrix to be printed
+@return int: 0 on success, 1 if writing or memory allocation failed
+*/
+int fprint_packed(FILE* file, const packed_matrix* mat)
+{
+    int i,j,failed = 0;
+    double* row;
+    text_buffer tb = {NULL, NULL, 0, 0, 0};
+
+    if((row = malloc((mat->n + 1) * sizeof(double))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return 1;
+    }
+    stats_allocated((mat->n + 1) * sizeof(double));
+    tb.file = file;
+    for(i=0;i<mat->n && !failed;i++)
+    {
+        for(j=0;j<i;j++)
+        {
+            row[j] = PACKED_ROW(mat, j)[i - j];
+        }
+        memcpy(row + i, PACKED_ROW(mat, i), (mat->n - i) * sizeof(double));
+        failed = append_row(&tb, row, mat->n);
+    }
+    free(row);
+    return finish(&tb, failed);
+}
+
+/*
+prints the entries of a sparse matrix, one "row,column,value" line per entry with the value as "%.4f"
+@param file: the destination
+@param mat: the matrix to be printed
+@return int: 0 on success, 1 if writing or memory allocation failed
+*/
+int fprint_sparse(FILE* file, const csr_matrix* mat)
+{
+    int i,p,failed = 0;
+    text_buffer tb = {NULL, NULL, 0, 0, 0};
+
+    tb.file = file;
+    for(i=0;i<mat->n && !failed;i++)
+    {
+        for(p=mat->row_ptr[i];p<mat->row_ptr[i + 1] && !failed;p++)
+        {
+            if((failed = reserve(&tb, FIXED4_MAX_LENGTH + 32)) != 0) break;
+            tb.used += sprintf(tb.data + tb.used, "%d,%d,", i, mat->col[p]);
+            tb.used += format_fixed4(mat->val[p], tb.data + tb.used);
+            tb.data[tb.used++] = '\n';
+        }
+    }
+    return finish(&tb, failed);
+}
@@ -0,0 +1,15 @@
+/* C header file for the buffered text output of matrices */
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+#include "symnmf.h"
+
+#define FIXED4_MAX_LENGTH 320 /* characters of the longest "%.4f" of a double (-DBL_MAX), without the null */
+
+size_t format_fixed4(double value, char* dest);
+int fprint_matrix(FILE* file, const matrix* mat, int threads);
+int fprint_packed(FILE* file, const packed_matrix* mat);
+int fprint_sparse(FILE* file, const csr_matrix* mat);
+
+#endif
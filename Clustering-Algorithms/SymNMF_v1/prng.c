@@ -0,0 +1,70 @@
+#include "prng.h"
+
+#define MT_SHIFT 397
+#define MT_MATRIX_A 0x9908b0dfUL
+#define MT_UPPER_MASK 0x80000000UL
+#define MT_LOWER_MASK 0x7fffffffUL
+#define MT_WORD_MASK 0xffffffffUL
+
+/*
+seeds the generator like init_genrand of the reference implementation (and numpy.random.seed)
+@param mt: the generator
+@param seed: the seed, only its low 32 bits are used
+@return void
+*/
+void mt_seed(mt19937* mt, unsigned long seed)
+{
+    int i;
+    mt->state[0] = seed & MT_WORD_MASK;
+    for(i=1;i<MT_STATE_SIZE;i++)
+    {
+        mt->state[i] = (1812433253UL * (mt->state[i - 1] ^ (mt->state[i - 1] >> 30)) + i) & MT_WORD_MASK;
+    }
+    mt->index = MT_STATE_SIZE;
+}
+
+/*
+regenerates the whole state, producing the next MT_STATE_SIZE words at once
+@param mt: the generator
+@return void
+*/
+static void mt_generate(mt19937* mt)
+{
+    int i;
+    unsigned long y;
+    for(i=0;i<MT_STATE_SIZE;i++)
+    {
+        y = (mt->state[i] & MT_UPPER_MASK) | (mt->state[(i + 1) % MT_STATE_SIZE] & MT_LOWER_MASK);
+        mt->state[i] = mt->state[(i + MT_SHIFT) % MT_STATE_SIZE] ^ (y >> 1) ^ ((y & 1UL) ? MT_MATRIX_A : 0UL);
+    }
+    mt->index = 0;
+}
+
+/*
+draws the next 32 bit word
+@param mt: the generator
+@return unsigned long: a uniform value in [0, 2^32)
+*/
+unsigned long mt_next(mt19937* mt)
+{
+    unsigned long y;
+    if(mt->index >= MT_STATE_SIZE) mt_generate(mt);
+    y = mt->state[mt->index++];
+    y ^= y >> 11;
+    y ^= (y << 7) & 0x9d2c5680UL;
+    y ^= (y << 15) & 0xefc60000UL;
+    y ^= y >> 18;
+    return y & MT_WORD_MASK;
+}
+
+/*
+draws a double from two words like numpy's random_sample, keeping 27 + 26 = 53 random bits
+@param mt: the generator
+@return double: a uniform value in [0, 1)
+*/
+double mt_uniform(mt19937* mt)
+{
+    unsigned long a = mt_next(mt) >> 5;
+    unsigned long b = mt_next(mt) >> 6;
+    return (a * 67108864.0 + b) / 9007199254740992.0;
+}
@@ -0,0 +1,22 @@
+/* C header file for the random number generator used to initialize H */
+#ifndef PRNG_H
+#define PRNG_H
+
+#define MT_STATE_SIZE 624
+
+/*
+the 32 bit Mersenne Twister MT19937, the generator behind numpy.random.seed,
+so that H drawn in C is the same as H drawn by numpy for the same seed
+values are kept in unsigned long and masked to 32 bits, since C89 has no fixed width types
+*/
+typedef struct mt19937
+{
+    unsigned long state[MT_STATE_SIZE];
+    int index; /* the next word of state to temper, MT_STATE_SIZE when the state must be regenerated */
+} mt19937;
+
+void mt_seed(mt19937* mt, unsigned long seed);
+unsigned long mt_next(mt19937* mt);
+double mt_uniform(mt19937* mt);
+
+#endif
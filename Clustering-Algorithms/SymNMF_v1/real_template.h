@@ -0,0 +1,685 @@
+/*
+the storage of W and the kernels that build it and read it, written once for the element type of W,
+included by symnmf.c once per precision with
+REAL: the element type of W
+REAL_MATRIX: the matrix type holding REAL, laid out like matrix
+REAL_PACKED: the packed symmetric matrix type holding REAL, laid out like packed_matrix
+REAL_NAME(name): the name of a function in that precision
+REAL_IN_PLACE: 1 when REAL is double, so the similarities are computed straight into W, 0 when they are
+computed into double scratch rows and tiles and rounded into W
+the distances, the exponentials and the degrees are always computed in double
+there is deliberately no include guard
+*/
+
+/*
+calculates the row stride of a matrix with m columns
+rows of at least a cache line are padded to a multiple of it, narrower rows are kept dense
+so that tall skinny matrices (N*k) do not waste bandwidth on padding
+@param m: the number of columns
+@return int: the distance in elements between two consecutive rows
+*/
+static int REAL_NAME(matrix_stride)(int m)
+{
+    int line = MATRIX_ALIGNMENT / sizeof(REAL);
+    if(m < line) return m;
+    return (m + line - 1) / line * line;
+}
+
+/*
+frees a matrix allocated by matrix_malloc
+@param p: the matrix to be freed (may be NULL)
+@return void
+*/
+void REAL_NAME(matrix_free)(REAL_MATRIX* p)
+{
+    free(p); /* header and elements share one block */
+}
+
+/*
+allocates memory for a matrix with dimensions n*m
+the header and all the elements are allocated in a single block, with the elements
+starting on a MATRIX_ALIGNMENT boundary
+@param n: the number of rows
+@param m: the number of columns
+@return REAL_MATRIX*: the allocated matrix
+*/
+REAL_MATRIX* REAL_NAME(matrix_malloc)(int n, int m)
+{
+    int stride = REAL_NAME(matrix_stride)(m);
+    size_t header = (sizeof(REAL_MATRIX) + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+    size_t bytes = header + MATRIX_ALIGNMENT + (size_t)n * stride * sizeof(REAL);
+    size_t misalignment;
+    char* block;
+    REAL_MATRIX* new_matrix;
+
+    if((block = malloc(bytes)) == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    stats_allocated(bytes);
+    new_matrix = (REAL_MATRIX*)block;
+    misalignment = (size_t)(block + header) % MATRIX_ALIGNMENT;
+    new_matrix->data = (REAL*)(block + header + (misalignment ? MATRIX_ALIGNMENT - misalignment : 0));
+    new_matrix->rows = n;
+    new_matrix->cols = m;
+    new_matrix->stride = stride;
+    return new_matrix;
+}
+
+/*
+frees a packed matrix allocated by packed_malloc
+@param p: the matrix to be freed (may be NULL)
+@return void
+*/
+void REAL_NAME(packed_free)(REAL_PACKED* p)
+{
+    free(p); /* header and elements share one block */
+}
+
+/*
+allocates memory for a packed symmetric matrix of dimensions n*n
+like matrix_malloc, the header and the n*(n+1)/2 elements share a single block
+with the elements starting on a MATRIX_ALIGNMENT boundary
+@param n: the number of rows and columns
+@return REAL_PACKED*: the allocated matrix
+*/
+REAL_PACKED* REAL_NAME(packed_malloc)(int n)
+{
+    size_t header = (sizeof(REAL_PACKED) + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+    size_t bytes = header + MATRIX_ALIGNMENT + (size_t)n * (n + 1) / 2 * sizeof(REAL);
+    size_t misalignment;
+    char* block;
+    REAL_PACKED* new_matrix;
+
+    if((block = malloc(bytes)) == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    stats_allocated(bytes);
+    new_matrix = (REAL_PACKED*)block;
+    misalignment = (size_t)(block + header) % MATRIX_ALIGNMENT;
+    new_matrix->data = (REAL*)(block + header + (misalignment ? MATRIX_ALIGNMENT - misalignment : 0));
+    new_matrix->n = n;
+    return new_matrix;
+}
+
+/*
+fills rows [begin, end) of the upper triangle of the symilarity matrix, diagonal included
+the matrix is either dense or packed, the other one is NULL
+every element a_ij above the diagonal is added to the degrees of both i and j while its row is still in cache
+@param vectors: the matrix of vectors (N*vecdim)
+@param sym_matrix: the dense symilarity matrix (N*N)
+@param sym_packed: the packed symilarity matrix (N*N)
+@param begin: the first row
+@param end: one past the last row
+@param exp_mode: how the kernel exp(-d/2) is evaluated, one of the EXP_ values
+@param degrees: the N partial degrees of the chunk, added to (NULL when the degrees are not needed)
+@param scratch: a row of N doubles the similarities are computed in before they are rounded (unused when REAL_IN_PLACE)
+@return void
+*/
+static void REAL_NAME(sym_rows)(const matrix* vectors, REAL_MATRIX* sym_matrix, REAL_PACKED* sym_packed,
+                                int begin, int end, int exp_mode, double* degrees, double* scratch)
+{
+    int i,j;
+    int N = vectors->rows, vecdim = vectors->cols;
+    double sum;
+    double* values;
+#if REAL_IN_PLACE
+    (void)scratch;
+#endif
+    for(i=begin;i<end;i++)
+    {
+        const double* vec_i = MATRIX_ROW(vectors, i);
+        /* both layouts, and the scratch row, are addressed by column index */
+        REAL* sym_row = (sym_matrix != NULL) ? MATRIX_ROW(sym_matrix, i) : PACKED_ROW(sym_packed, i) - i;
+#if REAL_IN_PLACE
+        values = sym_row;
+#else
+        values = scratch;
+#endif
+        sym_row[i] = 0;
+        for(j=i+1;j<N;j++)
+        {
+            values[j] = -euclidean_distance(vec_i, MATRIX_ROW(vectors, j), vecdim, 1) / 2;
+        }
+        simd_exp(values + i + 1, N - i - 1, exp_mode);
+#if !REAL_IN_PLACE
+        for(j=i+1;j<N;j++)
+        {
+            sym_row[j] = (REAL)values[j];
+        }
+#endif
+        if(degrees == NULL) continue;
+        sum = 0;
+        for(j=i+1;j<N;j++)
+        {
+            sum += values[j];
+            degrees[j] += values[j];
+        }
+        degrees[i] += sum;
+    }
+}
+
+/*
+computes the upper triangle of the symilarity matrix tile by tile, with the gram trick or the per pair loop,
+and either stores it or only keeps the degrees, each tile going through a scratch tile of its thread
+unless it can be computed in place
+the tiles of the triangle, numbered row by row, are dealt to the threads round robin, which keeps
+the work balanced and the tiles every thread adds to its degrees fixed
+@param vectors: the matrix of vectors (N*vecdim)
+@param sym_matrix: the symilarity matrix (N*N), NULL to only compute the degrees
+@param backend: one of the SYM_BACKEND_ values
+@param threads: the number of threads to use
+@param exp_mode: how the kernel exp(-d/2) is evaluated, one of the EXP_ values
+@param partials: threads*N partial degrees, one vector per thread added to (NULL when the degrees are not needed)
+@return int: 0 on success, 1 if memory allocation failed
+*/
+static int REAL_NAME(sym_tiles)(const matrix* vectors, REAL_MATRIX* sym_matrix, int backend, int threads, int exp_mode,
+                                double* partials)
+{
+    int i,j,t;
+    int N = vectors->rows, vecdim = vectors->cols;
+    int blocks = (N + SYM_TILE - 1) / SYM_TILE;
+    int gram_trick = (backend == SYM_BACKEND_GRAM);
+    size_t buffer_size = gram_trick ? gemm_buffer_size(SYM_TILE) : 0;
+    size_t scratch_size = (sym_matrix == NULL || !REAL_IN_PLACE) ? (size_t)SYM_TILE * SYM_TILE : 0;
+    double* sq_norms = NULL;
+    double* buffers;
+    matrix* transposed = NULL;
+
+    buffers = malloc((threads * (buffer_size + scratch_size) + 1) * sizeof(double));
+    if(buffers == NULL || (gram_trick && ((sq_norms = malloc((N + 1) * sizeof(double))) == NULL ||
+                                          (transposed = matrix_malloc(vecdim, N)) == NULL))) /* Memory allocation failed */
+    {
+        if(buffers == NULL || (gram_trick && sq_norms == NULL)) printf("An Error Has Occured");
+        free(sq_norms);
+        free(buffers);
+        matrix_free(transposed);
+        return 1;
+    }
+    stats_allocated((threads * (buffer_size + scratch_size) + 1 + (gram_trick ? (size_t)N + 1 : 0)) * sizeof(double));
+
+    for(i=0;i<N && gram_trick;i++)
+    {
+        const double* vec = MATRIX_ROW(vectors, i);
+        sq_norms[i] = 0;
+        for(j=0;j<vecdim;j++)
+        {
+            sq_norms[i] += vec[j] * vec[j];
+            MATRIX_AT(transposed, j, i) = vec[j];
+        }
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static, 1) private(i, j)
+#endif
+    for(t=0;t<blocks*(blocks+1)/2;t++)
+    {
+#ifdef _OPENMP
+        int thread = omp_get_thread_num();
+#else
+        int thread = 0;
+#endif
+        int bi = 0, bj = t;
+        double* buffer = buffers + thread * (buffer_size + scratch_size);
+        matrix tile; /* the place of the tile in the result, or the scratch tile */
+
+        while(bj >= blocks - bi) /* row bi of tiles holds the blocks - bi tiles right of the diagonal */
+        {
+            bj -= blocks - bi;
+            bi++;
+        }
+        bj = (bi + bj) * SYM_TILE;
+        bi *= SYM_TILE;
+        tile.rows = (N - bi < SYM_TILE) ? N - bi : SYM_TILE;
+        tile.cols = (N - bj < SYM_TILE) ? N - bj : SYM_TILE;
+#if REAL_IN_PLACE
+        if(sym_matrix != NULL)
+        {
+            tile.data = MATRIX_ROW(sym_matrix, bi) + bj;
+            tile.stride = sym_matrix->stride;
+        }
+        else
+#endif
+        {
+            tile.data = buffer + buffer_size;
+            tile.stride = SYM_TILE;
+        }
+        sym_tile(vectors, transposed, sq_norms, bi, bj, &tile, buffer, exp_mode);
+        if(partials != NULL) tile_degrees(&tile, bi, bj, partials + (size_t)thread * N);
+#if !REAL_IN_PLACE
+        for(i=0;i<tile.rows && sym_matrix!=NULL;i++) /* round the scratch tile into the result */
+        {
+            REAL* row = MATRIX_ROW(sym_matrix, bi + i) + bj;
+            for(j=0;j<tile.cols;j++)
+            {
+                row[j] = (REAL)MATRIX_AT(&tile, i, j);
+            }
+        }
+#endif
+    }
+
+    free(sq_norms);
+    free(buffers);
+    matrix_free(transposed);
+    return 0;
+}
+
+/*
+copies the upper triangle of a square matrix into its lower triangle
+the copy goes tile by tile so that both the rows read and the rows written stay in cache
+@param mat: the square matrix
+@param threads: the number of threads to use
+@return void
+*/
+static void REAL_NAME(mirror_upper_triangle)(REAL_MATRIX* mat, int threads)
+{
+    int tile = 64;
+    int bi,bj,i,j;
+    int N = mat->rows;
+    (void)threads;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 1) private(bj, i, j)
+#endif
+    for(bi=0;bi<N;bi+=tile)
+    {
+        for(bj=0;bj<=bi;bj+=tile)
+        {
+            for(i=bi;i<N && i<bi+tile;i++)
+            {
+                REAL* row = MATRIX_ROW(mat, i);
+                for(j=bj;j<i && j<bj+tile;j++)
+                {
+                    row[j] = MATRIX_AT(mat, j, i);
+                }
+            }
+        }
+    }
+}
+
+/*
+calculates the symilarity matrix of a matrix of doubles, and optionally the degrees in the same pass
+the upper triangle is split into one chunk of (almost) equal pair count per thread,
+then mirrored into the lower triangle
+the distances come from the backend selected in the config, the per pair loop by default,
+and each row of distances is turned into similarities by one batched exp
+@param vectors: the matrix of vectors (N*vecdim)
+@param config: the engine settings (may be NULL for the defaults)
+@param partials: config_threads(config)*N zeroed partial degrees, to be summed with reduce_degrees
+(NULL when the degrees are not needed)
+@return REAL_MATRIX*: the symilarity matrix (N*N)
+*/
+static REAL_MATRIX* REAL_NAME(sym_degrees)(const matrix* vectors, const symnmf_config* config, double* partials)
+{
+    int chunk, failed = 0;
+    int N = vectors->rows;
+    int threads = config_threads(config);
+    int exp_mode = (config != NULL) ? config->exp_mode : EXP_LIBM;
+    double start = stats_start();
+    double* scratch = NULL;
+    REAL_MATRIX* sym_matrix;
+
+    /* malloc a matrix sized N*N */
+    if((sym_matrix = REAL_NAME(matrix_malloc)(N, N)) == NULL) return NULL; /* Memory allocation failed */
+
+    /* calculate the upper triangle of the symilarity matrix */
+    if(config != NULL && config->sym_backend == SYM_BACKEND_GRAM)
+    {
+        failed = REAL_NAME(sym_tiles)(vectors, sym_matrix, SYM_BACKEND_GRAM, threads, exp_mode, partials) != 0;
+    }
+    else if(!(failed = !REAL_IN_PLACE && (scratch = sym_scratch(N, threads)) == NULL))
+    {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static, 1)
+#endif
+        for(chunk=0;chunk<threads;chunk++)
+        {
+            REAL_NAME(sym_rows)(vectors, sym_matrix, NULL, triangle_row(N, chunk, threads), triangle_row(N, chunk + 1, threads),
+                                exp_mode, (partials != NULL) ? partials + (size_t)chunk * N : NULL,
+                                (scratch != NULL) ? scratch + (size_t)chunk * N : NULL);
+        }
+        free(scratch);
+    }
+    if(failed) /* Memory allocation failed */
+    {
+        REAL_NAME(matrix_free)(sym_matrix);
+        return NULL;
+    }
+    REAL_NAME(mirror_upper_triangle)(sym_matrix, threads);
+
+    stats_stop(STATS_SYM, start);
+    return sym_matrix;
+}
+
+/*
+calculates the symilarity matrix of a matrix of doubles in packed storage, and optionally the degrees in the same pass
+only the upper triangle is computed and stored, split into chunks of (almost) equal
+pair count like sym; the per pair distance loop is always used
+@param vectors: the matrix of vectors (N*vecdim)
+@param config: the engine settings (may be NULL for the defaults)
+@param partials: config_threads(config)*N zeroed partial degrees, to be summed with reduce_degrees
+(NULL when the degrees are not needed)
+@return REAL_PACKED*: the symilarity matrix (N*N)
+*/
+static REAL_PACKED* REAL_NAME(sym_packed_degrees)(const matrix* vectors, const symnmf_config* config, double* partials)
+{
+    int chunk;
+    int N = vectors->rows;
+    int threads = config_threads(config);
+    int exp_mode = (config != NULL) ? config->exp_mode : EXP_LIBM;
+    double start = stats_start();
+    double* scratch = NULL;
+    REAL_PACKED* sym_matrix;
+
+    if((sym_matrix = REAL_NAME(packed_malloc)(N)) == NULL) return NULL; /* Memory allocation failed */
+    if(!REAL_IN_PLACE && (scratch = sym_scratch(N, threads)) == NULL) /* Memory allocation failed */
+    {
+        REAL_NAME(packed_free)(sym_matrix);
+        return NULL;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static, 1)
+#endif
+    for(chunk=0;chunk<threads;chunk++)
+    {
+        REAL_NAME(sym_rows)(vectors, NULL, sym_matrix, triangle_row(N, chunk, threads), triangle_row(N, chunk + 1, threads),
+                            exp_mode, (partials != NULL) ? partials + (size_t)chunk * N : NULL,
+                            (scratch != NULL) ? scratch + (size_t)chunk * N : NULL);
+    }
+
+    free(scratch);
+    stats_stop(STATS_SYM, start);
+    return sym_matrix;
+}
+
+/*
+calculates the norm matrix of a matrix of doubles
+the symilarity matrix is computed once, with the degrees summed by the same pass (each chunk of rows
+into its own degree vector, the vectors are then summed in chunk order), and scaled in place into
+D^-1/2 * A * D^-1/2, so the only N*N matrix allocated is the result and it is written once and read once
+@param vectors: the matrix of vectors (N*vecdim)
+@param config: the engine settings (may be NULL for the defaults)
+@return REAL_MATRIX*: the norm matrix (N*N)
+*/
+REAL_MATRIX* REAL_NAME(norm)(const matrix* vectors, const symnmf_config* config)
+{
+    int i,j;
+    int N = vectors->rows;
+    int threads = config_threads(config);
+    double start = stats_start();
+    double* degrees;
+    REAL_MATRIX* norm_matrix;
+
+    /* calculate sym and its degrees */
+    if((degrees = calloc((size_t)threads * N + 1, sizeof(double))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    stats_allocated(((size_t)threads * N + 1) * sizeof(double));
+    if((norm_matrix = REAL_NAME(sym_degrees)(vectors, config, degrees)) == NULL) /* Memory allocation failed */
+    {
+        free(degrees);
+        return NULL;
+    }
+    reduce_degrees(degrees, N, threads);
+
+    /* scale the symilarity matrix into the norm matrix */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) private(j)
+#endif
+    for(i=0;i<N;i++)
+    {
+        REAL* norm_row = MATRIX_ROW(norm_matrix, i);
+        double d_i = degrees[i];
+        for(j=0;j<N;j++)
+        {
+            norm_row[j] /= sqrt(d_i * degrees[j]);
+        }
+    }
+
+    free(degrees);
+    stats_stop(STATS_NORM, start);
+    return norm_matrix;
+}
+
+/*
+calculates the norm matrix of a matrix of doubles in packed storage
+every stored element a_ij adds to the degrees of both i and j as it is computed, each chunk of rows
+accumulates into its own degree vector and the vectors are summed in chunk order,
+then the triangle is scaled in place
+@param vectors: the matrix of vectors (N*vecdim)
+@param config: the engine settings (may be NULL for the defaults)
+@return REAL_PACKED*: the norm matrix (N*N)
+*/
+REAL_PACKED* REAL_NAME(norm_packed)(const matrix* vectors, const symnmf_config* config)
+{
+    int i,j;
+    int N = vectors->rows;
+    int threads = config_threads(config);
+    double start = stats_start();
+    double* partials;
+    REAL_PACKED* norm_matrix;
+
+    if((partials = calloc((size_t)threads * N + 1, sizeof(double))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    stats_allocated(((size_t)threads * N + 1) * sizeof(double));
+    if((norm_matrix = REAL_NAME(sym_packed_degrees)(vectors, config, partials)) == NULL) /* Memory allocation failed */
+    {
+        free(partials);
+        return NULL;
+    }
+    reduce_degrees(partials, N, threads); /* the first partial vector becomes the degrees */
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 64) private(j)
+#endif
+    for(i=0;i<N;i++)
+    {
+        REAL* row = PACKED_ROW(norm_matrix, i) - i;
+        for(j=i;j<N;j++)
+        {
+            row[j] /= sqrt(partials[i] * partials[j]);
+        }
+    }
+
+    free(partials);
+    stats_stop(STATS_NORM, start);
+    return norm_matrix;
+}
+
+/*
+multiplies two matrices with every thread computing its own chunk of rows of C = A*B
+the rows of C are independent, so the result does not depend on the number of threads
+@param A: the first matrix (n*m)
+@param B: the second matrix (m*p)
+@param C: the result matrix (n*p), must not alias A or B
+@param buffers: packing space of threads*gemm_buffer_size(p) elements
+@param threads: the number of threads to use
+@return void
+*/
+static void REAL_NAME(gemm_rows)(const REAL_MATRIX* A, const REAL_MATRIX* B, matrix* C, REAL* buffers, int threads)
+{
+    int t,begin,end;
+    REAL_MATRIX a_rows;
+    matrix c_rows;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) private(begin, end, a_rows, c_rows)
+#endif
+    for(t=0;t<threads;t++)
+    {
+        begin = chunk_row(A->rows, t, threads);
+        end = chunk_row(A->rows, t + 1, threads);
+        a_rows.data = MATRIX_ROW(A, begin);
+        a_rows.rows = end - begin;
+        a_rows.cols = A->cols;
+        a_rows.stride = A->stride;
+        c_rows.data = MATRIX_ROW(C, begin);
+        c_rows.rows = end - begin;
+        c_rows.cols = C->cols;
+        c_rows.stride = C->stride;
+        REAL_NAME(gemm)(&a_rows, B, &c_rows, buffers + t * gemm_buffer_size(B->cols));
+    }
+}
+
+/*
+sums an array with pairwise summation, the scheme numpy uses, so the rounding error grows
+with log(n) instead of n: blocks of up to 128 values are summed with 8 interleaved accumulators
+the accumulators are doubles whatever the type of the values
+@param values: the values
+@param n: the number of values
+@return double: their sum
+*/
+static double REAL_NAME(pairwise_sum)(const REAL* values, size_t n)
+{
+    size_t i,j,half;
+    double r[8];
+    double sum = 0;
+
+    if(n < 8)
+    {
+        for(i=0;i<n;i++)
+        {
+            sum += values[i];
+        }
+        return sum;
+    }
+    if(n <= 128)
+    {
+        for(j=0;j<8;j++)
+        {
+            r[j] = values[j];
+        }
+        for(i=8;i<n-(n%8);i+=8)
+        {
+            for(j=0;j<8;j++)
+            {
+                r[j] += values[i + j];
+            }
+        }
+        sum = ((r[0] + r[1]) + (r[2] + r[3])) + ((r[4] + r[5]) + (r[6] + r[7]));
+        for(;i<n;i++)
+        {
+            sum += values[i];
+        }
+        return sum;
+    }
+    half = n / 2;
+    half -= half % 8;
+    return REAL_NAME(pairwise_sum)(values, half) + REAL_NAME(pairwise_sum)(values + half, n - half);
+}
+
+/*
+calculates the average entry of a matrix rounded the way numpy.mean rounds it: an unpadded
+matrix is summed pairwise in one go, a padded one (which numpy sees as a strided view) in
+pairwise summed chunks of MEAN_CHUNK entries, the size of numpy's iteration buffer
+@param mat: the matrix
+@return double: the average entry, or -1 if memory allocation failed
+*/
+static double REAL_NAME(matrix_mean)(const REAL_MATRIX* mat)
+{
+    size_t count = (size_t)mat->rows * mat->cols;
+    size_t flat,filled,take;
+    int i,j;
+    double sum = 0;
+    REAL* chunk;
+
+    if(mat->stride == mat->cols) return REAL_NAME(pairwise_sum)(mat->data, count) / count;
+    if((chunk = malloc(MEAN_CHUNK * sizeof(REAL))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return -1;
+    }
+    stats_allocated(MEAN_CHUNK * sizeof(REAL));
+    i = 0;
+    j = 0;
+    for(flat=0;flat<count;flat+=filled)
+    {
+        /* gather the next chunk of entries in row-major order */
+        for(filled=0;filled<MEAN_CHUNK && flat+filled<count;filled+=take)
+        {
+            take = mat->cols - j;
+            if(take > MEAN_CHUNK - filled) take = MEAN_CHUNK - filled;
+            memcpy(chunk + filled, MATRIX_ROW(mat, i) + j, take * sizeof(REAL));
+            j += (int)take;
+            if(j == mat->cols)
+            {
+                i++;
+                j = 0;
+            }
+        }
+        sum += REAL_NAME(pairwise_sum)(chunk, filled);
+    }
+    free(chunk);
+    return sum / count;
+}
+
+/*
+calculates the average entry of a packed symmetric matrix, every stored element above the diagonal
+standing for two entries; the rows are summed pairwise, so it agrees with matrix_mean on the dense
+matrix up to rounding
+@param mat: the matrix
+@return double: the average entry
+*/
+static double REAL_NAME(packed_mean)(const REAL_PACKED* mat)
+{
+    int i;
+    int N = mat->n;
+    double sum = 0;
+    for(i=0;i<N;i++)
+    {
+        const REAL* row = PACKED_ROW(mat, i);
+        sum += row[0] + 2 * REAL_NAME(pairwise_sum)(row + 1, N - i - 1);
+    }
+    return sum / ((double)N * N);
+}
+
+/*
+calculates the squared forbius norm of a matrix
+@param mat: the matrix
+@return double: the sum of the squares of the entries
+*/
+static double REAL_NAME(squared_norm)(const REAL_MATRIX* mat)
+{
+    int i,j;
+    double sum = 0;
+    for(i=0;i<mat->rows;i++)
+    {
+        for(j=0;j<mat->cols;j++)
+        {
+            sum += (double)MATRIX_AT(mat, i, j) * MATRIX_AT(mat, i, j);
+        }
+    }
+    return sum;
+}
+
+/*
+calculates the squared forbius norm of a packed symmetric matrix
+@param mat: the matrix
+@return double: the sum of the squares of the entries
+*/
+static double REAL_NAME(packed_squared_norm)(const REAL_PACKED* mat)
+{
+    int i,j;
+    int N = mat->n;
+    double sum = 0, row_sum;
+    for(i=0;i<N;i++)
+    {
+        const REAL* row = PACKED_ROW(mat, i);
+        row_sum = 0;
+        for(j=1;j<N-i;j++)
+        {
+            row_sum += (double)row[j] * row[j];
+        }
+        sum += (double)row[0] * row[0] + 2 * row_sum;
+    }
+    return sum;
+}
@@ -4,7 +4,8 @@ from setuptools import Extension, setup
 setup.py file for SymNMF module
 """
 
-module = Extension('mysymnmfsp', sources=['symnmfmodule.c', 'symnmf.c'], include_dirs=['./'])
+module = Extension('mysymnmfsp', sources=['symnmfmodule.c', 'symnmf.c', 'gemm.c', 'simd.c', 'sparse.c', 'stream.c', 'prng.c', 'csv.c', 'matfile.c', 'output.c', 'incremental.c', 'stats.c'], include_dirs=['./'],
+                   extra_compile_args=['-fopenmp'], extra_link_args=['-fopenmp'])
 
 setup(
     name='symnmf',
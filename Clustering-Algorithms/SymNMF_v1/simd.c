@@ -0,0 +1,514 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gemm.h"
+#include "simd.h"
+
+/*
+the vector kernels are compiled for their instruction set with target attributes and only
+called after the CPU was checked, so the rest of the engine stays portable
+*/
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#if GEMM_MR != 4 || GEMM_NR != 4
+#error "the micro-kernels are written for a 4*4 register tile"
+#endif
+
+/*
+the polynomial exp splits x = t*ln(2) + r with an integer t and |r| <= ln(2)/2, so that
+exp(x) = 2^t * exp(r), ln(2) is split in two parts (Cody-Waite) to keep r exact
+exp(r) is its Taylor polynomial, degree 11 leaves a truncation error of (ln(2)/2)^12/12! < 1e-14
+and degree 7 one of (ln(2)/2)^8/8! < 1e-8
+arguments outside [EXP_MIN, EXP_MAX] (where 2^t would not be a normal double) and NaN go to libm
+*/
+#define EXP_PRECISE_DEGREE 11
+#define EXP_FAST_DEGREE 7
+#define EXP_MIN (-708.39)
+#define EXP_MAX 709.0
+#define EXP_LOG2E 1.44269504088896338700
+#define EXP_LN2_HI 6.93147180369123816490e-01 /* the upper bits of ln(2), t*EXP_LN2_HI is exact */
+#define EXP_LN2_LO 1.90821492927058770002e-10 /* ln(2) - EXP_LN2_HI */
+
+/* the Taylor coefficients 1/i! */
+static const double inv_factorial[EXP_PRECISE_DEGREE + 1] = {
+    1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040, 1.0 / 40320,
+    1.0 / 362880, 1.0 / 3628800, 1.0 / 39916800
+};
+
+static int forced_level = -1;   /* level set by simd_set_level, -1 when not forced */
+static int detected_level = -1; /* cached result of the CPU detection */
+
+/*
+detects the best instruction set level supported by the CPU
+the SYMNMF_SIMD environment variable (scalar, avx2 or avx512) caps the level
+@return int: the detected level
+*/
+static int detect_level(void)
+{
+    int level = SIMD_SCALAR;
+    const char* cap = getenv("SYMNMF_SIMD");
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) level = SIMD_AVX2;
+    if(level == SIMD_AVX2 && __builtin_cpu_supports("avx512f")) level = SIMD_AVX512;
+#endif
+    if(cap != NULL)
+    {
+        if(!strcmp(cap, "scalar")) level = SIMD_SCALAR;
+        else if(!strcmp(cap, "avx2") && level > SIMD_AVX2) level = SIMD_AVX2;
+    }
+    return level;
+}
+
+/*
+returns the instruction set level the kernels dispatch to, detected on the first call
+which is not synchronised, so programs make it before any parallel region
+@return int: one of SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512
+*/
+int simd_level(void)
+{
+    if(detected_level < 0) detected_level = detect_level();
+    if(forced_level >= 0 && forced_level < detected_level) return forced_level;
+    return detected_level;
+}
+
+/*
+restricts the kernels to an instruction set level, levels the CPU lacks are ignored
+@param level: the highest level to use, or -1 to use the best one available
+@return void
+*/
+void simd_set_level(int level)
+{
+    forced_level = level;
+}
+
+/*
+names an instruction set level for reports
+@param level: the level
+@return const char*: its name
+*/
+const char* simd_level_name(int level)
+{
+    switch(level)
+    {
+        case SIMD_AVX512: return "avx512";
+        case SIMD_AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+/*
+adds the mr*nr valid part of a GEMM_MR*GEMM_NR tile of results to C
+@param tile: the computed tile
+@param c: the top left element of the destination tile
+@param ldc: the row stride of C
+@param mr: the number of valid rows in the tile
+@param nr: the number of valid columns in the tile
+@return void
+*/
+static void store_tile(const double tile[GEMM_MR][GEMM_NR], double* c, int ldc, int mr, int nr)
+{
+    int i,j;
+    for(i=0;i<mr;i++)
+    {
+        for(j=0;j<nr;j++)
+        {
+            c[(size_t)i*ldc + j] += tile[i][j];
+        }
+    }
+}
+
+/*
+multiplies a packed GEMM_MR*kc micro-panel of A by a packed kc*GEMM_NR micro-panel of B
+and adds the mr*nr valid part of the product to C
+the GEMM_MR*GEMM_NR accumulators are kept in registers for the whole kc loop
+@param kc: the shared dimension
+@param a: the packed micro-panel of A
+@param b: the packed micro-panel of B
+@param c: the top left element of the destination tile
+@param ldc: the row stride of C
+@param mr: the number of valid rows in the tile
+@param nr: the number of valid columns in the tile
+@return void
+*/
+static void micro_kernel_scalar(int kc, const double* a, const double* b, double* c, int ldc, int mr, int nr)
+{
+    int p;
+    double c00 = 0, c01 = 0, c02 = 0, c03 = 0;
+    double c10 = 0, c11 = 0, c12 = 0, c13 = 0;
+    double c20 = 0, c21 = 0, c22 = 0, c23 = 0;
+    double c30 = 0, c31 = 0, c32 = 0, c33 = 0;
+    double tile[GEMM_MR][GEMM_NR];
+
+    for(p=0;p<kc;p++)
+    {
+        double a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+        double b0 = b[0], b1 = b[1], b2 = b[2], b3 = b[3];
+        c00 += a0*b0; c01 += a0*b1; c02 += a0*b2; c03 += a0*b3;
+        c10 += a1*b0; c11 += a1*b1; c12 += a1*b2; c13 += a1*b3;
+        c20 += a2*b0; c21 += a2*b1; c22 += a2*b2; c23 += a2*b3;
+        c30 += a3*b0; c31 += a3*b1; c32 += a3*b2; c33 += a3*b3;
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+    tile[0][0] = c00; tile[0][1] = c01; tile[0][2] = c02; tile[0][3] = c03;
+    tile[1][0] = c10; tile[1][1] = c11; tile[1][2] = c12; tile[1][3] = c13;
+    tile[2][0] = c20; tile[2][1] = c21; tile[2][2] = c22; tile[2][3] = c23;
+    tile[3][0] = c30; tile[3][1] = c31; tile[3][2] = c32; tile[3][3] = c33;
+    store_tile((const double (*)[GEMM_NR])tile, c, ldc, mr, nr);
+}
+
+#ifdef SIMD_X86
+/*
+AVX2 version of the micro-kernel: each row of the tile is one 256-bit accumulator,
+updated with a broadcast of the A value and a fused multiply-add per step of kc
+*/
+__attribute__((target("avx2,fma")))
+static void micro_kernel_avx2(int kc, const double* a, const double* b, double* c, int ldc, int mr, int nr)
+{
+    int p;
+    __m256d c0 = _mm256_setzero_pd(), c1 = _mm256_setzero_pd();
+    __m256d c2 = _mm256_setzero_pd(), c3 = _mm256_setzero_pd();
+    __m256d bv;
+    double tile[GEMM_MR][GEMM_NR];
+
+    for(p=0;p<kc;p++)
+    {
+        bv = _mm256_loadu_pd(b);
+        c0 = _mm256_fmadd_pd(_mm256_broadcast_sd(a), bv, c0);
+        c1 = _mm256_fmadd_pd(_mm256_broadcast_sd(a + 1), bv, c1);
+        c2 = _mm256_fmadd_pd(_mm256_broadcast_sd(a + 2), bv, c2);
+        c3 = _mm256_fmadd_pd(_mm256_broadcast_sd(a + 3), bv, c3);
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+    _mm256_storeu_pd(tile[0], c0);
+    _mm256_storeu_pd(tile[1], c1);
+    _mm256_storeu_pd(tile[2], c2);
+    _mm256_storeu_pd(tile[3], c3);
+    store_tile((const double (*)[GEMM_NR])tile, c, ldc, mr, nr);
+}
+
+/*
+AVX-512 version of the micro-kernel: two rows of the tile share one 512-bit accumulator,
+the B row is duplicated into both halves and the A values are spread with a permutation
+*/
+__attribute__((target("avx512f")))
+static void micro_kernel_avx512(int kc, const double* a, const double* b, double* c, int ldc, int mr, int nr)
+{
+    int p;
+    __m512d c01 = _mm512_setzero_pd(), c23 = _mm512_setzero_pd();
+    __m512d av, bv;
+    __m512i rows01 = _mm512_set_epi64(1, 1, 1, 1, 0, 0, 0, 0);
+    __m512i rows23 = _mm512_set_epi64(3, 3, 3, 3, 2, 2, 2, 2);
+    double tile[GEMM_MR][GEMM_NR];
+
+    for(p=0;p<kc;p++)
+    {
+        av = _mm512_castpd256_pd512(_mm256_loadu_pd(a));
+        bv = _mm512_broadcast_f64x4(_mm256_loadu_pd(b));
+        c01 = _mm512_fmadd_pd(_mm512_permutexvar_pd(rows01, av), bv, c01);
+        c23 = _mm512_fmadd_pd(_mm512_permutexvar_pd(rows23, av), bv, c23);
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+    _mm512_storeu_pd(tile[0], c01);
+    _mm512_storeu_pd(tile[2], c23);
+    store_tile((const double (*)[GEMM_NR])tile, c, ldc, mr, nr);
+}
+#endif
+
+/*
+selects the gemm micro-kernel for the current instruction set level
+@return micro_kernel_fn: the micro-kernel
+*/
+micro_kernel_fn simd_micro_kernel(void)
+{
+#ifdef SIMD_X86
+    switch(simd_level())
+    {
+        case SIMD_AVX512: return micro_kernel_avx512;
+        case SIMD_AVX2: return micro_kernel_avx2;
+        default: break;
+    }
+#endif
+    return micro_kernel_scalar;
+}
+
+/*
+adds the mr*nr valid part of a GEMM_MR*GEMM_NR tile of float results to C in double
+@param tile: the computed tile
+@param c: the top left element of the destination tile
+@param ldc: the row stride of C
+@param mr: the number of valid rows in the tile
+@param nr: the number of valid columns in the tile
+@return void
+*/
+static void store_tile_f32(const float tile[GEMM_MR][GEMM_NR], double* c, int ldc, int mr, int nr)
+{
+    int i,j;
+    for(i=0;i<mr;i++)
+    {
+        for(j=0;j<nr;j++)
+        {
+            c[(size_t)i*ldc + j] += tile[i][j];
+        }
+    }
+}
+
+/*
+multiplies a packed GEMM_MR*kc micro-panel of A by a packed kc*GEMM_NR micro-panel of B, both of floats,
+and adds the mr*nr valid part of the product to C
+the accumulators are floats kept in registers for the whole kc loop, only the finished tile is widened
+@param kc: the shared dimension
+@param a: the packed micro-panel of A
+@param b: the packed micro-panel of B
+@param c: the top left element of the destination tile
+@param ldc: the row stride of C
+@param mr: the number of valid rows in the tile
+@param nr: the number of valid columns in the tile
+@return void
+*/
+static void micro_kernel_f32_scalar(int kc, const float* a, const float* b, double* c, int ldc, int mr, int nr)
+{
+    int p;
+    float c00 = 0, c01 = 0, c02 = 0, c03 = 0;
+    float c10 = 0, c11 = 0, c12 = 0, c13 = 0;
+    float c20 = 0, c21 = 0, c22 = 0, c23 = 0;
+    float c30 = 0, c31 = 0, c32 = 0, c33 = 0;
+    float tile[GEMM_MR][GEMM_NR];
+
+    for(p=0;p<kc;p++)
+    {
+        float a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+        float b0 = b[0], b1 = b[1], b2 = b[2], b3 = b[3];
+        c00 += a0*b0; c01 += a0*b1; c02 += a0*b2; c03 += a0*b3;
+        c10 += a1*b0; c11 += a1*b1; c12 += a1*b2; c13 += a1*b3;
+        c20 += a2*b0; c21 += a2*b1; c22 += a2*b2; c23 += a2*b3;
+        c30 += a3*b0; c31 += a3*b1; c32 += a3*b2; c33 += a3*b3;
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+    tile[0][0] = c00; tile[0][1] = c01; tile[0][2] = c02; tile[0][3] = c03;
+    tile[1][0] = c10; tile[1][1] = c11; tile[1][2] = c12; tile[1][3] = c13;
+    tile[2][0] = c20; tile[2][1] = c21; tile[2][2] = c22; tile[2][3] = c23;
+    tile[3][0] = c30; tile[3][1] = c31; tile[3][2] = c32; tile[3][3] = c33;
+    store_tile_f32((const float (*)[GEMM_NR])tile, c, ldc, mr, nr);
+}
+
+#ifdef SIMD_X86
+/*
+AVX2 version of the float micro-kernel: two rows of the tile share one 256-bit accumulator,
+the B row is duplicated into both halves and the A values are spread with a permutation
+*/
+__attribute__((target("avx2,fma")))
+static void micro_kernel_f32_avx2(int kc, const float* a, const float* b, double* c, int ldc, int mr, int nr)
+{
+    int p;
+    __m256 c01 = _mm256_setzero_ps(), c23 = _mm256_setzero_ps();
+    __m256 av, bv;
+    __m256i rows01 = _mm256_set_epi32(1, 1, 1, 1, 0, 0, 0, 0);
+    __m256i rows23 = _mm256_set_epi32(3, 3, 3, 3, 2, 2, 2, 2);
+    float tile[GEMM_MR][GEMM_NR];
+
+    for(p=0;p<kc;p++)
+    {
+        av = _mm256_castps128_ps256(_mm_loadu_ps(a));
+        bv = _mm256_broadcast_ps((const __m128*)b);
+        c01 = _mm256_fmadd_ps(_mm256_permutevar8x32_ps(av, rows01), bv, c01);
+        c23 = _mm256_fmadd_ps(_mm256_permutevar8x32_ps(av, rows23), bv, c23);
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+    _mm256_storeu_ps(tile[0], c01);
+    _mm256_storeu_ps(tile[2], c23);
+    store_tile_f32((const float (*)[GEMM_NR])tile, c, ldc, mr, nr);
+}
+
+/*
+AVX-512 version of the float micro-kernel: the whole tile is one 512-bit accumulator,
+the B row is copied into all four quarters and the A values are spread with a permutation
+*/
+__attribute__((target("avx512f")))
+static void micro_kernel_f32_avx512(int kc, const float* a, const float* b, double* c, int ldc, int mr, int nr)
+{
+    int p;
+    __m512 acc = _mm512_setzero_ps();
+    __m512 av, bv;
+    __m512i rows = _mm512_set_epi32(3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0);
+    float tile[GEMM_MR][GEMM_NR];
+
+    for(p=0;p<kc;p++)
+    {
+        av = _mm512_castps128_ps512(_mm_loadu_ps(a));
+        bv = _mm512_broadcast_f32x4(_mm_loadu_ps(b));
+        acc = _mm512_fmadd_ps(_mm512_permutexvar_ps(rows, av), bv, acc);
+        a += GEMM_MR;
+        b += GEMM_NR;
+    }
+
+    _mm512_storeu_ps(tile[0], acc);
+    store_tile_f32((const float (*)[GEMM_NR])tile, c, ldc, mr, nr);
+}
+#endif
+
+/*
+selects the float gemm micro-kernel for the current instruction set level
+@return micro_kernel_f32_fn: the micro-kernel
+*/
+micro_kernel_f32_fn simd_micro_kernel_f32(void)
+{
+#ifdef SIMD_X86
+    switch(simd_level())
+    {
+        case SIMD_AVX512: return micro_kernel_f32_avx512;
+        case SIMD_AVX2: return micro_kernel_f32_avx2;
+        default: break;
+    }
+#endif
+    return micro_kernel_f32_scalar;
+}
+
+/*
+evaluates exp in place with the range reduced Taylor polynomial, one element at a time
+@param values: the arguments, replaced by their exponentials
+@param n: the number of values
+@param degree: the degree of the polynomial
+@return void
+*/
+static void exp_scalar(double* values, int n, int degree)
+{
+    int i,k;
+    double x, t, r, p;
+    for(i=0;i<n;i++)
+    {
+        x = values[i];
+        if(!(x >= EXP_MIN && x <= EXP_MAX))
+        {
+            values[i] = exp(x);
+            continue;
+        }
+        t = floor(x * EXP_LOG2E + 0.5);
+        r = (x - t * EXP_LN2_HI) - t * EXP_LN2_LO;
+        p = inv_factorial[degree];
+        for(k=degree-1;k>=0;k--)
+        {
+            p = p * r + inv_factorial[k];
+        }
+        values[i] = ldexp(p, (int)t);
+    }
+}
+
+#ifdef SIMD_X86
+/*
+AVX2 version of the polynomial exp: four values per step, 2^t is built directly in the
+exponent bits of a double, a step with an argument out of range is left to the scalar version
+*/
+__attribute__((target("avx2,fma")))
+static void exp_avx2(double* values, int n, int degree)
+{
+    int i,k;
+    __m256d x, t, r, p;
+    __m256i e;
+    const __m256d min = _mm256_set1_pd(EXP_MIN), max = _mm256_set1_pd(EXP_MAX);
+    const __m256d log2e = _mm256_set1_pd(EXP_LOG2E);
+    const __m256d ln2_hi = _mm256_set1_pd(EXP_LN2_HI), ln2_lo = _mm256_set1_pd(EXP_LN2_LO);
+
+    for(i=0;i+4<=n;i+=4)
+    {
+        x = _mm256_loadu_pd(values + i);
+        if(_mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(x, min, _CMP_GE_OQ), _mm256_cmp_pd(x, max, _CMP_LE_OQ))) != 0xF)
+        {
+            exp_scalar(values + i, 4, degree);
+            continue;
+        }
+        t = _mm256_round_pd(_mm256_mul_pd(x, log2e), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        r = _mm256_fnmadd_pd(t, ln2_lo, _mm256_fnmadd_pd(t, ln2_hi, x));
+        p = _mm256_set1_pd(inv_factorial[degree]);
+        for(k=degree-1;k>=0;k--)
+        {
+            p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(inv_factorial[k]));
+        }
+        e = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(t));
+        e = _mm256_slli_epi64(_mm256_add_epi64(e, _mm256_set1_epi64x(1023)), 52);
+        _mm256_storeu_pd(values + i, _mm256_mul_pd(p, _mm256_castsi256_pd(e)));
+    }
+    exp_scalar(values + i, n - i, degree);
+}
+
+/*
+AVX-512 version of the polynomial exp: eight values per step, scaled by 2^t with scalef
+*/
+__attribute__((target("avx512f")))
+static void exp_avx512(double* values, int n, int degree)
+{
+    int i,k;
+    __m512d x, t, r, p;
+    const __m512d min = _mm512_set1_pd(EXP_MIN), max = _mm512_set1_pd(EXP_MAX);
+    const __m512d log2e = _mm512_set1_pd(EXP_LOG2E);
+    const __m512d ln2_hi = _mm512_set1_pd(EXP_LN2_HI), ln2_lo = _mm512_set1_pd(EXP_LN2_LO);
+
+    for(i=0;i+8<=n;i+=8)
+    {
+        x = _mm512_loadu_pd(values + i);
+        if((_mm512_cmp_pd_mask(x, min, _CMP_GE_OQ) & _mm512_cmp_pd_mask(x, max, _CMP_LE_OQ)) != 0xFF)
+        {
+            exp_scalar(values + i, 8, degree);
+            continue;
+        }
+        t = _mm512_roundscale_pd(_mm512_mul_pd(x, log2e), _MM_FROUND_TO_NEAREST_INT);
+        r = _mm512_fnmadd_pd(t, ln2_lo, _mm512_fnmadd_pd(t, ln2_hi, x));
+        p = _mm512_set1_pd(inv_factorial[degree]);
+        for(k=degree-1;k>=0;k--)
+        {
+            p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(inv_factorial[k]));
+        }
+        _mm512_storeu_pd(values + i, _mm512_scalef_pd(p, t));
+    }
+    exp_scalar(values + i, n - i, degree);
+}
+#endif
+
+/*
+replaces every value of an array by its exponential
+@param values: the arguments, replaced by their exponentials
+@param n: the number of values
+@param mode: EXP_LIBM, or EXP_PRECISE / EXP_FAST for the vectorized polynomial
+(libm is used at the scalar level)
+@return void
+*/
+void simd_exp(double* values, int n, int mode)
+{
+    int i;
+    int degree = (mode == EXP_FAST) ? EXP_FAST_DEGREE : EXP_PRECISE_DEGREE;
+    if(mode == EXP_LIBM)
+    {
+        for(i=0;i<n;i++)
+        {
+            values[i] = exp(values[i]);
+        }
+        return;
+    }
+#ifdef SIMD_X86
+    switch(simd_level())
+    {
+        case SIMD_AVX512:
+            exp_avx512(values, n, degree);
+            return;
+        case SIMD_AVX2:
+            exp_avx2(values, n, degree);
+            return;
+        default: break;
+    }
+#endif
+    /* one element at a time the polynomial is slower than libm, which is also more accurate */
+    simd_exp(values, n, EXP_LIBM);
+}
@@ -0,0 +1,23 @@
+/* C header file for the SIMD kernels and their runtime CPU dispatch */
+#ifndef SIMD_H
+#define SIMD_H
+
+/* instruction set levels, in increasing order */
+#define SIMD_SCALAR 0
+#define SIMD_AVX2 1
+#define SIMD_AVX512 2
+
+/* adds the product of a packed GEMM_MR*kc micro-panel of A and a packed kc*GEMM_NR micro-panel of B to C */
+typedef void (*micro_kernel_fn)(int kc, const double* a, const double* b, double* c, int ldc, int mr, int nr);
+
+/* the same on micro-panels of floats: the kc products are summed in float and the tile is added to C in double */
+typedef void (*micro_kernel_f32_fn)(int kc, const float* a, const float* b, double* c, int ldc, int mr, int nr);
+
+int simd_level(void);
+void simd_set_level(int level);
+const char* simd_level_name(int level);
+micro_kernel_fn simd_micro_kernel(void);
+micro_kernel_f32_fn simd_micro_kernel_f32(void);
+void simd_exp(double* values, int n, int mode);
+
+#endif
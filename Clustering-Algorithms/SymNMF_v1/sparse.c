@@ -0,0 +1,477 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "symnmf.h"
+#include "sparse.h"
+#include "simd.h"
+#include "stats.h"
+
+/*
+the sparse mode keeps, for every point, either its knn nearest neighbours or every point
+within distance epsilon, so W takes O(N*knn) memory instead of O(N^2)
+a knn graph is not symmetric by itself, it is symmetrized by union: (i,j) is kept when j is
+among the neighbours of i or i among those of j
+the neighbours are found by brute force, which still costs O(N^2*vecdim) time
+*/
+
+/* a neighbour of a point: its index and its squared distance to the point */
+typedef struct neighbour
+{
+    int index;
+    double sq_dist;
+} neighbour;
+
+/*
+frees a sparse matrix allocated by csr_malloc
+@param p: the matrix to be freed (may be NULL)
+@return void
+*/
+void csr_free(csr_matrix* p)
+{
+    free(p); /* header and arrays share one block */
+}
+
+/*
+allocates memory for a sparse n*n matrix with nnz entries
+the header, the values (on a MATRIX_ALIGNMENT boundary), the row offsets and the column
+indices are allocated in a single block
+@param n: the number of rows and columns
+@param nnz: the number of entries
+@return csr_matrix*: the allocated matrix
+*/
+csr_matrix* csr_malloc(int n, int nnz)
+{
+    size_t header = (sizeof(csr_matrix) + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+    size_t values = (size_t)nnz * sizeof(double);
+    size_t bytes = header + MATRIX_ALIGNMENT + values + ((size_t)n + 1 + nnz) * sizeof(int);
+    size_t misalignment;
+    char* block;
+    csr_matrix* new_matrix;
+
+    if((block = malloc(bytes)) == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    stats_allocated(bytes);
+    new_matrix = (csr_matrix*)block;
+    misalignment = (size_t)(block + header) % MATRIX_ALIGNMENT;
+    new_matrix->val = (double*)(block + header + (misalignment ? MATRIX_ALIGNMENT - misalignment : 0));
+    new_matrix->row_ptr = (int*)(new_matrix->val + nnz);
+    new_matrix->col = new_matrix->row_ptr + n + 1;
+    new_matrix->n = n;
+    new_matrix->nnz = nnz;
+    return new_matrix;
+}
+
+/*
+tells if a neighbour is farther than another, ties are broken by index so that the graph
+does not depend on the order the points are visited in
+@param a: the first neighbour
+@param b: the second neighbour
+@return int: 1 if a is farther than b, 0 otherwise
+*/
+static int farther(const neighbour* a, const neighbour* b)
+{
+    return a->sq_dist > b->sq_dist || (a->sq_dist == b->sq_dist && a->index > b->index);
+}
+
+/*
+orders neighbours by index, for qsort
+@param a: the first neighbour
+@param b: the second neighbour
+@return int: negative, zero or positive as a comes before, with or after b
+*/
+static int compare_index(const void* a, const void* b)
+{
+    return ((const neighbour*)a)->index - ((const neighbour*)b)->index;
+}
+
+/*
+finds the knn nearest neighbours of a point, the point itself excluded
+the candidates go through a max-heap of size knn whose top is the farthest neighbour kept
+@param vectors: the matrix of vectors (N*vecdim)
+@param i: the point
+@param knn: the number of neighbours, at most N-1
+@param heap: filled with the knn neighbours, in heap order
+@return void
+*/
+static void nearest_neighbours(const matrix* vectors, int i, int knn, neighbour* heap)
+{
+    int j, size = 0, pos, child;
+    neighbour candidate;
+    const double* vec_i = MATRIX_ROW(vectors, i);
+
+    for(j=0;j<vectors->rows;j++)
+    {
+        if(j == i) continue;
+        candidate.index = j;
+        candidate.sq_dist = euclidean_distance(vec_i, MATRIX_ROW(vectors, j), vectors->cols, 1);
+        if(size < knn) /* sift the new neighbour up */
+        {
+            pos = size++;
+            while(pos > 0 && farther(&candidate, &heap[(pos - 1) / 2]))
+            {
+                heap[pos] = heap[(pos - 1) / 2];
+                pos = (pos - 1) / 2;
+            }
+            heap[pos] = candidate;
+        }
+        else if(knn > 0 && farther(&heap[0], &candidate)) /* replace the farthest one and sift down */
+        {
+            pos = 0;
+            while((child = 2 * pos + 1) < size)
+            {
+                if(child + 1 < size && farther(&heap[child + 1], &heap[child])) child++;
+                if(!farther(&heap[child], &candidate)) break;
+                heap[pos] = heap[child];
+                pos = child;
+            }
+            heap[pos] = candidate;
+        }
+    }
+}
+
+/*
+builds the symmetrized knn similarity graph
+every knn edge (i,j) is written to row i and to row j, then every row is sorted by column
+and the edges found from both ends are merged
+@param vectors: the matrix of vectors (N*vecdim)
+@param knn: the number of neighbours per point, at most N-1
+@param threads: the number of threads to use
+@param exp_mode: how the kernel exp(-d/2) is evaluated, one of the EXP_ values
+@return csr_matrix*: the similarity graph (N*N), NULL if it has more entries than an int can index
+*/
+static csr_matrix* knn_graph(const matrix* vectors, int knn, int threads, int exp_mode)
+{
+    int i,t;
+    int N = vectors->rows;
+    size_t edges = (size_t)N * knn;
+    neighbour* neighbours;
+    neighbour* entries;
+    int* starts;
+    int* lengths;
+    csr_matrix* graph = NULL;
+
+    if(2 * edges > INT_MAX) /* the row offsets of the edges written from both ends are ints */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    neighbours = malloc((edges + 1) * sizeof(neighbour));
+    entries = malloc((2 * edges + 1) * sizeof(neighbour));
+    starts = calloc((size_t)N + 1, sizeof(int));
+    lengths = malloc(((size_t)N + 1) * sizeof(int));
+    if(neighbours == NULL || entries == NULL || starts == NULL || lengths == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        free(neighbours);
+        free(entries);
+        free(starts);
+        free(lengths);
+        return NULL;
+    }
+    stats_allocated((edges + 1 + 2 * edges + 1) * sizeof(neighbour) + 2 * ((size_t)N + 1) * sizeof(int));
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 16)
+#endif
+    for(i=0;i<N;i++)
+    {
+        nearest_neighbours(vectors, i, knn, neighbours + (size_t)i * knn);
+    }
+
+    /* write every edge to both of its rows */
+    for(i=0;i<N;i++)
+    {
+        for(t=0;t<knn;t++)
+        {
+            starts[i + 1]++;
+            starts[neighbours[(size_t)i * knn + t].index + 1]++;
+        }
+    }
+    for(i=0;i<N;i++)
+    {
+        starts[i + 1] += starts[i];
+    }
+    memcpy(lengths, starts, N * sizeof(int));
+    for(i=0;i<N;i++)
+    {
+        for(t=0;t<knn;t++)
+        {
+            neighbour edge = neighbours[(size_t)i * knn + t];
+            entries[lengths[i]++] = edge;
+            entries[lengths[edge.index]].index = i;
+            entries[lengths[edge.index]++].sq_dist = edge.sq_dist;
+        }
+    }
+
+    /* sort the rows and merge the duplicated edges, lengths becomes the merged row lengths */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 64) private(t)
+#endif
+    for(i=0;i<N;i++)
+    {
+        neighbour* row = entries + starts[i];
+        int length = 0;
+        qsort(row, starts[i + 1] - starts[i], sizeof(neighbour), compare_index);
+        for(t=0;t<starts[i + 1] - starts[i];t++)
+        {
+            if(length == 0 || row[length - 1].index != row[t].index) row[length++] = row[t];
+        }
+        lengths[i] = length;
+    }
+
+    t = 0;
+    for(i=0;i<N;i++)
+    {
+        t += lengths[i];
+    }
+    if((graph = csr_malloc(N, t)) != NULL)
+    {
+        graph->row_ptr[0] = 0;
+        for(i=0;i<N;i++)
+        {
+            graph->row_ptr[i + 1] = graph->row_ptr[i] + lengths[i];
+        }
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) private(t)
+#endif
+        for(i=0;i<N;i++)
+        {
+            int offset = graph->row_ptr[i];
+            for(t=0;t<lengths[i];t++)
+            {
+                graph->col[offset + t] = entries[starts[i] + t].index;
+                graph->val[offset + t] = -entries[starts[i] + t].sq_dist / 2;
+            }
+            simd_exp(graph->val + offset, lengths[i], exp_mode);
+        }
+    }
+
+    (void)threads;
+    free(neighbours);
+    free(entries);
+    free(starts);
+    free(lengths);
+    return graph;
+}
+
+/*
+builds the epsilon neighbourhood similarity graph, symmetric by construction
+the rows are counted in a first pass over the pairs and filled in a second one
+@param vectors: the matrix of vectors (N*vecdim)
+@param epsilon: the radius of the neighbourhoods
+@param threads: the number of threads to use
+@param exp_mode: how the kernel exp(-d/2) is evaluated, one of the EXP_ values
+@return csr_matrix*: the similarity graph (N*N), NULL if it has more entries than an int can index
+*/
+static csr_matrix* epsilon_graph(const matrix* vectors, double epsilon, int threads, int exp_mode)
+{
+    int i,j;
+    int N = vectors->rows, vecdim = vectors->cols;
+    double sq_epsilon = epsilon * epsilon;
+    size_t total = 0;
+    int* counts;
+    csr_matrix* graph;
+
+    if((counts = calloc((size_t)N + 1, sizeof(int))) == NULL) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    stats_allocated(((size_t)N + 1) * sizeof(int));
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 16) private(j)
+#endif
+    for(i=0;i<N;i++)
+    {
+        const double* vec_i = MATRIX_ROW(vectors, i);
+        int count = 0;
+        for(j=0;j<N;j++)
+        {
+            if(j != i && euclidean_distance(vec_i, MATRIX_ROW(vectors, j), vecdim, 1) <= sq_epsilon) count++;
+        }
+        counts[i + 1] = count;
+    }
+    /* a large epsilon keeps up to N*(N-1) entries, more than the int row offsets of the graph can index */
+    for(i=0;i<N;i++)
+    {
+        total += counts[i + 1];
+        if(total > INT_MAX)
+        {
+            printf("An Error Has Occured");
+            free(counts);
+            return NULL;
+        }
+        counts[i + 1] = (int)total;
+    }
+
+    if((graph = csr_malloc(N, counts[N])) != NULL)
+    {
+        memcpy(graph->row_ptr, counts, ((size_t)N + 1) * sizeof(int));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 16) private(j)
+#endif
+        for(i=0;i<N;i++)
+        {
+            const double* vec_i = MATRIX_ROW(vectors, i);
+            int p = graph->row_ptr[i];
+            double sq_dist;
+            for(j=0;j<N;j++)
+            {
+                if(j == i) continue;
+                sq_dist = euclidean_distance(vec_i, MATRIX_ROW(vectors, j), vecdim, 1);
+                if(sq_dist <= sq_epsilon)
+                {
+                    graph->col[p] = j;
+                    graph->val[p++] = -sq_dist / 2;
+                }
+            }
+            simd_exp(graph->val + graph->row_ptr[i], graph->row_ptr[i + 1] - graph->row_ptr[i], exp_mode);
+        }
+    }
+
+    (void)threads;
+    free(counts);
+    return graph;
+}
+
+/*
+calculates the sparse similarity graph of a matrix of doubles
+the graph keeps the config->knn nearest neighbours of every point, or when knn is 0 the
+points within config->epsilon, SPARSE_DEFAULT_KNN neighbours when neither is set
+@param vectors: the matrix of vectors (N*vecdim)
+@param config: the engine settings (may be NULL for the defaults)
+@return csr_matrix*: the similarity graph (N*N)
+*/
+csr_matrix* sym_sparse(const matrix* vectors, const symnmf_config* config)
+{
+    int N = vectors->rows;
+    int threads = config_threads(config);
+    int exp_mode = (config != NULL) ? config->exp_mode : EXP_LIBM;
+    int knn = (config != NULL) ? config->knn : 0;
+    double epsilon = (config != NULL) ? config->epsilon : 0;
+    double start = stats_start();
+    csr_matrix* graph;
+
+    if(knn <= 0 && epsilon <= 0) knn = SPARSE_DEFAULT_KNN;
+    if(knn > 0) graph = knn_graph(vectors, (knn < N) ? knn : ((N > 1) ? N - 1 : 0), threads, exp_mode); /* N < 2 has no pairs */
+    else graph = epsilon_graph(vectors, epsilon, threads, exp_mode);
+    if(graph != NULL) stats_stop(STATS_SYM, start);
+    return graph;
+}
+
+/*
+calculates the degree of every point in a sparse similarity graph
+@param graph: the similarity graph (N*N)
+@return matrix*: the degrees, the diagonal of the ddg matrix (N*1)
+*/
+static matrix* csr_row_sums(const csr_matrix* graph)
+{
+    int i,p;
+    double sum;
+    matrix* degrees;
+
+    if((degrees = matrix_malloc(graph->n, 1)) == NULL) return NULL; /* Memory allocation failed */
+    for(i=0;i<graph->n;i++)
+    {
+        sum = 0;
+        for(p=graph->row_ptr[i];p<graph->row_ptr[i + 1];p++)
+        {
+            sum += graph->val[p];
+        }
+        MATRIX_AT(degrees, i, 0) = sum;
+    }
+    return degrees;
+}
+
+/*
+calculates the degrees of the sparse similarity graph of a matrix of doubles
+@param vectors: the matrix of vectors (N*vecdim)
+@param config: the engine settings (may be NULL for the defaults)
+@return matrix*: the degrees, the diagonal of the ddg matrix (N*1)
+*/
+matrix* ddg_sparse(const matrix* vectors, const symnmf_config* config)
+{
+    csr_matrix* graph;
+    matrix* degrees;
+
+    if((graph = sym_sparse(vectors, config)) == NULL) return NULL; /* Memory allocation failed */
+    degrees = csr_row_sums(graph);
+    csr_free(graph);
+    return degrees;
+}
+
+/*
+calculates the normalized sparse similarity graph of a matrix of doubles, D^-1/2 * A * D^-1/2
+with the same entries as sym_sparse, scaled in place
+@param vectors: the matrix of vectors (N*vecdim)
+@param config: the engine settings (may be NULL for the defaults)
+@return csr_matrix*: the normalized similarity graph (N*N)
+*/
+csr_matrix* norm_sparse(const matrix* vectors, const symnmf_config* config)
+{
+    int i,p;
+    double start = stats_start();
+    csr_matrix* graph;
+    matrix* degrees;
+
+    if((graph = sym_sparse(vectors, config)) == NULL) return NULL; /* Memory allocation failed */
+    if((degrees = csr_row_sums(graph)) == NULL) /* Memory allocation failed */
+    {
+        csr_free(graph);
+        return NULL;
+    }
+    for(i=0;i<graph->n;i++)
+    {
+        for(p=graph->row_ptr[i];p<graph->row_ptr[i + 1];p++)
+        {
+            graph->val[p] /= sqrt(MATRIX_AT(degrees, i, 0) * MATRIX_AT(degrees, graph->col[p], 0));
+        }
+    }
+    matrix_free(degrees);
+    stats_stop(STATS_NORM, start);
+    return graph;
+}
+
+/*
+multiplies a sparse matrix by a tall dense matrix, C = A*B
+each entry a_ij adds a_ij times row j of B to row i of C
+the rows of C are independent, so threads only split them and the result does not change
+@param A: the sparse matrix (n*n)
+@param B: the dense matrix (n*k)
+@param C: the result matrix (n*k), must not alias B
+@param threads: the number of threads to use
+@return void
+*/
+void csr_multiply(const csr_matrix* A, const matrix* B, matrix* C, int threads)
+{
+    int i,p,c;
+    int k = B->cols;
+    (void)threads;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads > 0 ? threads : 1) schedule(dynamic, 64) private(p, c)
+#endif
+    for(i=0;i<A->n;i++)
+    {
+        double* c_row = MATRIX_ROW(C, i);
+        memset(c_row, 0, k * sizeof(double));
+        for(p=A->row_ptr[i];p<A->row_ptr[i + 1];p++)
+        {
+            const double* b_row = MATRIX_ROW(B, A->col[p]);
+            double a = A->val[p];
+            for(c=0;c<k;c++)
+            {
+                c_row[c] += a * b_row[c];
+            }
+        }
+    }
+}
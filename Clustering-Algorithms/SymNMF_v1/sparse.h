@@ -0,0 +1,14 @@
+/* C header file for the sparse neighbourhood graph mode */
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include "symnmf.h"
+
+void csr_free(csr_matrix* p);
+csr_matrix* csr_malloc(int n, int nnz);
+csr_matrix* sym_sparse(const matrix* vectors, const symnmf_config* config);
+matrix* ddg_sparse(const matrix* vectors, const symnmf_config* config);
+csr_matrix* norm_sparse(const matrix* vectors, const symnmf_config* config);
+void csr_multiply(const csr_matrix* A, const matrix* B, matrix* C, int threads);
+
+#endif
@@ -0,0 +1,165 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+/* the names of the phases in the JSON report, by their STATS_ values */
+static const char* phase_names[STATS_PHASES] = {"read", "sym", "norm", "solve", "product", "gram", "write"};
+
+/* every counter is only touched when the statistics are enabled, so a disabled engine pays one branch per phase */
+static int enabled = 0;
+static symnmf_stats totals = {{0}, {0}, 0, 0, -1, 0};
+
+/*
+enables the statistics if the STATS_ENV environment variable is set to anything but "" or "0"
+@return int: 1 if the statistics are enabled
+*/
+int stats_from_env(void)
+{
+    const char* value = getenv(STATS_ENV);
+    if(value != NULL && value[0] != '\0' && strcmp(value, "0") != 0) enabled = 1;
+    return enabled;
+}
+
+/*
+enables or disables the statistics, the counters are kept
+@param on: 1 to enable, 0 to disable
+@return void
+*/
+void stats_enable(int on)
+{
+    enabled = (on != 0);
+}
+
+/*
+tells whether the statistics are enabled
+@return int: 1 if they are
+*/
+int stats_enabled(void)
+{
+    return enabled;
+}
+
+/*
+clears every counter
+@return void
+*/
+void stats_reset(void)
+{
+    memset(&totals, 0, sizeof(totals));
+    totals.iterations = -1;
+}
+
+/*
+reads the monotonic clock at the start of a phase
+@return double: the current time in seconds, 0 when the statistics are disabled
+*/
+double stats_start(void)
+{
+    struct timespec now;
+    if(!enabled) return 0;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*
+adds the time since stats_start to a phase
+phases may end on several threads at once (the restarts of symnmf_restarts), so the update is serialized
+@param phase: one of the STATS_ values
+@param start: what stats_start returned at the start of the phase
+@return void
+*/
+void stats_stop(int phase, double start)
+{
+    struct timespec now;
+    double elapsed;
+    if(!enabled) return;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    elapsed = now.tv_sec + now.tv_nsec * 1e-9 - start;
+#ifdef _OPENMP
+#pragma omp critical(symnmf_stats)
+#endif
+    {
+        totals.seconds[phase] += elapsed;
+        totals.calls[phase]++;
+    }
+}
+
+/*
+counts an allocation of the engine
+@param bytes: the size of the allocation
+@return void
+*/
+void stats_allocated(size_t bytes)
+{
+    if(!enabled) return;
+#ifdef _OPENMP
+#pragma omp critical(symnmf_stats)
+#endif
+    {
+        totals.bytes_allocated += (double)bytes;
+        totals.allocations++;
+    }
+}
+
+/*
+records how a factorization ended
+@param iterations: the number of iterations performed
+@param delta: the squared change of H in the last iteration
+@return void
+*/
+void stats_solved(int iterations, double delta)
+{
+    if(!enabled) return;
+#ifdef _OPENMP
+#pragma omp critical(symnmf_stats)
+#endif
+    {
+        totals.iterations = iterations;
+        totals.delta = delta;
+    }
+}
+
+/*
+copies the counters
+@param stats: filled with the counters
+@return void
+*/
+void stats_get(symnmf_stats* stats)
+{
+    *stats = totals;
+}
+
+/*
+gives the name of a phase in the JSON report
+@param phase: one of the STATS_ values
+@return const char*: the name
+*/
+const char* stats_phase_name(int phase)
+{
+    return phase_names[phase];
+}
+
+/*
+writes the counters as a single line JSON object:
+{"phases": {"read": {"seconds": s, "calls": n}, ...}, "bytes_allocated": b, "allocations": a,
+"iterations": i, "delta": d}, with null iterations and delta when nothing was factorized
+@param file: the file to write to (stderr for the command line)
+@return int: 0 on success, 1 if writing failed
+*/
+int stats_print_json(FILE* file)
+{
+    int phase;
+    fprintf(file, "{\"phases\": {");
+    for(phase=0;phase<STATS_PHASES;phase++)
+    {
+        fprintf(file, "%s\"%s\": {\"seconds\": %.9f, \"calls\": %ld}", phase ? ", " : "", phase_names[phase],
+                totals.seconds[phase], totals.calls[phase]);
+    }
+    fprintf(file, "}, \"bytes_allocated\": %.0f, \"allocations\": %ld, ", totals.bytes_allocated, totals.allocations);
+    if(totals.iterations < 0) fprintf(file, "\"iterations\": null, \"delta\": null}\n");
+    else fprintf(file, "\"iterations\": %d, \"delta\": %.17g}\n", totals.iterations, totals.delta);
+    return ferror(file) != 0;
+}
@@ -0,0 +1,50 @@
+/* C header file for the timers and counters of the engine */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* the phases the engine times, a phase includes the phases it calls (norm includes sym) */
+#define STATS_READ 0    /* reading the input vectors */
+#define STATS_SYM 1     /* the similarity matrix, in any storage */
+#define STATS_NORM 2    /* the norm matrix, in any storage and precision */
+#define STATS_SOLVE 3   /* the symnmf iterations, including their products */
+#define STATS_PRODUCT 4 /* the products W*H */
+#define STATS_GRAM 5    /* the products H^T*H and H*(H^T*H) */
+#define STATS_WRITE 6   /* writing the result */
+#define STATS_PHASES 7
+
+/* the environment variable enabling the statistics when set to anything but "" or "0" */
+#define STATS_ENV "SYMNMF_STATS"
+
+/*
+what the engine measured since the statistics were last reset
+the totals are process-global: calls running at the same time (threads of the Python module, which release
+the GIL) add into the same counters, so their numbers are mixed together and iterations and delta are those of
+whichever factorization finished last
+*/
+typedef struct symnmf_stats
+{
+    double seconds[STATS_PHASES]; /* wall time spent in every phase, on the monotonic clock */
+    long calls[STATS_PHASES];     /* times every phase was entered */
+    double bytes_allocated;       /* bytes of the matrices and scratch buffers the engine allocated, a growing
+                                     buffer counting every size it grows to */
+    long allocations;             /* number of those allocations */
+    int iterations;               /* iterations of the last factorization, -1 before any */
+    double delta;                 /* squared change of H in the last iteration of the last factorization */
+} symnmf_stats;
+
+int stats_from_env(void);
+void stats_enable(int enabled);
+int stats_enabled(void);
+void stats_reset(void);
+double stats_start(void);
+void stats_stop(int phase, double start);
+void stats_allocated(size_t bytes);
+void stats_solved(int iterations, double delta);
+void stats_get(symnmf_stats* stats);
+const char* stats_phase_name(int phase);
+int stats_print_json(FILE* file);
+
+#endif
@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "stream.h"
+#include "gemm.h"
+#include "stats.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/*
+frees the memory of a streaming operator, the vectors stay owned by the caller
+@param op: the operator to free
+@return void
+*/
+void stream_free(stream_operator* op)
+{
+    int t;
+    if(op == NULL) return;
+    if(op->cache != NULL)
+    {
+        for(t=0;t<op->cached_tiles;t++)
+        {
+            matrix_free(op->cache[t]);
+        }
+        free(op->cache);
+    }
+    matrix_free(op->transposed);
+    free(op->sq_norms);
+    free(op->inv_sqrt_degrees);
+    free(op);
+}
+
+/*
+counts the tiles of the upper triangle of A swept by stream_multiply
+@param N: the number of points
+@return int: the number of tiles (bi, bj) with bj >= bi
+*/
+static int stream_tiles(int N)
+{
+    int blocks = (N + STREAM_TILE - 1) / STREAM_TILE;
+    return blocks * (blocks + 1) / 2;
+}
+
+/*
+computes the degrees of the points and the tiles that fit in the cache
+the cache holds the first tiles of the sweep order rather than the most recently used ones,
+since every product sweeps all the tiles in the same order and would evict an LRU cache entirely
+@param op: the operator, with vectors, transposed and sq_norms set
+@param config: the configuration of the similarity matrix
+@param cache_bytes: the memory budget of the tile cache
+@return int: 0 on success, 1 if memory allocation failed
+*/
+static int stream_prepare(stream_operator* op, const symnmf_config* config, size_t cache_bytes)
+{
+    int i,t,bi,bj;
+    int N = op->vectors->rows;
+    size_t tiles = cache_bytes / ((size_t)STREAM_TILE * STREAM_TILE * sizeof(double));
+    matrix* degrees;
+    double* buffer;
+
+    if((degrees = ddg_diagonal(op->vectors, config)) == NULL) return 1; /* Memory allocation failed */
+    if((op->inv_sqrt_degrees = malloc(N * sizeof(double))) == NULL)
+    {
+        printf("An Error Has Occured");
+        matrix_free(degrees);
+        return 1;
+    }
+    stats_allocated(N * sizeof(double));
+    for(i=0;i<N;i++)
+    {
+        op->inv_sqrt_degrees[i] = 1 / sqrt(MATRIX_AT(degrees, i, 0));
+    }
+    matrix_free(degrees);
+
+    if(tiles > (size_t)stream_tiles(N)) tiles = stream_tiles(N);
+    if(tiles == 0) return 0;
+    if((op->cache = calloc(tiles, sizeof(matrix*))) == NULL ||
+       (buffer = malloc(gemm_buffer_size(STREAM_TILE) * sizeof(double))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return 1;
+    }
+    stats_allocated(tiles * sizeof(matrix*) + gemm_buffer_size(STREAM_TILE) * sizeof(double));
+    t = 0;
+    for(bi=0;bi<N && t<(int)tiles;bi+=STREAM_TILE)
+    {
+        for(bj=bi;bj<N && t<(int)tiles;bj+=STREAM_TILE)
+        {
+            if((op->cache[t] = matrix_malloc(MIN(STREAM_TILE, N - bi), MIN(STREAM_TILE, N - bj))) == NULL)
+            {
+                free(buffer);
+                return 1;
+            }
+            sym_tile(op->vectors, op->transposed, op->sq_norms, bi, bj, op->cache[t], buffer, op->exp_mode);
+            op->cached_tiles = ++t;
+        }
+    }
+    free(buffer);
+    return 0;
+}
+
+/*
+creates the streaming operator of the norm matrix of a set of points
+memory is O(N*vecdim) plus the tile cache, instead of the O(N^2) of the stored norm matrix
+@param vectors: the matrix of vectors (N*vecdim), must outlive the operator
+@param config: the configuration of the similarity matrix (sym_backend, exp_mode)
+@param cache_bytes: the memory budget for cached tiles of the similarity matrix, 0 to recompute every tile
+@return stream_operator*: the operator
+*/
+stream_operator* stream_create(const matrix* vectors, const symnmf_config* config, size_t cache_bytes)
+{
+    int i,j;
+    int N = vectors->rows, vecdim = vectors->cols;
+    stream_operator* op;
+
+    if((op = calloc(1, sizeof(stream_operator))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    stats_allocated(sizeof(stream_operator));
+    op->vectors = vectors;
+    op->exp_mode = config->exp_mode;
+
+    if(config->sym_backend == SYM_BACKEND_GRAM)
+    {
+        if((op->sq_norms = malloc(N * sizeof(double))) == NULL)
+        {
+            printf("An Error Has Occured");
+            stream_free(op);
+            return NULL;
+        }
+        stats_allocated(N * sizeof(double));
+        if((op->transposed = matrix_malloc(vecdim, N)) == NULL)
+        {
+            stream_free(op);
+            return NULL;
+        }
+        for(i=0;i<N;i++)
+        {
+            const double* vec = MATRIX_ROW(vectors, i);
+            op->sq_norms[i] = 0;
+            for(j=0;j<vecdim;j++)
+            {
+                op->sq_norms[i] += vec[j] * vec[j];
+                MATRIX_AT(op->transposed, j, i) = vec[j];
+            }
+        }
+    }
+
+    if(stream_prepare(op, config, cache_bytes)) /* Memory allocation failed */
+    {
+        stream_free(op);
+        return NULL;
+    }
+    return op;
+}
+
+/*
+calculates the number of doubles one chunk of stream_multiply needs for its scratch space
+@param k: the number of columns of H (and C)
+@return size_t: the size of a recomputed tile, of the transposed product of a tile and of the gemm packing space
+*/
+static size_t stream_chunk_size(int k)
+{
+    return (size_t)STREAM_TILE * STREAM_TILE + (size_t)k * STREAM_TILE + gemm_buffer_size(STREAM_TILE > k ? STREAM_TILE : k);
+}
+
+/*
+calculates the number of doubles needed for the scratch space of stream_multiply
+@param n: the number of points
+@param k: the number of columns of H (and C)
+@param threads: the number of threads stream_multiply is called with
+@return size_t: the size of the scaled H and its transpose, of the scratch space of every chunk
+and of one partial result per chunk when threaded
+*/
+size_t stream_buffer_size(int n, int k, int threads)
+{
+    if(threads < 1) threads = 1;
+    return 2 * (size_t)n * k + threads * stream_chunk_size(k) + (threads > 1 ? (size_t)threads * n * k : 0);
+}
+
+/*
+adds the block rows [begin, end) of the implicit matrix A times G to C
+each block row adds to its own rows of C and, through the mirrored lower triangle, to the rows below it
+@param op: the streaming operator (N*N)
+@param scaled: G = D^-1/2*H (N*k)
+@param scaled_t: the transpose of G (k*N)
+@param C: the result matrix (N*k)
+@param buffer: scratch space of stream_chunk_size(k) doubles
+@param begin: the first row, a multiple of STREAM_TILE
+@param end: one past the last row, a multiple of STREAM_TILE or N
+@return void
+*/
+static void stream_blocks(const stream_operator* op, const matrix* scaled, const matrix* scaled_t,
+                          matrix* C, double* buffer, int begin, int end)
+{
+    int j,c,bi,bj;
+    int N = op->vectors->rows, k = scaled->cols;
+    int blocks = (N + STREAM_TILE - 1) / STREAM_TILE;
+    int t = begin / STREAM_TILE * blocks - begin / STREAM_TILE * (begin / STREAM_TILE - 1) / 2; /* tiles before the block row */
+    const matrix* a;
+    matrix tile, product_t, g_i_t, g_j, c_i;
+
+    tile.data = buffer;
+    product_t.data = tile.data + (size_t)STREAM_TILE * STREAM_TILE;
+    product_t.rows = k;
+    buffer = product_t.data + (size_t)k * STREAM_TILE;
+
+    for(bi=begin;bi<end;bi+=STREAM_TILE)
+    {
+        c_i.data = MATRIX_ROW(C, bi);
+        c_i.rows = MIN(STREAM_TILE, N - bi);
+        c_i.cols = k;
+        c_i.stride = C->stride;
+        g_i_t.data = scaled_t->data + bi;
+        g_i_t.rows = k;
+        g_i_t.cols = c_i.rows;
+        g_i_t.stride = scaled_t->stride;
+        for(bj=bi;bj<N;bj+=STREAM_TILE)
+        {
+            if(t < op->cached_tiles)
+            {
+                a = op->cache[t];
+            }
+            else
+            {
+                tile.rows = c_i.rows;
+                tile.cols = tile.stride = MIN(STREAM_TILE, N - bj);
+                sym_tile(op->vectors, op->transposed, op->sq_norms, bi, bj, &tile, buffer, op->exp_mode);
+                a = &tile;
+            }
+            t++;
+
+            /* C_I += A_IJ*G_J */
+            g_j.data = MATRIX_ROW(scaled, bj);
+            g_j.rows = a->cols;
+            g_j.cols = k;
+            g_j.stride = scaled->stride;
+            gemm_accumulate(a, &g_j, &c_i, buffer);
+            if(bi == bj) continue;
+
+            /* C_J += A_IJ^T*G_I, from the k*cols product G_I^T*A_IJ */
+            product_t.cols = product_t.stride = a->cols;
+            gemm(&g_i_t, a, &product_t, buffer);
+            for(j=0;j<a->cols;j++)
+            {
+                double* c_j = MATRIX_ROW(C, bj + j);
+                for(c=0;c<k;c++)
+                {
+                    c_j[c] += MATRIX_AT(&product_t, c, j);
+                }
+            }
+        }
+    }
+}
+
+/*
+multiplies the implicit norm matrix by a tall matrix, C = D^-1/2*A*D^-1/2*H
+the upper triangle of A is swept tile by tile, each tile comes from the cache or is recomputed
+from the vectors, and is used twice through gemm like the blocks of symm_packed:
+C_I += A_IJ*G_J and, off the diagonal, C_J += A_IJ^T*G_I, where G = D^-1/2*H
+with several threads the block rows are split into chunks of equal work whose partial results
+are summed in chunk order, so the result only depends on the thread count
+@param op: the streaming operator (N*N)
+@param H: the tall matrix (N*k)
+@param C: the result matrix (N*k), must not alias H
+@param buffer: scratch space of stream_buffer_size(N, k, threads) doubles, or NULL to allocate it here
+@param threads: the number of threads to use
+@return int: 0 on success, 1 if memory allocation failed
+*/
+int stream_multiply(const stream_operator* op, const matrix* H, matrix* C, double* buffer, int threads)
+{
+    int i,c,t;
+    int N = op->vectors->rows, k = H->cols;
+    double* own_buffer = NULL;
+    double* partials;
+    matrix scaled, scaled_t, partial;
+
+    if(threads < 1) threads = 1;
+    if(buffer == NULL)
+    {
+        if((own_buffer = malloc(stream_buffer_size(N, k, threads) * sizeof(double))) == NULL)
+        {
+            printf("An Error Has Occured");
+            return 1;
+        }
+        stats_allocated(stream_buffer_size(N, k, threads) * sizeof(double));
+        buffer = own_buffer;
+    }
+    scaled.data = buffer;
+    scaled.rows = N;
+    scaled.cols = scaled.stride = k;
+    scaled_t.data = scaled.data + (size_t)N * k;
+    scaled_t.rows = k;
+    scaled_t.cols = scaled_t.stride = N;
+    buffer = scaled_t.data + (size_t)k * N;
+    partials = buffer + threads * stream_chunk_size(k);
+
+    /* G = D^-1/2*H and its transpose */
+    for(i=0;i<N;i++)
+    {
+        const double* h_i = MATRIX_ROW(H, i);
+        double* g_row = MATRIX_ROW(&scaled, i);
+        for(c=0;c<k;c++)
+        {
+            g_row[c] = h_i[c] * op->inv_sqrt_degrees[i];
+            MATRIX_AT(&scaled_t, c, i) = g_row[c];
+        }
+        memset(MATRIX_ROW(C, i), 0, k * sizeof(double));
+    }
+
+    if(threads == 1)
+    {
+        stream_blocks(op, &scaled, &scaled_t, C, buffer, 0, N);
+    }
+    else
+    {
+        memset(partials, 0, (size_t)threads * N * k * sizeof(double));
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 1) private(partial)
+#endif
+        for(t=0;t<threads;t++)
+        {
+            partial.data = partials + (size_t)t * N * k;
+            partial.rows = N;
+            partial.cols = partial.stride = k;
+            stream_blocks(op, &scaled, &scaled_t, &partial, buffer + t * stream_chunk_size(k),
+                          symm_chunk_row(N, t, threads, STREAM_TILE), symm_chunk_row(N, t + 1, threads, STREAM_TILE));
+        }
+
+        /* C is the sum of the partials, taken in chunk order */
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) private(c, t)
+#endif
+        for(i=0;i<N;i++)
+        {
+            double* c_i = MATRIX_ROW(C, i);
+            for(t=0;t<threads;t++)
+            {
+                const double* p_i = partials + ((size_t)t * N + i) * k;
+                for(c=0;c<k;c++)
+                {
+                    c_i[c] += p_i[c];
+                }
+            }
+        }
+    }
+
+    /* C = D^-1/2*(A*G) */
+    for(i=0;i<N;i++)
+    {
+        double* c_row = MATRIX_ROW(C, i);
+        for(c=0;c<k;c++)
+        {
+            c_row[c] *= op->inv_sqrt_degrees[i];
+        }
+    }
+
+    free(own_buffer);
+    return 0;
+}
+
+/*
+calculates the average entry of the implicit norm matrix, used to initialize H
+the sum of the entries is the sum of the product of the matrix by a vector of ones
+@param op: the streaming operator (N*N)
+@param threads: the number of threads to use
+@return double: the average entry, or a negative value if memory allocation failed
+*/
+double stream_mean(const stream_operator* op, int threads)
+{
+    int i;
+    int N = op->vectors->rows;
+    double sum = 0;
+    matrix* ones;
+    matrix* product;
+
+    ones = matrix_malloc(N, 1);
+    product = matrix_malloc(N, 1);
+    if(ones == NULL || product == NULL) /* Memory allocation failed */
+    {
+        matrix_free(ones);
+        matrix_free(product);
+        return -1;
+    }
+    for(i=0;i<N;i++)
+    {
+        MATRIX_AT(ones, i, 0) = 1;
+    }
+    if(stream_multiply(op, ones, product, NULL, threads) == 0)
+    {
+        for(i=0;i<N;i++)
+        {
+            sum += MATRIX_AT(product, i, 0);
+        }
+        sum /= (double)N * N;
+    }
+    else
+    {
+        sum = -1;
+    }
+    matrix_free(ones);
+    matrix_free(product);
+    return sum;
+}
@@ -0,0 +1,30 @@
+/* C header file for the streaming (matrix free) W operator */
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "symnmf.h"
+
+#define STREAM_TILE 256 /* side of the tiles of W recomputed by stream_multiply */
+
+/*
+the norm matrix W = D^-1/2*A*D^-1/2 kept implicitly: only the vectors, the degrees and a bounded
+number of cached tiles of A are stored, every other tile of A is recomputed by each product
+*/
+typedef struct stream_operator
+{
+    const matrix* vectors;    /* the points (N*vecdim), owned by the caller */
+    matrix* transposed;       /* the transposed vectors for the gram backend, NULL otherwise */
+    double* sq_norms;         /* the squared norms of the vectors for the gram backend, NULL otherwise */
+    double* inv_sqrt_degrees; /* d_i^-1/2 for every point */
+    matrix** cache;           /* the first cached_tiles tiles of the sweep, NULL when there are none */
+    int cached_tiles;
+    int exp_mode;
+} stream_operator;
+
+void stream_free(stream_operator* op);
+stream_operator* stream_create(const matrix* vectors, const symnmf_config* config, size_t cache_bytes);
+size_t stream_buffer_size(int n, int k, int threads);
+int stream_multiply(const stream_operator* op, const matrix* H, matrix* C, double* buffer, int threads);
+double stream_mean(const stream_operator* op, int threads);
+
+#endif
@@ -2,460 +2,1312 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
-#define MAX_LINE_LENGTH 1024  /* Define max line length for buffer */
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "symnmf.h"
+#include "gemm.h"
+#include "simd.h"
+#include "sparse.h"
+#include "stream.h"
+#include "prng.h"
+#include "csv.h"
+#include "matfile.h"
+#include "stats.h"
+#include "output.h"
+#define MEAN_CHUNK 8192  /* entries summed at a time by matrix_mean, numpy's default buffer size */
+#define SYM_TILE 256  /* side of the tiles computed by the gram sym backend */
+#define STEP_SUMS 3   /* reductions computed by every elementwise solver step */
+#define SOLVER_FLOOR 1e-12 /* smallest entry of an extrapolated point, the multiplicative update cannot leave 0 */
+#define PG_ARMIJO 0.01     /* fraction of the predicted decrease a projected gradient step must achieve */
+#define PG_MAX_TRIALS 40   /* step halvings before projected gradient gives up on finding a descent step */
+#define RESTART_ROUND 20    /* iterations every restart runs between two comparisons of the restarts */
+#define RESTART_PATIENCE 4  /* rounds a restart may need at its last pace to reach the best one before it is abandoned */
+#define F32_DOUBLES(count) (((count) * sizeof(float) + sizeof(double) - 1) / sizeof(double)) /* doubles taking the space of count floats */
 
-static int N_c, vecdim_c;
+/*
+resolves the number of threads the engine should use
+@param config: the engine settings (may be NULL for the defaults)
+@return int: the number of threads, always 1 when built without OpenMP
+*/
+int config_threads(const symnmf_config* config)
+{
+#ifdef _OPENMP
+    if(config != NULL && config->threads > 0) return config->threads;
+    return omp_get_max_threads();
+#else
+    (void)config;
+    return 1;
+#endif
+}
+
+/*
+calculates the euclidean distance between two vectors of doubles
+@param vec1: the first vector
+@param vec2: the second vector
+@param vecdim: the number of dimensions
+@param is_squared: a flag to determine if the squared distance should be returned
+@return double: the euclidean distance
+*/
+double euclidean_distance(const double* vec1, const double* vec2, int vecdim, int is_squared)
+{
+    int i;
+    double sum = 0;
+    double diff;
+    for (i=0;i<vecdim;i++)
+    {
+        diff = vec1[i] - vec2[i];
+        sum += diff * diff;
+    }
+    return (is_squared==0) ? sqrt(sum) : sum;
+}
 
-/* 
-prints a matrix of doubles with dimensions n*m
-@param matrix: the matrix to be printed
-@param n: the number of rows
-@param m: the number of columns
+/*
+finds where a chunk of the upper triangle starts so that all chunks hold the same number of pairs
+row r holds the N-1-r pairs (r,j) with j > r, so the rows before r hold r*(2N-r-1)/2 pairs
+@param N: the number of rows
+@param chunk: the index of the chunk
+@param chunks: the number of chunks
+@return int: the first row of the chunk (N for chunk == chunks)
+*/
+static int triangle_row(int N, int chunk, int chunks)
+{
+    double target = 0.5 * N * (N - 1.0) * chunk / chunks;
+    int low = 0, high = N, mid;
+    if(chunk >= chunks) return N; /* the last row holds no pairs but still needs its diagonal */
+    while(low < high) /* smallest row whose preceding rows hold at least target pairs */
+    {
+        mid = low + (high - low) / 2;
+        if(0.5 * mid * (2.0 * N - mid - 1) < target) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+/*
+adds the elements of a tile of the symilarity matrix that lie above its diagonal to the degrees of their row and of their column
+@param tile: the tile, the rows [bi, bi+tile->rows) against the columns [bj, bj+tile->cols) with bj >= bi
+@param bi: the first row of the tile
+@param bj: the first column of the tile
+@param degrees: the N partial degrees, added to
 @return void
 */
-void print_matrix(double** matrix, int n, int m)
+static void tile_degrees(const matrix* tile, int bi, int bj, double* degrees)
 {
     int i,j;
-    for(i=0;i<n;i++)
+    double sum;
+    for(i=0;i<tile->rows;i++)
     {
-        for(j=0;j<m;j++)
+        const double* row = MATRIX_ROW(tile, i);
+        sum = 0;
+        for(j=(bi == bj) ? i + 1 : 0;j<tile->cols;j++)
         {
-            printf("%.4f ", matrix[i][j]);
-            if(j != m-1)
-            {
-                printf(",");
-            }
+            sum += row[j];
+            degrees[bj + j] += row[j];
         }
-        printf("\n");
+        degrees[bi + i] += sum;
     }
-}   
+}
 
 /*
-frees a matrix of doubles with dimensions n*m
-@param p: the matrix to be freed
-@param n: the number of rows
+sums the partial degree vectors of the chunks in chunk order into the first one,
+so the degrees only depend on the number of chunks
+@param partials: the threads*N partial degrees, the first N are set to the degrees
+@param N: the number of points
+@param threads: the number of chunks
 @return void
 */
-void matrix_free(double** p, int n)
+static void reduce_degrees(double* partials, int N, int threads)
 {
-    int i;
-    for(i=0;i<n;i++)
+    int chunk,i;
+    for(chunk=1;chunk<threads;chunk++)
     {
-        free(p[i]);
+        for(i=0;i<N;i++)
+        {
+            partials[i] += partials[(size_t)chunk * N + i];
+        }
     }
-    free(p); 
 }
 
 /*
-allocates memory for a matrix of doubles with dimensions n*m
-@param new_matrix: the matrix to be allocated
-@param n: the number of rows
-@param m: the number of columns
-@return double**: the allocated matrix
+computes one tile of the symilarity matrix, the rows [bi, bi+tile->rows) against the columns
+[bj, bj+tile->cols), with the diagonal set to zero when bi == bj
+with the transposed vectors the distances use the gram trick: the dot products of the tile
+come from gemm, ||x-y||^2 = ||x||^2 + ||y||^2 - 2x.y is then clamped at zero since
+cancellation can leave tiny negative values for nearby points; without them the per pair
+difference loop is used
+@param vectors: the matrix of vectors (N*vecdim)
+@param transposed: the transposed vectors (vecdim*N), NULL for the per pair loop
+@param sq_norms: the squared norms of the vectors (gram trick only)
+@param bi: the first row of the tile
+@param bj: the first column of the tile
+@param tile: the destination of the tile, its dimensions select the rows and columns
+@param buffer: packing space for gemm of gemm_buffer_size(tile->cols) doubles (gram trick only)
+@param exp_mode: how the kernel exp(-d/2) is evaluated, one of the EXP_ values
+@return void
 */
-double** matrix_malloc(double** new_matrix, int n, int m)
+void sym_tile(const matrix* vectors, const matrix* transposed, const double* sq_norms,
+              int bi, int bj, matrix* tile, double* buffer, int exp_mode)
 {
-    int i;
-    if((new_matrix = malloc(n*sizeof(double*))) == NULL)
+    int i,j;
+    double value;
+    matrix rows, cols;
+
+    if(transposed != NULL)
     {
-        printf("An Error Has Occured");
-        free(new_matrix);
-        return NULL;
+        /* views of the rows of the tile and of its columns */
+        rows.data = MATRIX_ROW(vectors, bi);
+        rows.rows = tile->rows;
+        rows.cols = vectors->cols;
+        rows.stride = vectors->stride;
+        cols.data = transposed->data + bj;
+        cols.rows = transposed->rows;
+        cols.cols = tile->cols;
+        cols.stride = transposed->stride;
+        gemm(&rows, &cols, tile, buffer);
     }
-    for(i=0;i<n;i++)
+    for(i=0;i<tile->rows;i++)
     {
-        if ((new_matrix[i] = malloc(m * sizeof(double))) == NULL)
+        double* row = MATRIX_ROW(tile, i);
+        const double* vec_i = MATRIX_ROW(vectors, bi + i);
+        for(j=0;j<tile->cols;j++)
         {
-            printf("An Error Has Occured");
-            matrix_free(new_matrix, n);
-            return NULL;
+            if(transposed != NULL)
+            {
+                value = sq_norms[bi + i] + sq_norms[bj + j] - 2 * row[j];
+                row[j] = -(value > 0 ? value : 0) / 2;
+            }
+            else
+            {
+                row[j] = -euclidean_distance(vec_i, MATRIX_ROW(vectors, bj + j), vectors->cols, 1) / 2;
+            }
         }
+        simd_exp(row, tile->cols, exp_mode);
+        if(bi == bj) row[i] = 0;
     }
-    return new_matrix;
 }
 
 /*
-multiplies two matrices of doubles
-@param matrix1: the first matrix
-@param matrix2: the second matrix
-@param n: the number of rows of the first matrix
-@param m: the number of columns of the first matrix and the number of rows of the second matrix
-@param p: the number of columns of the second matrix
-@return double**: the result matrix
+finds the first row of a chunk when the rows of H are split evenly between threads
+@param N: the number of rows
+@param chunk: the index of the chunk
+@param chunks: the number of chunks
+@return int: the first row of the chunk (N for chunk == chunks)
 */
-double** matrix_multiplication(double** matrix1, double** matrix2, int n, int m, int p)
+static int chunk_row(int N, int chunk, int chunks)
 {
-    int i,j,k;
-    double sum;
-    double** result_matrix = NULL;
-    
-    if((result_matrix = matrix_malloc(result_matrix, n, p)) == NULL) return NULL; /* Memory allocation failed */
+    return (int)((double)N * chunk / chunks);
+}
 
-    for(i=0;i<n;i++)
+/*
+allocates the scratch rows the similarities are computed in when they are rounded into W, one per thread
+@param N: the number of points
+@param threads: the number of threads
+@return double*: threads*N doubles, NULL if memory allocation failed
+*/
+static double* sym_scratch(int N, int threads)
+{
+    double* scratch;
+    if((scratch = malloc(((size_t)threads * N + 1) * sizeof(double))) == NULL)
     {
-        for(j=0;j<p;j++)
-        {
-            sum = 0;
-            for(k=0;k<m;k++)
-            {
-                sum += matrix1[i][k] * matrix2[k][j];
-            }
-            result_matrix[i][j] = sum;
-        }
+        printf("An Error Has Occured");
+        return NULL;
     }
-    return result_matrix;
+    stats_allocated(((size_t)threads * N + 1) * sizeof(double));
+    return scratch;
 }
 
+/* the storage of W and its kernels with W in doubles */
+#define REAL double
+#define REAL_MATRIX matrix
+#define REAL_PACKED packed_matrix
+#define REAL_NAME(name) name
+#define REAL_IN_PLACE 1
+#include "real_template.h"
+#undef REAL
+#undef REAL_MATRIX
+#undef REAL_PACKED
+#undef REAL_NAME
+#undef REAL_IN_PLACE
+
+/* the same with W in floats, named with an _f32 suffix */
+#define REAL float
+#define REAL_MATRIX matrix_f32
+#define REAL_PACKED packed_matrix_f32
+#define REAL_NAME(name) name##_f32
+#define REAL_IN_PLACE 0
+#include "real_template.h"
+#undef REAL
+#undef REAL_MATRIX
+#undef REAL_PACKED
+#undef REAL_NAME
+#undef REAL_IN_PLACE
+
 /*
-transposes a matrix of doubles
-@param matrix: the matrix to be transposed
-@param n: the number of rows
-@param m: the number of columns
-@return double**: the transposed matrix
+calculates the symilarity matrix of a matrix of doubles, see sym_degrees
+@param vectors: the matrix of vectors (N*vecdim)
+@param config: the engine settings (may be NULL for the defaults)
+@return matrix*: the symilarity matrix (N*N)
 */
-double** matrix_transpose(double** matrix, int n, int m)
+matrix* sym(const matrix* vectors, const symnmf_config* config)
 {
-    int i,j;
-    double** transposed_matrix = NULL;
-    
-    if((transposed_matrix = matrix_malloc(transposed_matrix, m, n)) == NULL) return NULL; /* Memory allocation failed */
+    return sym_degrees(vectors, config, NULL);
+}
 
-    for(i=0;i<n;i++)
+/*
+calculates the symilarity matrix of a matrix of doubles in packed storage, see sym_packed_degrees
+@param vectors: the matrix of vectors (N*vecdim)
+@param config: the engine settings (may be NULL for the defaults)
+@return packed_matrix*: the symilarity matrix (N*N)
+*/
+packed_matrix* sym_packed(const matrix* vectors, const symnmf_config* config)
+{
+    return sym_packed_degrees(vectors, config, NULL);
+}
+
+/*
+calculates the degree of every point without storing the symilarity matrix
+the upper triangle is computed tile by tile with the backend selected in the config (see sym_tiles),
+every pair once, and each tile is added to the degrees of its rows and of its columns, so the memory
+used is O(threads*(N + SYM_TILE^2)) instead of O(N^2)
+@param vectors: the matrix of vectors (N*vecdim)
+@param config: the engine settings (may be NULL for the defaults)
+@return matrix*: the degrees, the diagonal of the ddg matrix (N*1)
+*/
+matrix* ddg_diagonal(const matrix* vectors, const symnmf_config* config)
+{
+    int i;
+    int N = vectors->rows;
+    int threads = config_threads(config);
+    int backend = (config != NULL) ? config->sym_backend : SYM_BACKEND_SCALAR;
+    int exp_mode = (config != NULL) ? config->exp_mode : EXP_LIBM;
+    double* partials;
+    matrix* degrees;
+
+    if((partials = calloc((size_t)threads * N + 1, sizeof(double))) == NULL) /* Memory allocation failed */
     {
-        for(j=0;j<m;j++)
-        {
-            transposed_matrix[j][i] = matrix[i][j];
-        }
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    stats_allocated(((size_t)threads * N + 1) * sizeof(double));
+    if(sym_tiles(vectors, NULL, backend, threads, exp_mode, partials) != 0 ||
+       (degrees = matrix_malloc(N, 1)) == NULL) /* Memory allocation failed */
+    {
+        free(partials);
+        return NULL;
+    }
+    reduce_degrees(partials, N, threads);
+    for(i=0;i<N;i++)
+    {
+        MATRIX_AT(degrees, i, 0) = partials[i];
     }
 
-    return transposed_matrix;
+    free(partials);
+    return degrees;
 }
 
 /*
-substracts two matrices of doubles
-@param matrix1: the first matrix
-@param matrix2: the second matrix
-@param n: the number of rows
-@param m: the number of columns
-@return double**: the result matrix
+calculates the ddg matrix of a matrix of doubles
+the degrees come from ddg_diagonal, the dense matrix is only built for callers that need it
+@param vectors: the matrix of vectors (N*vecdim)
+@param config: the engine settings (may be NULL for the defaults)
+@return matrix*: the ddg matrix (N*N)
 */
-double** matrix_substraction(double** matrix1, double** matrix2, int n, int m)
+matrix* ddg(const matrix* vectors, const symnmf_config* config)
 {
-    int i,j;
-    double** result_matrix = NULL;
-    
-    if((result_matrix = matrix_malloc(result_matrix, n, m)) == NULL) return NULL; /* Memory allocation failed */
+    int i;
+    int N = vectors->rows;
+    matrix* degrees;
+    matrix* ddg_matrix;
 
-    for(i=0;i<n;i++)
+    if((degrees = ddg_diagonal(vectors, config)) == NULL) return NULL; /* Memory allocation failed */
+
+    if ((ddg_matrix = matrix_malloc(N, N)) == NULL) /* Memory allocation failed */
     {
-        for(j=0;j<m;j++)
-        {
-            result_matrix[i][j] = matrix1[i][j] - matrix2[i][j];
-        }
+        matrix_free(degrees);
+        return NULL;
+    }
+
+    /* the ddg matrix holds the degrees on its diagonal */
+    for(i=0;i<N;i++)
+    {
+        memset(MATRIX_ROW(ddg_matrix, i), 0, N * sizeof(double));
+        MATRIX_AT(ddg_matrix, i, i) = MATRIX_AT(degrees, i, 0);
     }
 
-    return result_matrix;
+    matrix_free(degrees);
+    return ddg_matrix;
 }
 
 /*
-performs the update step of the symnmf algorithm by using the recursive formula
-@param new_H: the new H matrix
-@param H: the old H matrix
-@param nom_matrix: the numerator matrix
-@param denom_matrix: the denominator matrix
-@param N: the number of rows
-@param k: the number of columns
+calculates the gram matrix G = H^T*H with every thread summing the outer products of its chunk of rows
+the k*k partial gram matrices are then added in chunk order, so the result only depends on the thread count
+@param H: the H matrix (N*k)
+@param G: the result matrix (k*k)
+@param partials: space for threads*k*k doubles
+@param threads: the number of threads to use
 @return void
 */
-void update_new_H(double** new_H, double** H, double** nom_matrix, double** denom_matrix, int N, int k)
+static void gram_rows(const matrix* H, matrix* G, double* partials, int threads)
 {
-    int i,j;
-    double beta = 0.5;
-    for(i=0;i<N;i++)
+    int t,a,b,begin,end;
+    int k = H->cols;
+    double start = stats_start();
+    matrix h_rows, partial;
+
+    if(threads == 1)
+    {
+        gram(H, G);
+        stats_stop(STATS_GRAM, start);
+        return;
+    }
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) private(begin, end, h_rows, partial)
+#endif
+    for(t=0;t<threads;t++)
+    {
+        begin = chunk_row(H->rows, t, threads);
+        end = chunk_row(H->rows, t + 1, threads);
+        h_rows.data = MATRIX_ROW(H, begin);
+        h_rows.rows = end - begin;
+        h_rows.cols = k;
+        h_rows.stride = H->stride;
+        partial.data = partials + (size_t)t * k * k;
+        partial.rows = k;
+        partial.cols = partial.stride = k;
+        gram(&h_rows, &partial);
+    }
+    for(a=0;a<k;a++)
+    {
+        double* g_row = MATRIX_ROW(G, a);
+        memcpy(g_row, partials + (size_t)a * k, k * sizeof(double));
+        for(t=1;t<threads;t++)
         {
-            for(j=0;j<k;j++)
+            const double* p_row = partials + ((size_t)t * k + a) * k;
+            for(b=0;b<k;b++)
             {
-                new_H[i][j] = H[i][j] * (1 - beta + beta*(nom_matrix[i][j] / denom_matrix[i][j]));
+                g_row[b] += p_row[b];
             }
         }
+    }
+    stats_stop(STATS_GRAM, start);
 }
 
 /*
-swiches the old H matrix with the new H matrix
-@param H: the old H matrix
-@param new_H: the new H matrix
-@param N: the number of rows
-@param k: the number of columns
+multiplies H by its gram matrix, the denominator H*(H^T*H) of the multiplicative update
+@param H: the H matrix (N*k)
+@param G: the gram matrix H^T*H (k*k)
+@param ws: the workspace, the product is written to ws->denom_matrix
 @return void
 */
-void advance_H(double** H, double** new_H, int N, int k)
+static void denominator_rows(const matrix* H, const matrix* G, symnmf_workspace* ws)
+{
+    double start = stats_start();
+    gemm_rows(H, G, ws->denom_matrix, ws->gemm_buffer, ws->threads);
+    stats_stop(STATS_GRAM, start);
+}
+
+/* the elementwise steps of the solvers, see step_range */
+#define STEP_MU 0          /* out = a*(1 - coef + coef*b/c) */
+#define STEP_EXTRAPOLATE 1 /* out = max(a + coef*(a - b), SOLVER_FLOOR) */
+#define STEP_PROJECT 2     /* out = max(a - coef*4*(c - b), 0) */
+#define STEP_DOT 3         /* no out, only the inner product of a and b */
+
+/*
+applies an elementwise solver step to the rows [begin, end) of N*k matrices
+the gradient of ||W - H*H^T||_F^2 at a is 4*(c - b) when b = W*a and c = a*(a^T*a),
+which the steps use to measure the change they make:
+STEP_MU sets sums[0] = ||out - d||^2, sums[1] = <c - b, out - d> and sums[2] = <a, b>, where d is the
+previous iterate (the multiplicative update of symnmf, with d = a and coef = beta),
+STEP_PROJECT sets sums[0] = ||out - a||^2 and sums[1] = <4*(c - b), out - a>,
+STEP_DOT sets sums[0] = <a, b>, STEP_EXTRAPOLATE sets no sums
+@param kind: one of the STEP_ values
+@param coef: the coefficient of the step
+@param out: the result (NULL for STEP_DOT)
+@param a: the first operand
+@param b: the second operand
+@param c: the third operand (NULL when unused)
+@param d: the previous iterate for STEP_MU (NULL otherwise)
+@param begin: the first row
+@param end: the end of the rows
+@param sums: the STEP_SUMS reductions of the rows
+@return void
+*/
+static void step_range(int kind, double coef, matrix* out, const matrix* a, const matrix* b, const matrix* c,
+                       const matrix* d, int begin, int end, double* sums)
 {
     int i,j;
-    for(i=0;i<N;i++)
+    int k = a->cols;
+    double value, diff;
+
+    sums[0] = sums[1] = sums[2] = 0;
+    for(i=begin;i<end;i++)
     {
+        const double* a_row = MATRIX_ROW(a, i);
+        const double* b_row = MATRIX_ROW(b, i);
+        const double* c_row = (c != NULL) ? MATRIX_ROW(c, i) : NULL;
+        const double* d_row = (d != NULL) ? MATRIX_ROW(d, i) : NULL;
+        double* out_row = (out != NULL) ? MATRIX_ROW(out, i) : NULL;
         for(j=0;j<k;j++)
         {
-            H[i][j] = new_H[i][j];
+            switch(kind)
+            {
+            case STEP_MU:
+                value = a_row[j] * (1 - coef + coef*(b_row[j] / c_row[j]));
+                diff = value - d_row[j];
+                sums[0] += diff * diff;
+                sums[1] += (c_row[j] - b_row[j]) * diff;
+                sums[2] += a_row[j] * b_row[j];
+                out_row[j] = value;
+                break;
+            case STEP_EXTRAPOLATE:
+                value = a_row[j] + coef * (a_row[j] - b_row[j]);
+                out_row[j] = (value > SOLVER_FLOOR) ? value : SOLVER_FLOOR;
+                break;
+            case STEP_PROJECT:
+                value = a_row[j] - coef * 4 * (c_row[j] - b_row[j]);
+                value = (value > 0) ? value : 0;
+                diff = value - a_row[j];
+                sums[0] += diff * diff;
+                sums[1] += 4 * (c_row[j] - b_row[j]) * diff;
+                out_row[j] = value;
+                break;
+            default: /* STEP_DOT */
+                sums[0] += a_row[j] * b_row[j];
+                break;
+            }
         }
     }
 }
 
 /*
-calculates the forbius norm of a matrix of doubles
-@param matrix: the matrix
-@param n: the number of rows
-@param m: the number of columns
-@param is_squared: a flag to determine if the squared norm should be returned
-@return double: the forbius norm
+applies an elementwise solver step to whole matrices with every thread handling its own chunk of rows
+the reductions of the chunks are added in chunk order, so the result only depends on the thread count
+@param kind: one of the STEP_ values, see step_range for the operands and the reductions
+@param coef: the coefficient of the step
+@param out: the result (NULL for STEP_DOT)
+@param a: the first operand
+@param b: the second operand
+@param c: the third operand (NULL when unused)
+@param d: the previous iterate for STEP_MU (NULL otherwise)
+@param ws: the workspace, whose partial_sums hold the reductions of the chunks
+@param sums: set to the STEP_SUMS reductions
+@return void
 */
-double forbius_norm(double** matrix, int n, int m, int is_squared)
+static void step_rows(int kind, double coef, matrix* out, const matrix* a, const matrix* b, const matrix* c,
+                      const matrix* d, symnmf_workspace* ws, double* sums)
+{
+    int t;
+    int threads = ws->threads;
+    double* partials = ws->partial_sums;
+
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static)
+#endif
+    for(t=0;t<threads;t++)
+    {
+        step_range(kind, coef, out, a, b, c, d, chunk_row(a->rows, t, threads), chunk_row(a->rows, t + 1, threads),
+                   partials + t * STEP_SUMS);
+    }
+    sums[0] = sums[1] = sums[2] = 0;
+    for(t=0;t<threads;t++)
+    {
+        sums[0] += partials[t * STEP_SUMS];
+        sums[1] += partials[t * STEP_SUMS + 1];
+        sums[2] += partials[t * STEP_SUMS + 2];
+    }
+}
+
+/*
+rounds H to floats for the products with a W stored in floats
+@param H: the H matrix (N*k)
+@param buffer: the space of the rounded matrix, F32_DOUBLES(N*k) doubles
+@param threads: the number of threads to use
+@return matrix_f32: the rounded H (N*k), stored in buffer
+*/
+static matrix_f32 round_operand(const matrix* H, double* buffer, int threads)
 {
     int i,j;
-    double sum = 0;
-    for(i=0;i<n;i++)
+    matrix_f32 rounded;
+    (void)threads;
+
+    rounded.data = (float*)buffer;
+    rounded.rows = H->rows;
+    rounded.cols = rounded.stride = H->cols;
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(threads) schedule(static) private(j)
+#endif
+    for(i=0;i<H->rows;i++)
     {
-        for(j=0;j<m;j++)
+        const double* row = MATRIX_ROW(H, i);
+        float* rounded_row = MATRIX_ROW(&rounded, i);
+        for(j=0;j<H->cols;j++)
         {
-            sum += pow(matrix[i][j], 2);
+            rounded_row[j] = (float)row[j];
         }
     }
-    return (is_squared == 0) ? sqrt(sum) : sum;
+    return rounded;
 }
 
 /*
-checks the convergence of two matrices of doubles by calculating the forbius norm of their difference
-@param matrix1: the first matrix
-@param matrix2: the second matrix
-@param n: the number of rows
-@param m: the number of columns
-@return double: the forbius norm of the difference
+multiplies the matrix W of symnmf by H with the kernel matching its storage
+@param W: the matrix W (N*N)
+@param H: the H matrix (N*k)
+@param result: the product W*H (N*k)
+@param buffer: the scratch space of the kernel, w_buffer_size(W, N, k, threads) doubles
+(threads*gemm_buffer_size(k) doubles for W_DENSE)
+@param threads: the number of threads to use
+@return void
 */
-double matrix_convergence(double** matrix1, double** matrix2, int n, int m)
+void w_operator_multiply(const w_operator* W, const matrix* H, matrix* result, double* buffer, int threads)
 {
-    double** result_matrix = matrix_substraction(matrix1, matrix2, n, m);
-    double norm = forbius_norm(result_matrix, n, m, 1);
-    matrix_free(result_matrix, n);
-    
-    return norm;
+    double start = stats_start();
+    size_t rounded_size = F32_DOUBLES((size_t)H->rows * H->cols);
+    matrix_f32 rounded;
+
+    switch(W->kind)
+    {
+        case W_PACKED:
+            symm_packed(W->packed, H, result, buffer, threads);
+            break;
+        case W_SPARSE:
+            csr_multiply(W->sparse, H, result, threads);
+            break;
+        case W_STREAM:
+            stream_multiply(W->stream, H, result, buffer, threads);
+            break;
+        case W_DENSE_F32:
+            rounded = round_operand(H, buffer, threads);
+            gemm_rows_f32(W->dense_f32, &rounded, result, (float*)(buffer + rounded_size), threads);
+            break;
+        case W_PACKED_F32:
+            rounded = round_operand(H, buffer, threads);
+            symm_packed_f32(W->packed_f32, &rounded, result, buffer + rounded_size, threads);
+            break;
+        default:
+            gemm_rows(W->dense, H, result, buffer, threads);
+            break;
+    }
+    stats_stop(STATS_PRODUCT, start);
 }
 
 /*
-calculates the euclidean distance between two vectors of doubles
-@param vec1: the first vector
-@param vec2: the second vector
-@param vecdim: the number of dimensions
-@param is_squared: a flag to determine if the squared distance should be returned
-@return double: the euclidean distance
+frees a symnmf workspace and all the buffers it owns
+@param ws: the workspace to be freed (may be NULL)
+@return void
 */
-double euclidean_distance(double* vec1, double* vec2, int vecdim, int is_squared)
+void symnmf_workspace_free(symnmf_workspace* ws)
 {
-    int i;
-    double sum = 0;
-    for (i=0;i<vecdim;i++)
+    if(ws == NULL) return;
+    matrix_free(ws->nom_matrix);
+    matrix_free(ws->gram_matrix);
+    matrix_free(ws->denom_matrix);
+    matrix_free(ws->new_H);
+    free(ws->gemm_buffer);
+    free(ws->w_buffer);
+    free(ws->partial_grams);
+    free(ws->partial_sums);
+    matrix_free(ws->spare[0]);
+    matrix_free(ws->spare[1]);
+    free(ws);
+}
+
+/*
+calculates the number of doubles of scratch space the product of W by H needs beyond the gemm buffers of the workspace
+@param W: the matrix W
+@param N: the number of rows of H
+@param k: the number of columns of H
+@param threads: the number of threads the product uses
+@return size_t: symm_buffer_size for W_PACKED, stream_buffer_size for W_STREAM, the rounded H and the
+space of its kernel for W_DENSE_F32 and W_PACKED_F32, 0 for W_DENSE and W_SPARSE
+*/
+static size_t w_buffer_size(const w_operator* W, int N, int k, int threads)
+{
+    switch(W->kind)
     {
-        sum += pow(vec1[i] - vec2[i], 2);
+        case W_PACKED:
+            return symm_buffer_size(N, k, threads);
+        case W_STREAM:
+            return stream_buffer_size(N, k, threads);
+        case W_DENSE_F32:
+            return F32_DOUBLES((size_t)N * k) + F32_DOUBLES(threads * gemm_buffer_size(k));
+        case W_PACKED_F32:
+            return F32_DOUBLES((size_t)N * k) + symm_buffer_size_f32(N, k, threads);
+        default:
+            return 0;
     }
-    return (is_squared==0) ? sqrt(sum) : sum;
 }
 
 /*
-calculates the symilarity matrix of a matrix of doubles
-@param vectors: the matrix of vectors
-@param N: the number of rows
-@param vecdim: the number of dimensions
-@return double**: the symilarity matrix
+allocates every buffer an iteration of symnmf needs, once per factorization
+@param W: the matrix W the workspace is used with
+@param N: the number of rows of H
+@param k: the number of columns of H
+@param threads: the number of threads the iterations use (0 for the OpenMP default)
+@return symnmf_workspace*: the allocated workspace
 */
-double** sym(double** vectors, int N, int vecdim)
+symnmf_workspace* symnmf_workspace_malloc(const w_operator* W, int N, int k, int threads)
 {
-    int i,j;
-    double value;
-    double** sym_matrix = NULL;
-
-    /* malloc a matrix of doubles sized N*N */
-    if((sym_matrix = matrix_malloc(sym_matrix, N, N)) == NULL) return NULL; /* Memory allocation failed */
+    size_t w_size;
+    symnmf_workspace* ws;
 
-    /* calculate the symilarity matrix */
-    for(i=0;i<N;i++)
+    if((ws = calloc(1, sizeof(symnmf_workspace))) == NULL)
     {
-        for(j=i;j<N;j++)
-        {
-            if (i==j)
-            {
-                sym_matrix[i][j] = 0;
-            }
-            else
-            {
-                value = euclidean_distance(vectors[i], vectors[j], vecdim, 1);
-                value = exp(-value/2);
-
-                sym_matrix[i][j] = value;
-                sym_matrix[j][i] = value;
-            }
-        }
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    stats_allocated(sizeof(symnmf_workspace));
+    ws->threads = (threads > 0) ? threads : config_threads(NULL);
+    ws->beta = SYMNMF_DEFAULT_BETA;
+    threads = ws->threads;
+    w_size = w_buffer_size(W, N, k, threads);
+    if((ws->nom_matrix = matrix_malloc(N, k)) == NULL ||
+       (ws->gram_matrix = matrix_malloc(k, k)) == NULL ||
+       (ws->denom_matrix = matrix_malloc(N, k)) == NULL ||
+       (ws->new_H = matrix_malloc(N, k)) == NULL) /* Memory allocation failed */
+    {
+        symnmf_workspace_free(ws);
+        return NULL;
     }
+    if((ws->gemm_buffer = malloc(threads * gemm_buffer_size(k) * sizeof(double))) == NULL ||
+       (ws->partial_grams = malloc((size_t)threads * k * k * sizeof(double))) == NULL ||
+       (ws->partial_sums = malloc(threads * STEP_SUMS * sizeof(double))) == NULL ||
+       (w_size > 0 && (ws->w_buffer = malloc(w_size * sizeof(double))) == NULL)) /* Memory allocation failed */
+    {
+        printf("An Error Has Occured");
+        symnmf_workspace_free(ws);
+        return NULL;
+    }
+    stats_allocated((threads * gemm_buffer_size(k) + (size_t)threads * k * k + threads * STEP_SUMS + w_size) * sizeof(double));
+    return ws;
+}
 
-    return sym_matrix;
+/*
+performs a single symnmf iteration, computing the next iterate into new_H
+with the multiplicative update new_H = H*(1 - beta + beta*(W*H)/(H*H^T*H)), beta = ws->beta
+ws->objective is set to ||H^T*H||_F^2 - 2*tr(H^T*W*H), the objective at H up to ||W||_F^2, from the
+products the update computes anyway; only the buffers of the workspace are used, so an iteration never allocates
+every step is split between ws->threads threads and reduced in a fixed order,
+so for a given thread count the iterates are reproducible bit for bit
+@param W: the norm matrix (N*N)
+@param H: the current H matrix (N*k)
+@param new_H: the next H matrix (N*k), must not alias H
+@param ws: a workspace allocated for the dimensions of H
+@return double: the squared forbius norm of new_H - H
+*/
+double symnmf_iterate(const w_operator* W, const matrix* H, matrix* new_H, symnmf_workspace* ws)
+{
+    double sums[STEP_SUMS];
+
+    /* calculate the numerator and denominator matrices */
+    w_operator_multiply(W, H, ws->nom_matrix, (W->kind == W_DENSE) ? ws->gemm_buffer : ws->w_buffer, ws->threads);
+    gram_rows(H, ws->gram_matrix, ws->partial_grams, ws->threads);
+    denominator_rows(H, ws->gram_matrix, ws);
+
+    /* update the new_H matrix and measure how far it moved */
+    step_rows(STEP_MU, ws->beta, new_H, H, ws->nom_matrix, ws->denom_matrix, H, ws, sums);
+    ws->objective = squared_norm(ws->gram_matrix) - 2 * sums[2];
+    return sums[0];
 }
 
 /*
-calculates the ddg matrix of a matrix of doubles
-@param vectors: the matrix of vectors
-@param N: the number of rows
-@param vecdim: the number of dimensions
-@return double**: the ddg matrix
+fills options with the defaults: the multiplicative update with beta = 0.5,
+at most 300 iterations and a convergence threshold of 0.0001
+@param options: the options to fill
+@return void
 */
-double** ddg(double** vectors, int N, int vecdim)
+void symnmf_default_options(symnmf_options* options)
 {
-    int i,j;
-    double sum;
-    double** sym_matrix = NULL;
-    double** ddg_matrix = NULL;
+    options->solver = SOLVER_MU;
+    options->max_iter = SYMNMF_DEFAULT_MAX_ITER;
+    options->eps = SYMNMF_DEFAULT_EPS;
+    options->beta = SYMNMF_DEFAULT_BETA;
+}
+
+/*
+computes the products the solvers need at H, W*H and H^T*H, and the objective at H
+@param W: the norm matrix (N*N)
+@param H: the H matrix (N*k)
+@param nom: set to W*H (N*k)
+@param gram: set to H^T*H (k*k)
+@param ws: the workspace
+@return double: ||W - H*H^T||_F^2 - ||W||_F^2 = ||H^T*H||_F^2 - 2*<H, W*H>
+*/
+static double objective_at(const w_operator* W, const matrix* H, matrix* nom, matrix* gram, symnmf_workspace* ws)
+{
+    double sums[STEP_SUMS];
 
-    /* calculate sym and malloc a matrix of doubles sized N*n */
-    if((sym_matrix = sym(vectors, N, vecdim)) == NULL) return NULL;  /* Memory allocation failed */
+    w_operator_multiply(W, H, nom, (W->kind == W_DENSE) ? ws->gemm_buffer : ws->w_buffer, ws->threads);
+    gram_rows(H, gram, ws->partial_grams, ws->threads);
+    step_rows(STEP_DOT, 0, NULL, H, nom, NULL, NULL, ws, sums);
+    return squared_norm(gram) - 2 * sums[0];
+}
+
+/*
+runs the damped multiplicative update, see symnmf_iterate
+the old and new iterates are double buffered between H and ws->new_H and swapped by pointer
+@param W: the norm matrix (N*N)
+@param H: the initial H matrix (N*k), overwritten
+@param ws: the workspace
+@param options: the iteration settings
+@param iterations: set to the number of iterations performed
+@return matrix*: the final iterate, H or ws->new_H
+*/
+static matrix* solve_mu(const w_operator* W, matrix* H, symnmf_workspace* ws, const symnmf_options* options, int* iterations)
+{
+    double delta;
+    matrix* current = H;
+    matrix* next = ws->new_H;
+    matrix* swap;
 
-    if ((ddg_matrix = matrix_malloc(ddg_matrix, N, N)) == NULL) /* Memory allocation failed */
+    for(*iterations=0;*iterations<options->max_iter;)
     {
-        matrix_free(sym_matrix, N);
-        return NULL;
+        delta = ws->delta = symnmf_iterate(W, current, next, ws);
+        swap = current;
+        current = next;
+        next = swap;
+        (*iterations)++;
+        if(delta < options->eps)
+        {
+            break;
+        }
     }
-    
+    return current;
+}
 
-    /* initialize the ddg matrix */
-    for(i=0;i<N;i++)
+/*
+runs the multiplicative update from Nesterov extrapolated points
+Y = H_k + (t_k - 1)/t_{k+1}*(H_k - H_{k-1}), floored at SOLVER_FLOOR to stay positive, and
+H_{k+1} = Y*(1 - beta + beta*(W*Y)/(Y*Y^T*Y)); the momentum restarts (t = 1) whenever the step
+goes against the gradient at Y, <grad(Y), H_{k+1} - H_k> > 0, so every iteration costs one product W*Y
+@param W: the norm matrix (N*N)
+@param H: the initial H matrix (N*k), overwritten
+@param ws: the workspace, with two N*k spare buffers
+@param options: the iteration settings
+@param iterations: set to the number of iterations performed
+@return matrix*: the final iterate, one of H, ws->new_H and ws->spare[0]
+*/
+static matrix* solve_nesterov(const w_operator* W, matrix* H, symnmf_workspace* ws, const symnmf_options* options,
+                              int* iterations)
+{
+    int i;
+    double t = 1, t_next;
+    double sums[STEP_SUMS];
+    matrix* current = H;
+    matrix* previous = ws->spare[0];
+    matrix* next = ws->new_H;
+    matrix* point;
+    matrix* swap;
+
+    for(i=0;i<H->rows;i++)
+    {
+        memcpy(MATRIX_ROW(previous, i), MATRIX_ROW(H, i), H->cols * sizeof(double));
+    }
+    for(*iterations=0;*iterations<options->max_iter;)
     {
-        for(j=0;j<N;j++)
+        t_next = (1 + sqrt(1 + 4 * t * t)) / 2;
+        point = current;
+        if(t > 1)
         {
-            ddg_matrix[i][j] = 0;
+            step_rows(STEP_EXTRAPOLATE, (t - 1) / t_next, ws->spare[1], current, previous, NULL, NULL, ws, sums);
+            point = ws->spare[1];
+        }
+        w_operator_multiply(W, point, ws->nom_matrix, (W->kind == W_DENSE) ? ws->gemm_buffer : ws->w_buffer, ws->threads);
+        gram_rows(point, ws->gram_matrix, ws->partial_grams, ws->threads);
+        denominator_rows(point, ws->gram_matrix, ws);
+        step_rows(STEP_MU, ws->beta, next, point, ws->nom_matrix, ws->denom_matrix, current, ws, sums);
+        t = (sums[1] > 0) ? 1 : t_next;
+        ws->delta = sums[0];
+        ws->objective = squared_norm(ws->gram_matrix) - 2 * sums[2];
+        swap = previous;
+        previous = current;
+        current = next;
+        next = swap;
+        (*iterations)++;
+        if(sums[0] < options->eps)
+        {
+            break;
         }
     }
-    /* calculate the ddg matrix */
-    for(i=0;i<N;i++)
+    return current;
+}
+
+/*
+runs projected gradient descent H_{k+1} = max(H_k - alpha*grad(H_k), 0) with grad = 4*(H*H^T*H - W*H)
+alpha is halved until the objective drops by at least PG_ARMIJO times the decrease predicted by the
+gradient (each trial costs one product W*H, which the next iteration reuses) and doubled after a step
+accepted on the first trial; it starts at 1/(12*||H^T*H||_F), the inverse of the curvature of the
+quartic term. Unlike the multiplicative updates, entries that reach 0 can grow back
+when no step passes the test within PG_MAX_TRIALS halvings, rounding has swamped the decrease: the
+iterations stop at the current iterate, with ws->stalled set and ws->delta the squared length of the
+first (longest) trial step, so that a run that has not converged is not reported as converged
+@param W: the norm matrix (N*N)
+@param H: the initial H matrix (N*k), overwritten
+@param ws: the workspace, with an N*k and a k*k spare buffer
+@param options: the iteration settings
+@param iterations: set to the number of iterations performed
+@return matrix*: the final iterate, H or ws->new_H
+*/
+static matrix* solve_pg(const w_operator* W, matrix* H, symnmf_workspace* ws, const symnmf_options* options,
+                        int* iterations)
+{
+    int trial;
+    double alpha, objective, trial_objective = 0, longest = 0;
+    double sums[STEP_SUMS];
+    matrix* current = H;
+    matrix* next = ws->new_H;
+    matrix* nom = ws->nom_matrix;
+    matrix* trial_nom = ws->spare[0];
+    matrix* gram = ws->gram_matrix;
+    matrix* trial_gram = ws->spare[1];
+    matrix* swap;
+
+    objective = ws->objective = objective_at(W, current, nom, gram, ws);
+    alpha = squared_norm(gram);
+    alpha = (alpha > 0) ? 1 / (12 * sqrt(alpha)) : 1;
+    for(*iterations=0;*iterations<options->max_iter;)
     {
-        sum = 0;
-        for(j=0;j<N;j++)
+        denominator_rows(current, gram, ws);
+        for(trial=0;trial<=PG_MAX_TRIALS;trial++)
+        {
+            step_rows(STEP_PROJECT, alpha, next, current, nom, ws->denom_matrix, NULL, ws, sums);
+            if(trial == 0) longest = sums[0];
+            if(sums[0] == 0) break; /* stationary */
+            trial_objective = objective_at(W, next, trial_nom, trial_gram, ws);
+            if(trial_objective <= objective + PG_ARMIJO * sums[1]) break;
+            alpha /= 2;
+        }
+        ws->delta = sums[0];
+        if(sums[0] == 0) break;
+        if(trial > PG_MAX_TRIALS) /* no descent step, keep the current iterate */
         {
-            sum += sym_matrix[i][j];
+            ws->delta = longest;
+            ws->stalled = 1;
+            break;
+        }
+        swap = current;
+        current = next;
+        next = swap;
+        swap = nom;
+        nom = trial_nom;
+        trial_nom = swap;
+        swap = gram;
+        gram = trial_gram;
+        trial_gram = swap;
+        objective = ws->objective = trial_objective;
+        if(trial == 0) alpha *= 2;
+        (*iterations)++;
+        if(sums[0] < options->eps)
+        {
+            break;
         }
-        ddg_matrix[i][i] = sum;
     }
+    return current;
+}
 
-    matrix_free(sym_matrix, N);
-    return ddg_matrix;
+/*
+allocates the spare buffers a solver needs in a workspace, if it has not got them yet
+@param ws: the workspace
+@param solver: one of the SOLVER_ values
+@param N: the number of rows of H
+@param k: the number of columns of H
+@return int: 0 on success, 1 if memory allocation failed
+*/
+static int spare_malloc(symnmf_workspace* ws, int solver, int N, int k)
+{
+    if(solver == SOLVER_MU || ws->spare[0] != NULL) return 0;
+    if((ws->spare[0] = matrix_malloc(N, k)) == NULL ||
+       (ws->spare[1] = (solver == SOLVER_PG) ? matrix_malloc(k, k) : matrix_malloc(N, k)) == NULL) return 1; /* Memory allocation failed */
+    return 0;
 }
 
 /*
-calculates the norm matrix of a matrix of doubles
-@param vectors: the matrix of vectors
-@param N: the number of rows
-@param vecdim: the number of dimensions
-@return double**: the norm matrix
+runs the solver the options select from H, in a workspace holding its spare buffers
+@param W: the norm matrix (N*N)
+@param H: the initial H matrix (N*k), overwritten with the final iterate
+@param ws: the workspace, ws->delta is set to the change made by the last iteration
+@param options: the solver and its settings
+@return int: the number of iterations performed
 */
-double** norm(double** vectors, int N, int vecdim)
+static int run_solver(const w_operator* W, matrix* H, symnmf_workspace* ws, const symnmf_options* options)
 {
-    int i,j;
-    double** sym_matrix = NULL;
-    double** ddg_matrix = NULL;
-    double** norm_matrix = NULL;
+    int i, count = 0;
+    matrix* current;
+
+    ws->beta = options->beta;
+    ws->stalled = 0;
+    if(options->solver == SOLVER_NESTEROV) current = solve_nesterov(W, H, ws, options, &count);
+    else if(options->solver == SOLVER_PG) current = solve_pg(W, H, ws, options, &count);
+    else current = solve_mu(W, H, ws, options, &count);
+    if(current != H)
+    {
+        for(i=0;i<H->rows;i++)
+        {
+            memcpy(MATRIX_ROW(H, i), MATRIX_ROW(current, i), H->cols * sizeof(double));
+        }
+    }
+    return count;
+}
 
-    /* malloc a matrix of doubles sized N on vecdim */
-    if((sym_matrix = sym(vectors, N, vecdim)) == NULL) return NULL; /* Memory allocation failed */
+/*
+calculates the symnmf matrix of W, minimizing ||W - H*H^T||_F^2 from the initial H with the solver
+the options select, until the squared forbius norm of the change of H drops below options->eps
+or options->max_iter iterations are reached
+the denominator (H*H^T)*H is evaluated as H*(H^T*H), which needs a k*k gram matrix
+instead of an N*N one and costs O(N*k^2) instead of O(N^2*k) per iteration
+all the buffers are allocated before the first iteration
+@param W: the norm matrix (N*N), in any of the W_ storages
+@param H: the H matrix (N*k), overwritten with the intermediate iterations
+@param threads: the number of threads to use (0 for the OpenMP default)
+@param options: the solver and its settings (may be NULL for the defaults, see symnmf_default_options)
+@param iterations: set to the number of iterations performed (may be NULL)
+@return matrix*: the symnmf matrix (N*k)
+*/
+matrix* symnmf_solve(const w_operator* W, matrix* H, int threads, const symnmf_options* options, int* iterations)
+{
+    int i, count;
+    double start;
+    symnmf_options defaults;
+    matrix* result;
+    symnmf_workspace* ws;
 
-    if((ddg_matrix = ddg(vectors, N, vecdim)) == NULL) /* Memory allocation failed */
+    if(options == NULL)
     {
-        matrix_free(sym_matrix, N);
+        symnmf_default_options(&defaults);
+        options = &defaults;
+    }
+    if((ws = symnmf_workspace_malloc(W, H->rows, H->cols, threads)) == NULL) return NULL; /* Memory allocation failed */
+    if(spare_malloc(ws, options->solver, H->rows, H->cols) != 0) /* Memory allocation failed */
+    {
+        symnmf_workspace_free(ws);
         return NULL;
     }
+    start = stats_start();
+    count = run_solver(W, H, ws, options);
+    stats_stop(STATS_SOLVE, start);
+    stats_solved(count, ws->delta);
 
-    if ((norm_matrix = matrix_malloc(norm_matrix, N, N)) == NULL) /* Memory allocation failed */
+    /* the workspace buffer is handed over to the caller */
+    result = ws->new_H;
+    for(i=0;i<H->rows;i++)
     {
-        matrix_free(sym_matrix, N);
-        matrix_free(ddg_matrix, N);
-        return NULL;
+        memcpy(MATRIX_ROW(result, i), MATRIX_ROW(H, i), H->cols * sizeof(double));
     }
+    ws->new_H = NULL;
+    symnmf_workspace_free(ws);
+    if(iterations != NULL) *iterations = count;
+    return result;
+}
+
+/*
+calculates the symnmf matrix of W with the default options, see symnmf_solve
+@param W: the norm matrix (N*N), in any of the W_ storages
+@param H: the H matrix (N*k), overwritten with the intermediate iterations
+@param threads: the number of threads to use (0 for the OpenMP default)
+@return matrix*: the symnmf matrix (N*k)
+*/
+matrix* symnmf_operator(const w_operator* W, matrix* H, int threads)
+{
+    return symnmf_solve(W, H, threads, NULL, NULL);
+}
 
-    /* calculate the norm matrix */
+/*
+calculates the symnmf matrix of a dense norm matrix, see symnmf_operator
+@param W: the norm matrix (N*N)
+@param H: the H matrix (N*k), overwritten with the intermediate iterations
+@param threads: the number of threads to use (0 for the OpenMP default)
+@return matrix*: the symnmf matrix (N*k)
+*/
+matrix* symnmf(const matrix* W, matrix* H, int threads)
+{
+    w_operator op;
+    op.kind = W_DENSE;
+    op.dense = W;
+    op.packed = NULL;
+    op.sparse = NULL;
+    op.stream = NULL;
+    op.dense_f32 = NULL;
+    op.packed_f32 = NULL;
+    return symnmf_operator(&op, H, threads);
+}
+
+/*
+initializes H with values drawn uniformly from [0, 2*sqrt(m/k)], where m is the average entry of W
+the values come from an MT19937 generator seeded like numpy.random.seed and are drawn row by row,
+so H is the one numpy.random.uniform(0, 2*sqrt(m/k), (N, k)) draws after numpy.random.seed(seed)
+@param mean: the average entry m of W
+@param N: the number of rows of H
+@param k: the number of columns of H
+@param seed: the seed of the generator
+@return matrix*: the initial H matrix (N*k)
+*/
+matrix* symnmf_init_H(double mean, int N, int k, unsigned long seed)
+{
+    int i,j;
+    double upper_bound = 2 * sqrt(mean / k);
+    mt19937 mt;
+    matrix* H;
+
+    if((H = matrix_malloc(N, k)) == NULL) return NULL; /* Memory allocation failed */
+    mt_seed(&mt, seed);
     for(i=0;i<N;i++)
     {
-        for(j=0;j<N;j++)
+        for(j=0;j<k;j++)
         {
-            norm_matrix[i][j] = sym_matrix[i][j] / sqrt(ddg_matrix[i][i] * ddg_matrix[j][j]);
+            MATRIX_AT(H, i, j) = upper_bound * mt_uniform(&mt);
         }
     }
+    return H;
+}
+
+/* the states of a restart of symnmf_restarts */
+#define RESTART_RUNNING 0
+#define RESTART_DONE 1      /* converged or reached options->max_iter */
+#define RESTART_ABANDONED 2 /* fell behind the best restart */
+
+/* one of the factorizations symnmf_restarts runs side by side */
+typedef struct restart
+{
+    matrix* H;             /* the current iterate, factorized in place */
+    symnmf_workspace* ws;  /* the buffers of its iterations */
+    int state;             /* one of the RESTART_ values */
+    int iterations;        /* iterations performed so far */
+    int rounds;            /* rounds run so far, progress is known from the second one on */
+    double objective;      /* ||W - H*H^T||_F^2 at the current iterate, the end of the last round */
+    double progress;       /* the decrease of the objective in the last round, negative when it went up */
+} restart;
 
-    matrix_free(sym_matrix, N);
-    matrix_free(ddg_matrix, N);
-    return norm_matrix;
+/*
+frees the restarts of symnmf_restarts
+@param runs: the restarts (may be NULL)
+@param count: the number of restarts
+@return void
+*/
+static void restarts_free(restart* runs, int count)
+{
+    int r;
+    if(runs == NULL) return;
+    for(r=0;r<count;r++)
+    {
+        matrix_free(runs[r].H);
+        symnmf_workspace_free(runs[r].ws);
+    }
+    free(runs);
 }
 
 /*
-calculates the symnmf matrix of a matrix of doubles using norm and H matrices
-check the convergence of the H matrix and updates it until convergence is reached for epsilon = 0.0001
-or until 300 iterations are reached
-@param W: the norm matrix
-@param H: the H matrix
-@param N: the number of rows
-@param k: the number of columns
-@return double**: the symnmf matrix
+factorizes W from several initial H and returns the best factorization, sharing W between them
+restart r starts from symnmf_init_H(mean, N, k, seed + r), so restart 0 is the start symnmf_from_vectors uses
+the restarts run side by side on up to threads threads, RESTART_ROUND iterations at a time; after every round
+the objective ||W - H*H^T||_F^2 = ||W||_F^2 - 2*tr(H^T*W*H) + ||H^T*H||_F^2 of every restart is evaluated at its
+current iterate with one product W*H (objective_at), so no N*N matrix is needed and every solver is compared at
+the same points. A restart behind the best one is abandoned once its gap exceeds RESTART_PATIENCE times its
+decrease in the last round, as it falls further behind while its iterations slow down, and at once when its
+objective did not decrease. With at least as many restarts as threads each restart iterates on one thread and
+the restarts share the threads, otherwise every restart iterates on all the threads one after the other, so the
+result only depends on the thread count when there are fewer restarts than threads
+@param op: the norm matrix (N*N), dense or packed
+@param N: the number of rows of W
+@param mean: the average entry of W
+@param w_norm: the squared forbius norm of W
+@param k: the number of columns of H
+@param seed: the seed of the first restart
+@param restarts: the number of initial H to factorize
+@param threads: the number of threads to use (0 for the OpenMP default)
+@param options: the solver and its settings (may be NULL for the defaults, see symnmf_default_options)
+@param objective: set to ||W - H*H^T||_F^2 of the returned H (may be NULL)
+@param abandoned: set to the number of restarts abandoned (may be NULL)
+@return matrix*: the symnmf matrix (N*k) with the lowest objective
 */
-double** symnmf(double** W, double** H, int N, int k)
+static matrix* restarts_operator(const w_operator* op, int N, double mean, double w_norm, int k, unsigned long seed,
+                                 int restarts, int threads, const symnmf_options* options, double* objective, int* abandoned)
 {
-    int i;
-    double** new_H = NULL;
-    int iter = 300;
-    double eps = 0.0001;
-    new_H = matrix_malloc(new_H, N, k);
-    if(new_H == NULL) return NULL; /* Memory allocation failed */
+    int r, best, running, run_threads, dropped = 0, failed = 0;
+    double start;
+    symnmf_options defaults;
+    matrix* result;
+    restart* runs;
 
-    for(i=0;i<iter;i++)
+    if(options == NULL)
     {
-        /* calculate the numerator and denominator matrices */
-        double** nom_matrix;
-        double** transposed_matrix;
-        double** denom_matrix;
-        double** helper_matrix;
-
-        if((nom_matrix = matrix_multiplication(W, H, N, N, k)) == NULL) return NULL;/* Memory allocation failed */
+        symnmf_default_options(&defaults);
+        options = &defaults;
+    }
+    restarts = (restarts > 1) ? restarts : 1;
+    threads = (threads > 0) ? threads : config_threads(NULL);
+    run_threads = (restarts < threads) ? threads : 1; /* the threads of each restart, nested regions would run on one */
+    if((runs = calloc(restarts, sizeof(restart))) == NULL)
+    {
+        printf("An Error Has Occured");
+        return NULL;
+    }
+    stats_allocated(restarts * sizeof(restart));
+    for(r=0;r<restarts && !failed;r++)
+    {
+        failed = (runs[r].H = symnmf_init_H(mean, N, k, seed + r)) == NULL ||
+                 (runs[r].ws = symnmf_workspace_malloc(op, N, k, run_threads)) == NULL ||
+                 spare_malloc(runs[r].ws, options->solver, N, k) != 0;
+    }
+    if(failed) /* Memory allocation failed */
+    {
+        restarts_free(runs, restarts);
+        return NULL;
+    }
 
-        if((transposed_matrix = matrix_transpose(H, N, k)) == NULL) /* Memory allocation failed */
+    best = 0;
+    start = stats_start();
+    for(running=restarts;running>0;)
+    {
+#ifdef _OPENMP
+#pragma omp parallel for num_threads((threads < running) ? threads : running) schedule(dynamic, 1) if(run_threads == 1)
+#endif
+        for(r=0;r<restarts;r++)
         {
-            matrix_free(nom_matrix, N);
-            return NULL;
+            int count;
+            double previous;
+            restart* run = &runs[r];
+            symnmf_workspace* ws = run->ws;
+            symnmf_options round = *options;
+
+            if(run->state != RESTART_RUNNING) continue;
+            round.max_iter = (options->max_iter - run->iterations < RESTART_ROUND) ? options->max_iter - run->iterations : RESTART_ROUND;
+            count = run_solver(op, run->H, ws, &round);
+            run->iterations += count;
+            previous = run->objective;
+            run->objective = w_norm + objective_at(op, run->H, ws->nom_matrix, ws->gram_matrix, ws);
+            run->progress = previous - run->objective; /* meaningless after the first round */
+            run->rounds++;
+            if(run->iterations >= options->max_iter || count < round.max_iter || ws->delta < options->eps)
+            {
+                run->state = RESTART_DONE;
+            }
         }
 
-        helper_matrix = matrix_multiplication(H, transposed_matrix, N, k, N);
-        matrix_free(transposed_matrix, k);
-        if(helper_matrix == NULL) /* Memory allocation failed */
+        /* keep the best restart, the first one on ties, and abandon the ones that cannot catch up with it */
+        for(r=0;r<restarts;r++)
         {
-            matrix_free(nom_matrix, N);
-            return NULL;
+            if(runs[r].state != RESTART_ABANDONED && (runs[best].state == RESTART_ABANDONED || runs[r].objective < runs[best].objective)) best = r;
         }
-
-        denom_matrix = matrix_multiplication(helper_matrix, H, N, N, k);
-        matrix_free(helper_matrix, N);
-        if(denom_matrix == NULL) /* Memory allocation failed */
+        for(r=0,running=0;r<restarts;r++)
         {
-            matrix_free(nom_matrix, N);
-            return NULL;
+            double gap = runs[r].objective - runs[best].objective;
+            if(runs[r].state == RESTART_RUNNING && runs[r].rounds > 1 && gap > 0 &&
+               (runs[r].progress <= 0 || gap > RESTART_PATIENCE * runs[r].progress))
+            {
+                runs[r].state = RESTART_ABANDONED;
+                dropped++;
+                symnmf_workspace_free(runs[r].ws);
+                runs[r].ws = NULL;
+            }
+            running += (runs[r].state == RESTART_RUNNING);
         }
+    }
 
-        /* update the new_H matrix */
-        update_new_H(new_H, H, nom_matrix, denom_matrix, N, k);
+    stats_stop(STATS_SOLVE, start);
+    stats_solved(runs[best].iterations, runs[best].ws->delta);
+    if(objective != NULL) *objective = runs[best].objective;
+    result = runs[best].H;
+    runs[best].H = NULL;
+    if(abandoned != NULL) *abandoned = dropped;
+    restarts_free(runs, restarts);
+    return result;
+}
 
-        /* free allocated memory for next iteration */
-        matrix_free(nom_matrix, N);
-        matrix_free(denom_matrix, N);
+/*
+factorizes a dense W from several initial H and returns the best factorization, see restarts_operator
+@param W: the norm matrix (N*N)
+@param k: the number of columns of H
+@param seed: the seed of the first restart
+@param restarts: the number of initial H to factorize
+@param threads: the number of threads to use (0 for the OpenMP default)
+@param options: the solver and its settings (may be NULL for the defaults, see symnmf_default_options)
+@param objective: set to ||W - H*H^T||_F^2 of the returned H (may be NULL)
+@param abandoned: set to the number of restarts abandoned (may be NULL)
+@return matrix*: the symnmf matrix (N*k) with the lowest objective
+*/
+matrix* symnmf_restarts(const matrix* W, int k, unsigned long seed, int restarts, int threads,
+                        const symnmf_options* options, double* objective, int* abandoned)
+{
+    double mean;
+    w_operator op;
 
-        if(matrix_convergence(new_H, H, N, k) < eps)
-        {
-            return new_H;
-        }
-        else
-        {
-            advance_H(H, new_H, N, k);
-        }
+    if((mean = matrix_mean(W)) < 0) return NULL; /* Memory allocation failed */
+    op.kind = W_DENSE;
+    op.dense = W;
+    op.packed = NULL;
+    op.sparse = NULL;
+    op.stream = NULL;
+    op.dense_f32 = NULL;
+    op.packed_f32 = NULL;
+    return restarts_operator(&op, W->rows, mean, squared_norm(W), k, seed, restarts, threads, options, objective, abandoned);
+}
+
+/*
+runs the whole symnmf pipeline on a set of points: builds the norm matrix W, initializes H
+from the average entry of W with symnmf_init_H and factorizes W, so W never leaves C
+with config->packed, W is built straight into packed storage by norm_packed and multiplied with
+symm_packed, and no dense N*N matrix is ever allocated: the peak memory is N*(N+1)/2 doubles for W,
+threads*N for the partial degrees and O(N*k) for the iterations, half of the dense pipeline
+with config->single, W is built in floats by norm_f32 or norm_packed_f32, which halves its memory again, and
+every product W*H rounds H to floats; H, the gram matrix and the steps of the solvers stay in double
+@param vectors: the matrix of vectors (N*vecdim)
+@param k: the number of clusters
+@param seed: the seed of the generator initializing H
+@param config: the engine settings (may be NULL for the defaults)
+@param options: the solver and its settings (may be NULL for the defaults)
+@param restarts: the number of initial H to factorize, keeping the best, see symnmf_restarts (1 for a single one)
+@return matrix*: the symnmf matrix (N*k)
+*/
+matrix* symnmf_from_vectors(const matrix* vectors, int k, unsigned long seed, const symnmf_config* config,
+                            const symnmf_options* options, int restarts)
+{
+    int N = vectors->rows;
+    int packed = (config != NULL && config->packed);
+    double mean, w_norm;
+    w_operator op;
+    matrix* W = NULL;
+    packed_matrix* P = NULL;
+    matrix_f32* W_f32 = NULL;
+    packed_matrix_f32* P_f32 = NULL;
+    matrix* H;
+    matrix* result = NULL;
+
+    if(config != NULL && config->single)
+    {
+        if(packed ? (P_f32 = norm_packed_f32(vectors, config)) == NULL
+                  : (W_f32 = norm_f32(vectors, config)) == NULL) return NULL; /* Memory allocation failed */
+        mean = packed ? packed_mean_f32(P_f32) : matrix_mean_f32(W_f32);
+        op.kind = packed ? W_PACKED_F32 : W_DENSE_F32;
+    }
+    else
+    {
+        if(packed ? (P = norm_packed(vectors, config)) == NULL
+                  : (W = norm(vectors, config)) == NULL) return NULL; /* Memory allocation failed */
+        mean = packed ? packed_mean(P) : matrix_mean(W);
+        op.kind = packed ? W_PACKED : W_DENSE;
+    }
+    op.dense = W;
+    op.packed = P;
+    op.sparse = NULL;
+    op.stream = NULL;
+    op.dense_f32 = W_f32;
+    op.packed_f32 = P_f32;
+    if(mean >= 0 && restarts > 1)
+    {
+        w_norm = (W != NULL) ? squared_norm(W) : (P != NULL) ? packed_squared_norm(P) :
+                 (W_f32 != NULL) ? squared_norm_f32(W_f32) : packed_squared_norm_f32(P_f32);
+        result = restarts_operator(&op, N, mean, w_norm, k, seed, restarts, config_threads(config), options, NULL, NULL);
     }
-    return new_H;
+    else if(mean >= 0 && (H = symnmf_init_H(mean, N, k, seed)) != NULL) /* a negative mean: memory allocation failed */
+    {
+        result = symnmf_solve(&op, H, config_threads(config), options, NULL);
+        matrix_free(H);
+    }
+    matrix_free(W);
+    packed_free(P);
+    matrix_free_f32(W_f32);
+    packed_free_f32(P_f32);
+    return result;
 }
 
 /*
@@ -486,100 +1338,184 @@ char* duplicateString(char* src)
 }
 
 /*
-read vectors from a file and store them in a matrix of doubles
+read vectors from a CSV file and store them in a matrix of doubles
+the file is parsed in a single pass (in chunks on several threads when it is large), see csv_read
 @param filename: the name of the file
-@return double**: the matrix of vectors
+@param config: the engine settings (may be NULL for the defaults)
+@return matrix*: the matrix of vectors
 */
-double** read_vectors_from_file(const char *filename)
+matrix* read_vectors_from_file(const char *filename, const symnmf_config* config)
 {
-    char line[MAX_LINE_LENGTH];
-    char* token;
-    int i,j;
-    int row_count = 0;
-    int col_count = 0;
-    double** matrix = NULL;
-
-    FILE *file = fopen(filename, "r");
-    if (file == NULL) {
-        perror("Error opening file");
-        return NULL;
-    }
+    return csv_read(filename, config_threads(config));
+}
 
-    /* First pass to determine the number of rows and columns */
-    while (fgets(line, sizeof(line), file)) {
-        row_count++;
+#ifndef SYMNMF_NO_MAIN
+#define BINARY_INPUT 1  /* the input file is a binary matrix file */
+#define BINARY_OUTPUT 2 /* the result is written to stdout as a binary matrix file */
 
-        /* Count columns in the first row */
-        if (row_count == 1) {
-            char* temp = duplicateString(line);  /* Duplicate line for counting columns */
-            char* token = strtok(temp, ",");
-            while (token != NULL) {
-                col_count++;
-                token = strtok(NULL, ",");
-            }
-            free(temp);
+/*
+parses the command line: options start with "--" and may appear anywhere,
+the remaining arguments are the goal and the input file
+supported options: --threads=T, --backend=scalar|gram, --exp=libm|precise|fast, --diag, --packed,
+--knn=K and --epsilon=E (for the sparse goals), --binary-input and --binary-output (see matfile.h),
+--stats (enables the timers and counters of stats.h, also enabled by the STATS_ENV environment variable)
+@param argc: the number of command line arguments
+@param argv: the command line arguments
+@param config: the engine settings to fill
+@param positional: filled with the goal and the input file
+@param diag: set to 1 if ddg should only print the diagonal
+@param packed: set to 1 if sym and norm should be computed in packed storage
+@param binary: bit 0 set if the input file is a binary matrix file, bit 1 if the result should be written as one
+@return int: 0 on success, 1 if the command line is invalid
+*/
+static int parse_arguments(int argc, char* argv[], symnmf_config* config, char* positional[2], int* diag, int* packed, int* binary)
+{
+    int i, count = 0;
+    for(i=1;i<argc;i++)
+    {
+        if(!strncmp(argv[i], "--threads=", 10))
+        {
+            config->threads = atoi(argv[i] + 10);
         }
-    }
-    N_c = row_count;
-    vecdim_c = col_count;
-
-    /* Allocate memory for the 2D matrix */
-    matrix = matrix_malloc(matrix, N_c, vecdim_c);
-
-    /* Reset file pointer to beginning and read values into matrix */
-    rewind(file);
-    i = 0;
-    while (fgets(line, sizeof(line), file)) {
-        j = 0;
-        token = strtok(line, ",");
-        while (token != NULL) {
-            matrix[i][j++] = atof(token);  /* Convert token to double and store in matrix */
-            token = strtok(NULL, ",");
+        else if(!strcmp(argv[i], "--backend=scalar") || !strcmp(argv[i], "--backend=gram"))
+        {
+            config->sym_backend = !strcmp(argv[i], "--backend=gram") ? SYM_BACKEND_GRAM : SYM_BACKEND_SCALAR;
+        }
+        else if(!strcmp(argv[i], "--exp=libm") || !strcmp(argv[i], "--exp=precise") || !strcmp(argv[i], "--exp=fast"))
+        {
+            config->exp_mode = !strcmp(argv[i], "--exp=libm") ? EXP_LIBM : (!strcmp(argv[i], "--exp=fast") ? EXP_FAST : EXP_PRECISE);
+        }
+        else if(!strcmp(argv[i], "--diag"))
+        {
+            *diag = 1;
+        }
+        else if(!strcmp(argv[i], "--packed"))
+        {
+            *packed = 1;
+        }
+        else if(!strncmp(argv[i], "--knn=", 6))
+        {
+            config->knn = atoi(argv[i] + 6);
+        }
+        else if(!strncmp(argv[i], "--epsilon=", 10))
+        {
+            config->epsilon = atof(argv[i] + 10);
+        }
+        else if(!strcmp(argv[i], "--binary-input"))
+        {
+            *binary |= BINARY_INPUT;
+        }
+        else if(!strcmp(argv[i], "--binary-output"))
+        {
+            *binary |= BINARY_OUTPUT;
+        }
+        else if(!strcmp(argv[i], "--stats"))
+        {
+            stats_enable(1);
+        }
+        else if(!strncmp(argv[i], "--", 2) || count == 2)
+        {
+            return 1;
+        }
+        else
+        {
+            positional[count++] = argv[i];
         }
-        i++;
     }
-
-    fclose(file);
-   
-    return matrix;
+    return count != 2;
 }
 
 int main(int argc, char* argv[])
 {
-    double** vectors;
-    double** goal_matrix = NULL;
-
-    char* goal = duplicateString(argv[1]);
-    char* filename = duplicateString(argv[2]);
+    matrix* vectors;
+    matrix* goal_matrix = NULL;
+    symnmf_config config = {0, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+    char* positional[2];
+    int diag = 0, packed = 0, binary = 0, failed = 0;
+    packed_matrix* goal_packed = NULL;
+    csr_matrix* goal_sparse = NULL;
+    char* goal;
+    char* filename;
+    double start;
 
-    (void)argc;
+    simd_level(); /* detect the instruction set once, before the parallel regions that dispatch on it */
+    stats_from_env();
+    if(parse_arguments(argc, argv, &config, positional, &diag, &packed, &binary) != 0)
+    {
+        printf("An Error Has Occured");
+        return 1;
+    }
+    goal = duplicateString(positional[0]);
+    filename = duplicateString(positional[1]);
 
-    vectors = read_vectors_from_file(filename);
+    start = stats_start();
+    vectors = (binary & BINARY_INPUT) ? matfile_read(filename) : read_vectors_from_file(filename, &config);
     if(vectors == NULL) 
     {
         free(goal);
         free(filename);
         return 1;
     }
+    stats_stop(STATS_READ, start);
     
     if(!strcmp(goal,"sym"))
     {
-        goal_matrix = sym(vectors, N_c, vecdim_c);
+        if(packed) goal_packed = sym_packed(vectors, &config);
+        else goal_matrix = sym(vectors, &config);
     }
     else if(!strcmp(goal,"ddg"))
     {
-        goal_matrix = ddg(vectors, N_c, vecdim_c);
+        goal_matrix = diag ? ddg_diagonal(vectors, &config) : ddg(vectors, &config);
     }
     else if(!strcmp(goal,"norm"))
     {
-        goal_matrix = norm(vectors, N_c, vecdim_c);
+        if(packed) goal_packed = norm_packed(vectors, &config);
+        else goal_matrix = norm(vectors, &config);
+    }
+    else if(!strcmp(goal,"ssym"))
+    {
+        goal_sparse = sym_sparse(vectors, &config);
     }
-    print_matrix(goal_matrix, N_c, N_c);
-    matrix_free(goal_matrix, N_c);
-    matrix_free(vectors, N_c);
+    else if(!strcmp(goal,"sddg"))
+    {
+        goal_matrix = ddg_sparse(vectors, &config);
+    }
+    else if(!strcmp(goal,"snorm"))
+    {
+        goal_sparse = norm_sparse(vectors, &config);
+    }
+    else
+    {
+        printf("An Error Has Occured"); /* unknown goal */
+    }
+    /* a goal that failed has printed the error message where it failed (every failure is an allocation) */
+    failed = (goal_matrix == NULL && goal_sparse == NULL && goal_packed == NULL);
+    start = stats_start();
+    if(goal_matrix != NULL)
+    {
+        if(binary & BINARY_OUTPUT) failed = matfile_write(stdout, goal_matrix);
+        else failed = fprint_matrix(stdout, goal_matrix, config_threads(&config));
+    }
+    if(goal_sparse != NULL)
+    {
+        if(binary & BINARY_OUTPUT) failed = matfile_write_sparse(stdout, goal_sparse);
+        else failed = fprint_sparse(stdout, goal_sparse);
+    }
+    if(goal_packed != NULL)
+    {
+        if(binary & BINARY_OUTPUT) failed = matfile_write_packed(stdout, goal_packed);
+        else failed = fprint_packed(stdout, goal_packed);
+    }
+    fflush(stdout);
+    stats_stop(STATS_WRITE, start);
+    if(stats_enabled()) stats_print_json(stderr);
+    matrix_free(goal_matrix);
+    packed_free(goal_packed);
+    csr_free(goal_sparse);
+    matrix_free(vectors);
     free(goal);
     free(filename);
     
-    return 0;
+    return failed;
 }
-
+#endif
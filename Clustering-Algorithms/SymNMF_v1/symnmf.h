@@ -2,11 +2,187 @@
 #ifndef SYMNMF_H
 #define SYMNMF_H
 
-void matrix_free(double **p, int n);
-double** matrix_malloc(double** new_matrix, int n, int m);
-double** sym(double** vectors, int N, int vecdim);
-double** ddg(double** vectors, int N, int vecdim);
-double** norm(double** vectors, int N, int vecdim);
-double** symnmf(double** W, double** H, int N, int k);
-
-#endif
\ No newline at end of file
+#include <stddef.h>
+
+/* every matrix block (and every padded row) starts on a cache line boundary */
+#define MATRIX_ALIGNMENT 64
+
+/*
+row-major matrix of doubles stored in a single aligned block
+element (i,j) lives at data[i*stride + j], rows wider than a cache line are padded
+so that each of them starts on a MATRIX_ALIGNMENT boundary
+*/
+typedef struct matrix
+{
+    double* data;
+    int rows;
+    int cols;
+    int stride;
+} matrix;
+
+#define MATRIX_ROW(mat, i) ((mat)->data + (size_t)(i) * (mat)->stride)
+#define MATRIX_AT(mat, i, j) (MATRIX_ROW(mat, i)[j])
+
+/*
+symmetric n*n matrix of which only the upper triangle is stored, packed row by row
+in a single aligned block: row i holds the elements (i,i) .. (i,n-1), so the matrix
+takes n*(n+1)/2 doubles instead of n*n
+*/
+typedef struct packed_matrix
+{
+    double* data;
+    int n;
+} packed_matrix;
+
+/* PACKED_ROW points at element (i,i), so element (i,j) with j >= i is PACKED_ROW(mat, i)[j - i] */
+#define PACKED_ROW(mat, i) ((mat)->data + (size_t)(i) * (mat)->n - (size_t)(i) * ((i) - 1) / 2)
+#define PACKED_AT(mat, i, j) ((i) <= (j) ? PACKED_ROW(mat, i)[(j) - (i)] : PACKED_ROW(mat, j)[(i) - (j)])
+
+/* the same storages holding floats, half the memory and half the traffic of every product with them */
+typedef struct matrix_f32
+{
+    float* data;
+    int rows;
+    int cols;
+    int stride;
+} matrix_f32;
+
+typedef struct packed_matrix_f32
+{
+    float* data;
+    int n;
+} packed_matrix_f32;
+
+/*
+sparse n*n matrix in compressed sparse row format, stored in a single block:
+row i holds the entries col[row_ptr[i]] .. col[row_ptr[i+1]-1], with increasing columns,
+and their values val[row_ptr[i]] .. val[row_ptr[i+1]-1]
+*/
+typedef struct csr_matrix
+{
+    double* val;
+    int* row_ptr;
+    int* col;
+    int n;
+    int nnz;
+} csr_matrix;
+
+/* ways sym can compute the pairwise squared distances */
+#define SYM_BACKEND_SCALAR 0 /* per pair difference loop */
+#define SYM_BACKEND_GRAM 1   /* |x|^2 + |y|^2 - 2x.y with the dot products from gemm tiles */
+
+/* ways sym can evaluate the Gaussian kernel exp(-d/2) on a row of distances */
+#define EXP_LIBM 0    /* exp from libm, one element at a time */
+#define EXP_PRECISE 1 /* batched SIMD polynomial, relative error below 1e-12 */
+#define EXP_FAST 2    /* batched SIMD polynomial, relative error below 1e-7 */
+
+/* neighbours kept per point by the sparse similarity graph when neither knn nor epsilon is set */
+#define SPARSE_DEFAULT_KNN 10
+
+/* settings shared by the engine entry points, a NULL config selects the defaults */
+typedef struct symnmf_config
+{
+    int threads;     /* number of OpenMP threads, 0 for the OpenMP default */
+    int sym_backend; /* one of the SYM_BACKEND_ values */
+    int exp_mode;    /* one of the EXP_ values */
+    int knn;         /* sparse graph: neighbours kept per point, 0 to use epsilon */
+    double epsilon;  /* sparse graph: radius of the kept neighbourhoods when knn is 0 */
+    int packed;      /* symnmf_from_vectors: 1 to build W in packed storage, half the memory of the dense one */
+    int single;      /* symnmf_from_vectors: 1 to store W in floats, the products with it summed in float */
+} symnmf_config;
+
+/* ways symnmf can hold the matrix W, of which it only ever needs the product W*H */
+#define W_DENSE 0  /* full N*N matrix, multiplied with gemm */
+#define W_PACKED 1 /* packed upper triangle, half the memory, multiplied with symm_packed */
+#define W_SPARSE 2 /* sparse neighbourhood graph, multiplied with csr_multiply */
+#define W_STREAM 3 /* never stored, recomputed tile by tile from the vectors by stream_multiply */
+#define W_DENSE_F32 4  /* W_DENSE in floats, H is rounded to float for every product */
+#define W_PACKED_F32 5 /* W_PACKED in floats, H is rounded to float for every product */
+
+struct stream_operator; /* defined in stream.h */
+
+/* the matrix W of symnmf, seen through the product W*H */
+typedef struct w_operator
+{
+    int kind;                    /* one of the W_ values */
+    const matrix* dense;         /* the matrix when kind is W_DENSE */
+    const packed_matrix* packed; /* the matrix when kind is W_PACKED */
+    const csr_matrix* sparse;    /* the matrix when kind is W_SPARSE */
+    const struct stream_operator* stream; /* the operator when kind is W_STREAM */
+    const matrix_f32* dense_f32;         /* the matrix when kind is W_DENSE_F32 */
+    const packed_matrix_f32* packed_f32; /* the matrix when kind is W_PACKED_F32 */
+} w_operator;
+
+/* the algorithms symnmf can minimize ||W - H*H^T||_F^2 with */
+#define SOLVER_MU 0       /* damped multiplicative update H <- H*(1 - beta + beta*(W*H)/(H*H^T*H)) */
+#define SOLVER_NESTEROV 1 /* the multiplicative update taken from a Nesterov extrapolated point, restarted when it stops descending */
+#define SOLVER_PG 2       /* projected gradient descent with a backtracking (Armijo) step size */
+
+#define SYMNMF_DEFAULT_MAX_ITER 300
+#define SYMNMF_DEFAULT_EPS 0.0001
+#define SYMNMF_DEFAULT_BETA 0.5
+
+/* settings of the symnmf iterations, a NULL options selects the defaults */
+typedef struct symnmf_options
+{
+    int solver;   /* one of the SOLVER_ values */
+    int max_iter; /* iterations before giving up on convergence */
+    double eps;   /* convergence threshold on the squared Frobenius norm of the change of H */
+    double beta;  /* damping of the multiplicative update (SOLVER_MU and SOLVER_NESTEROV) */
+} symnmf_options;
+
+/* preallocated buffers reused by every iteration of symnmf */
+typedef struct symnmf_workspace
+{
+    int threads;          /* the number of row chunks of H, each handled by one thread */
+    double beta;          /* damping of the multiplicative update, SYMNMF_DEFAULT_BETA unless a solver sets it */
+    double delta;         /* the squared Frobenius norm of the change of H in the last iteration of a solver */
+    int stalled;          /* set when the last solver stopped before converging as no step decreased the objective (SOLVER_PG) */
+    double objective;     /* ||H^T*H||_F^2 - 2*tr(H^T*W*H) at the point W last multiplied (the previous iterate
+                             for SOLVER_MU, the extrapolated point for SOLVER_NESTEROV, the iterate for SOLVER_PG) */
+    matrix* nom_matrix;   /* W*H (N*k) */
+    matrix* gram_matrix;  /* H^T*H (k*k) */
+    matrix* denom_matrix; /* H*(H^T*H) (N*k) */
+    matrix* new_H;        /* second buffer for the iterates (N*k) */
+    double* gemm_buffer;  /* packing space for gemm, one per thread */
+    double* w_buffer;     /* scratch space for W*H, NULL when it needs none */
+    double* partial_grams; /* the k*k gram matrix of every row chunk of H */
+    double* partial_sums; /* the reductions (three per chunk) of the elementwise steps on every row chunk of H */
+    matrix* spare[2];     /* the extra buffers of SOLVER_NESTEROV (N*k twice) and SOLVER_PG (N*k and k*k), NULL for SOLVER_MU */
+} symnmf_workspace;
+
+int config_threads(const symnmf_config* config);
+void matrix_free(matrix* p);
+matrix* matrix_malloc(int n, int m);
+double euclidean_distance(const double* vec1, const double* vec2, int vecdim, int is_squared);
+void packed_free(packed_matrix* p);
+packed_matrix* packed_malloc(int n);
+void matrix_free_f32(matrix_f32* p);
+matrix_f32* matrix_malloc_f32(int n, int m);
+void packed_free_f32(packed_matrix_f32* p);
+packed_matrix_f32* packed_malloc_f32(int n);
+void sym_tile(const matrix* vectors, const matrix* transposed, const double* sq_norms,
+              int bi, int bj, matrix* tile, double* buffer, int exp_mode);
+matrix* sym(const matrix* vectors, const symnmf_config* config);
+packed_matrix* sym_packed(const matrix* vectors, const symnmf_config* config);
+matrix* ddg_diagonal(const matrix* vectors, const symnmf_config* config);
+matrix* ddg(const matrix* vectors, const symnmf_config* config);
+matrix* norm(const matrix* vectors, const symnmf_config* config);
+packed_matrix* norm_packed(const matrix* vectors, const symnmf_config* config);
+matrix_f32* norm_f32(const matrix* vectors, const symnmf_config* config);
+packed_matrix_f32* norm_packed_f32(const matrix* vectors, const symnmf_config* config);
+void w_operator_multiply(const w_operator* W, const matrix* H, matrix* result, double* buffer, int threads);
+symnmf_workspace* symnmf_workspace_malloc(const w_operator* W, int N, int k, int threads);
+void symnmf_workspace_free(symnmf_workspace* ws);
+double symnmf_iterate(const w_operator* W, const matrix* H, matrix* new_H, symnmf_workspace* ws);
+void symnmf_default_options(symnmf_options* options);
+matrix* symnmf_solve(const w_operator* W, matrix* H, int threads, const symnmf_options* options, int* iterations);
+matrix* symnmf_operator(const w_operator* W, matrix* H, int threads);
+matrix* symnmf(const matrix* W, matrix* H, int threads);
+matrix* symnmf_init_H(double mean, int N, int k, unsigned long seed);
+matrix* symnmf_restarts(const matrix* W, int k, unsigned long seed, int restarts, int threads,
+                        const symnmf_options* options, double* objective, int* abandoned);
+matrix* symnmf_from_vectors(const matrix* vectors, int k, unsigned long seed, const symnmf_config* config,
+                            const symnmf_options* options, int restarts);
+
+#endif
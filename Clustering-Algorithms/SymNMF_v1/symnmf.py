@@ -1,10 +1,18 @@
+import json
 import math
 import sys
+import time
 import pandas as pd
 import numpy as np
 import mysymnmfsp as SymNMF
 
-np.random.seed(1234)
+SEED = 1234 # The seed of the random generator initializing H, in numpy and in C
+SOLVERS = {"mu": 0, "nesterov": 1, "pg": 2} # The solvers of the C engine, by their --solver= names
+DEFAULT_OPTIONS = (SOLVERS["mu"], 300, 1e-4, 0.5) # solver, max iterations, tolerance and beta of the C engine
+PRECISIONS = ("double", "single") # W in float64, or in float32 with the products W*H summed in float32
+W_SUFFIX, DEGREES_SUFFIX = ".w", ".degrees" # The files --checkpoint saves W and the degrees to, next to H
+
+np.random.seed(SEED)
 
 """
 Initialize the matrix H (decomposition matrix) for Symmetric Non-negative Matrix Factorization (SymNMF).
@@ -13,18 +21,31 @@ This function initializes the matrix H with random values from the interval [0,
 where m is the mean of the entries in the input matrix w_mat and k is the number of centroids.
 
 Parameters:
-w_mat (list): A list of list of float representing the normalized similarity matrix.
+w_mat (numpy.ndarray): The normalized similarity matrix.
 N (int): The number of vectors (rows in the matrix H).
 k (int): The number of centroids (columns in the matrix H).
 
 Returns:
-list: A list of list of float of shape (N, k) representing a matrix initialized with random values.
+numpy.ndarray: A float64 array of shape (N, k) representing a matrix initialized with random values.
 """
 def initializeH(w_mat, N, k):
     m = np.mean(w_mat) # Calculate the average of all entries in w_mat
+    return initializeHFromMean(m, N, k)
+
+"""
+Initialize the matrix H from the average m of the entries of W, see initializeH.
+
+Parameters:
+m (float): The average of all entries in the normalized similarity matrix.
+N (int): The number of vectors (rows in the matrix H).
+k (int): The number of centroids (columns in the matrix H).
+
+Returns:
+numpy.ndarray: A float64 array of shape (N, k) representing a matrix initialized with random values.
+"""
+def initializeHFromMean(m, N, k):
     upper_bound = 2 * np.sqrt(m / k) # Calculate the upper bound for the random values
-    H = np.random.uniform(low=0, high=upper_bound, size=(N, k)) # Initialize H with random values from the interval [0, upper_bound]
-    return H.tolist()
+    return np.random.uniform(low=0, high=upper_bound, size=(N, k)) # Initialize H with random values from the interval [0, upper_bound]
 
 """
 Perform Symmetric Non-negative Matrix Factorization (SymNMF) on the given vectors.
@@ -32,19 +53,100 @@ Perform Symmetric Non-negative Matrix Factorization (SymNMF) on the given vector
 This function normalizes the input vectors to calculate the W matrix (normalized similarity matrix),
 initializes the H matrix (decomposition matrix),
 and then performs SymNMF to calculate the resulting matrix.
+All three steps run in C, so the N*N matrix W never crosses into Python; H is drawn from
+the same random stream initializeH would draw it from after np.random.seed(SEED).
 
 Parameters:
-vectors (list of list of float): A list of lists representing the input vectors.
+vectors (numpy.ndarray): A C-contiguous float64 array of shape (N, d) representing the input vectors.
 k (int): The number of clusters to form.
+threads (int): The number of threads the C engine may use (0 for all available cores).
+options (tuple): The solver, max iterations, tolerance and beta of the factorization, see DEFAULT_OPTIONS.
+restarts (int): The number of initial H (seeds SEED, SEED + 1, ...) factorized side by side on the same W,
+                keeping the one with the lowest ||W - HH^T|| and abandoning those that fall clearly behind.
+precision (str): "double", or "single" to store W as float32 (half the memory and bandwidth of every product W*H),
+                 H stays float64.
+packed (bool): Build and keep W in packed storage (only its upper triangle, half the memory of the dense W,
+               so N around 60000 fits in 16 GB).
 
 Returns:
-list: A list of list of float representing the resulting matrix after performing SymNMF.
+numpy.ndarray: A float64 array of shape (N, k) representing the resulting matrix after performing SymNMF.
 """
-def doSymnmf(vectors, k):
-    w_mat = SymNMF.norm(vectors) # Calling norm function in C to calculate W matrix
-    h_mat = initializeH(w_mat, len(vectors), k) # Initialize H matrix
-    matrix_goal = SymNMF.symnmf(w_mat, h_mat, k) # Calling symnmf function in C to calculate the matrix
-    return matrix_goal
+def doSymnmf(vectors, k, threads=0, options=DEFAULT_OPTIONS, restarts=1, precision="double", packed=False):
+    if precision not in PRECISIONS:
+        raise ValueError(precision)
+    matrix_goal = SymNMF.symnmf_from_vectors(vectors, k, SEED, threads, *options, restarts, packed, precision == "single") # Calling symnmf_from_vectors function in C to calculate the matrix
+    return np.asarray(matrix_goal)
+
+"""
+Perform SymNMF on the given vectors with a sparse neighbourhood graph as W.
+
+W keeps only the knn nearest neighbours of every point (or, with knn 0, the points within
+distance epsilon) and never leaves its sparse form, so memory grows with N*knn instead of N^2.
+
+Parameters:
+vectors (numpy.ndarray): A C-contiguous float64 array of shape (N, d) representing the input vectors.
+k (int): The number of clusters to form.
+knn (int): The number of neighbours kept per point, 0 to use epsilon.
+epsilon (float): The radius of the kept neighbourhoods when knn is 0.
+threads (int): The number of threads the C engine may use (0 for all available cores).
+options (tuple): The solver, max iterations, tolerance and beta of the factorization, see DEFAULT_OPTIONS.
+
+Returns:
+numpy.ndarray: A float64 array of shape (N, k) representing the resulting matrix after performing SymNMF.
+"""
+def doSymnmfSparse(vectors, k, knn, epsilon, threads=0, options=DEFAULT_OPTIONS):
+    indptr, indices, data = SymNMF.snorm(vectors, knn, epsilon, threads) # Calling snorm function in C to calculate the sparse W
+    N = len(vectors)
+    h_mat = initializeHFromMean(np.sum(data) / (N * N), N, k) # Initialize H matrix, the missing entries of W are zeros
+    return np.asarray(SymNMF.ssymnmf(indptr, indices, data, h_mat, k, threads, *options)) # Calling ssymnmf function in C to calculate the matrix
+
+"""
+Perform SymNMF on the given vectors without ever storing the W matrix.
+
+W is recomputed tile by tile from the vectors by every product, with up to cache_mb megabytes
+of its tiles kept between products, so memory grows with N*(d+k) instead of N^2.
+H is drawn from the same random samples as initializeH, only scaled inside the C engine.
+
+Parameters:
+vectors (numpy.ndarray): A C-contiguous float64 array of shape (N, d) representing the input vectors.
+k (int): The number of clusters to form.
+cache_mb (int): The memory budget for cached tiles of W in megabytes, 0 to recompute every tile.
+threads (int): The number of threads the C engine may use (0 for all available cores).
+options (tuple): The solver, max iterations, tolerance and beta of the factorization, see DEFAULT_OPTIONS.
+
+Returns:
+numpy.ndarray: A float64 array of shape (N, k) representing the resulting matrix after performing SymNMF.
+"""
+def doSymnmfStream(vectors, k, cache_mb=0, threads=0, options=DEFAULT_OPTIONS):
+    samples = np.random.uniform(low=0, high=1, size=(len(vectors), k)) # Scaled by 2*sqrt(m/k) in C once the mean of W is known
+    return np.asarray(SymNMF.streamsymnmf(vectors, samples, k, cache_mb, threads, *options)) # Calling streamsymnmf function in C to calculate the matrix
+
+"""
+Extend a SymNMF solution with appended points, warm starting from the previous H.
+
+Only the similarities with the new points are computed, the old entries of W are rescaled by the
+degrees the new points add, and the factorization starts from the previous H (its rows rescaled the
+same way) with the row of every new point averaged from its most similar old points, so it converges
+in a few iterations instead of the full run from a random H. W and the degrees returned are what
+the next batch of points extends.
+
+Parameters:
+vectors (numpy.ndarray): A C-contiguous float64 array of shape (N+M, d), the N old points followed by the M new ones.
+k (int): The number of clusters to form.
+w_mat (numpy.ndarray): The normalized similarity matrix of the N old points.
+degrees (numpy.ndarray): The degrees of the N old points, as SymNMF.ddgdiag returns them.
+h_mat (numpy.ndarray): The resulting matrix of SymNMF on the N old points.
+threads (int): The number of threads the C engine may use (0 for all available cores).
+options (tuple): The solver, max iterations, tolerance and beta of the factorization, see DEFAULT_OPTIONS.
+
+Returns:
+tuple: The resulting matrix of shape (N+M, k), W and the degrees of all N+M points.
+"""
+def doSymnmfAppend(vectors, k, w_mat, degrees, h_mat, threads=0, options=DEFAULT_OPTIONS):
+    w_new, degrees_new = SymNMF.norm_extend(w_mat, degrees, vectors, threads) # Calling norm_extend function in C to extend W
+    h_start = SymNMF.warm_start_H(w_new, degrees, degrees_new, h_mat, threads) # Calling warm_start_H function in C to extend H
+    h_new = np.asarray(SymNMF.symnmf(w_new, h_start, k, 0, threads, *options)) # Calling symnmf function in C to calculate the matrix
+    return h_new, np.asarray(w_new), np.asarray(degrees_new)
 
 def main():
     try:
@@ -52,29 +154,121 @@ def main():
         input_data = sys.argv
         k, goal, input_file = int(input_data[1]), input_data[2], input_data[3]
 
+        # Optional arguments follow the positional ones
+        threads = 0
+        diag = False
+        knn, epsilon = 0, 0.0
+        stream, cache_mb = False, 0
+        solver, max_iter, tol, beta = DEFAULT_OPTIONS
+        restarts = 1
+        warm_start, checkpoint = None, None
+        precision = "double"
+        packed = False
+        for option in input_data[4:]:
+            if option.startswith("--threads="):
+                threads = int(option[len("--threads="):])
+            elif option == "--diag":
+                diag = True # ddg prints only the diagonal, one degree per line
+            elif option.startswith("--knn="):
+                knn = int(option[len("--knn="):]) # symnmf uses a sparse W with knn neighbours per point
+            elif option.startswith("--epsilon="):
+                epsilon = float(option[len("--epsilon="):]) # symnmf uses a sparse W with the points within epsilon
+            elif option == "--stream":
+                stream = True # symnmf recomputes the tiles of W instead of storing it
+            elif option.startswith("--tile-cache="):
+                cache_mb = int(option[len("--tile-cache="):]) # megabytes of W tiles kept by --stream
+            elif option.startswith("--solver="):
+                solver = SOLVERS[option[len("--solver="):]] # mu, nesterov or pg
+            elif option.startswith("--max-iter="):
+                max_iter = int(option[len("--max-iter="):])
+            elif option.startswith("--tol="):
+                tol = float(option[len("--tol="):]) # symnmf stops once ||H_next - H||_F^2 drops below tol
+            elif option.startswith("--beta="):
+                beta = float(option[len("--beta="):]) # damping of the multiplicative updates
+            elif option.startswith("--restarts="):
+                restarts = int(option[len("--restarts="):]) # symnmf keeps the best of this many initial H
+            elif option.startswith("--warm-start="):
+                warm_start = option[len("--warm-start="):] # binary matrix file of the H of the first points
+            elif option == "--packed":
+                packed = True # symnmf keeps only the upper triangle of W, half the memory
+            elif option.startswith("--precision="):
+                precision = option[len("--precision="):] # double, or single for W in float32
+            elif option == "--stats":
+                SymNMF.enable_stats(True) # per-phase timers and counters, printed as JSON to stderr
+            elif option.startswith("--checkpoint="):
+                checkpoint = option[len("--checkpoint="):] # binary matrix file symnmf saves its H to
+            else:
+                raise ValueError(option)
+        options = (solver, max_iter, tol, beta)
+
+        SymNMF.reset_stats()
+        start = time.monotonic()
         # Create Vectors dataframe from csv file
         vectors = pd.read_csv(input_file, header=None)
-        # Convert vectors to python list of lists
-        vectors = vectors.values.tolist()
+        # Convert vectors to a C-contiguous float64 array, passed to C without a copy
+        vectors = np.ascontiguousarray(vectors.values, dtype=np.float64)
+        read_seconds = time.monotonic() - start
         
         matrix_goal = None # The matrix to calculate and return
+        w_goal, degrees_goal = None, None # W and the degrees of symnmf, when a warm start returned them
 
         # Choose which matrix to calculate and return
         if goal == "sym":
-            matrix_goal = SymNMF.sym(vectors) # Calling sym function in C to calculate the matrix
+            matrix_goal = np.asarray(SymNMF.sym(vectors, threads)) # Calling sym function in C to calculate the matrix
+        elif goal == "ddg" and diag:
+            matrix_goal = np.asarray(SymNMF.ddgdiag(vectors, threads)).reshape(-1, 1) # Calling ddgdiag function in C to calculate the degrees
         elif goal == "ddg":
-            matrix_goal = SymNMF.ddg(vectors) # Calling ddg function in C to calculate the matrix
+            matrix_goal = np.asarray(SymNMF.ddg(vectors, threads)) # Calling ddg function in C to calculate the matrix
         elif goal == "norm":
-            matrix_goal = SymNMF.norm(vectors) # Calling norm function in C to calculate the matrix  
+            matrix_goal = np.asarray(SymNMF.norm(vectors, threads)) # Calling norm function in C to calculate the matrix  
+        elif goal == "symnmf" and restarts > 1 and (knn > 0 or epsilon > 0 or stream):
+            raise ValueError("--restarts needs the dense W")
+        elif goal == "symnmf" and packed and (knn > 0 or epsilon > 0 or stream or warm_start is not None):
+            raise ValueError("--packed needs the W built from scratch")
+        elif goal == "symnmf" and precision != "double" and (knn > 0 or epsilon > 0 or stream or warm_start is not None):
+            raise ValueError("--precision needs the dense W built from scratch")
+        elif goal == "symnmf" and warm_start is not None and (restarts > 1 or knn > 0 or epsilon > 0 or stream):
+            raise ValueError("--warm-start needs the dense W and a single run")
+        elif goal == "symnmf" and warm_start is not None:
+            h_prev = np.asarray(SymNMF.load(warm_start)) # The H of the first len(h_prev) vectors, the rest are new
+            w_prev = SymNMF.load(warm_start + W_SUFFIX) # W and the degrees of the old points, checkpointed next to their H
+            degrees = np.asarray(SymNMF.load(warm_start + DEGREES_SUFFIX)).reshape(-1)
+            if len(degrees) != len(h_prev):
+                raise ValueError("--warm-start needs the W and degrees checkpointed with its H")
+            matrix_goal, w_goal, degrees_goal = doSymnmfAppend(vectors, k, w_prev, degrees, h_prev, threads, options)
+        elif goal == "symnmf" and (knn > 0 or epsilon > 0):
+            matrix_goal = doSymnmfSparse(vectors, k, knn, epsilon, threads, options)
+        elif goal == "symnmf" and stream:
+            matrix_goal = doSymnmfStream(vectors, k, cache_mb, threads, options)
         elif goal == "symnmf":
-            matrix_goal = doSymnmf(vectors, k)
+            matrix_goal = doSymnmf(vectors, k, threads, options, restarts, precision, packed)
         else:
             print("An Error Has Occurred")
             return
+        if goal == "symnmf" and checkpoint is not None:
+            # A dense W is saved with its degrees next to H for --warm-start to extend, built again here unless the warm start returned it
+            if w_goal is None and not (knn > 0 or epsilon > 0 or stream):
+                w_goal = SymNMF.norm(vectors, threads)
+                degrees_goal = np.asarray(SymNMF.ddgdiag(vectors, threads))
+            if w_goal is not None:
+                SymNMF.save(checkpoint + W_SUFFIX, w_goal)
+                SymNMF.save(checkpoint + DEGREES_SUFFIX, np.ascontiguousarray(degrees_goal).reshape(-1, 1))
+            # Matrix files hold float64, whatever precision W was stored in; each is replaced only once complete, and H last,
+            # so a crash keeps the previous checkpoint of H
+            SymNMF.save(checkpoint, np.ascontiguousarray(matrix_goal, dtype=np.float64))
 
         # print matrix_goal until 4 decimal points
+        start = time.monotonic()
         for row in matrix_goal:
             print(','.join(format(x, ".4f") for x in row))
+        sys.stdout.flush()
+
+        stats = SymNMF.stats()
+        if stats["enabled"]:
+            # Reading and printing happen in Python, so their phases are timed here
+            stats["phases"]["read"] = {"seconds": read_seconds, "calls": 1}
+            stats["phases"]["write"] = {"seconds": time.monotonic() - start, "calls": 1}
+            print(json.dumps(stats), file=sys.stderr)
 
     except Exception:
         print("An Error Has Occurred")
@@ -2,251 +2,921 @@
 # include <Python.h>
 # include <stdio.h>
 # include <math.h>
+# include <string.h>
 # include "symnmf.h"
+# include "sparse.h"
+# include "stream.h"
+# include "simd.h"
+# include "incremental.h"
+# include "matfile.h"
+# include "stats.h"
 
-static int N, vecdim, k;
+/**
+ * A block of C memory exposed to Python through the buffer protocol.
+ *
+ * Results are handed to Python as these objects instead of lists, so numpy.asarray views
+ * them without copying or boxing a single element. The object either owns the C allocation
+ * (block, freed with release) or keeps alive another buffer object that owns it (base).
+ */
+typedef struct
+{
+    PyObject_HEAD
+    void* block;             /* the C allocation holding the data, NULL when base owns it */
+    void (*release)(void*);  /* frees block */
+    PyObject* base;          /* the buffer object owning the data, NULL when block is owned */
+    char* data;              /* the first element */
+    int ndim;                /* 1 or 2 */
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];   /* in bytes, rows of a matrix may be padded */
+    Py_ssize_t itemsize;
+    char* format;            /* "d" for doubles, "i" for ints */
+} BufferObject;
+
+/**
+ * Fill a Py_buffer describing a BufferObject, the getbuffer slot of the buffer protocol.
+ *
+ * @param obj The BufferObject.
+ * @param view The Py_buffer to fill.
+ * @param flags The kind of buffer requested by the consumer.
+ * @return 0 on success, -1 with a BufferError set if the layout cannot satisfy the request.
+ */
+static int buffer_getbuffer(PyObject* obj, Py_buffer* view, int flags)
+{
+    BufferObject* self = (BufferObject*)obj;
+    int contiguous = (self->strides[self->ndim - 1] == self->itemsize) &&
+                     (self->ndim == 1 || self->strides[0] == self->shape[1] * self->itemsize);
+
+    if(!contiguous && ((flags & PyBUF_STRIDES) != PyBUF_STRIDES ||
+                       (flags & PyBUF_C_CONTIGUOUS) == PyBUF_C_CONTIGUOUS ||
+                       (flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS ||
+                       (flags & PyBUF_ANY_CONTIGUOUS) == PyBUF_ANY_CONTIGUOUS))
+    {
+        PyErr_SetString(PyExc_BufferError, "the matrix rows are padded, request a strided buffer");
+        return -1;
+    }
+    if((flags & PyBUF_F_CONTIGUOUS) == PyBUF_F_CONTIGUOUS && self->ndim == 2 && self->shape[0] > 1 && self->shape[1] > 1)
+    {
+        PyErr_SetString(PyExc_BufferError, "the matrix is stored row major");
+        return -1;
+    }
+    view->obj = obj;
+    Py_INCREF(obj);
+    view->buf = self->data;
+    view->len = self->shape[0] * (self->ndim == 2 ? self->shape[1] : 1) * self->itemsize;
+    view->readonly = 0;
+    view->itemsize = self->itemsize;
+    view->format = (flags & PyBUF_FORMAT) ? self->format : NULL;
+    view->ndim = self->ndim;
+    view->shape = ((flags & PyBUF_ND) == PyBUF_ND) ? self->shape : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    return 0;
+}
+
+/**
+ * Free a BufferObject and the C memory it owns.
+ *
+ * @param obj The BufferObject.
+ */
+static void buffer_dealloc(PyObject* obj)
+{
+    BufferObject* self = (BufferObject*)obj;
+    if(self->base != NULL) Py_DECREF(self->base);
+    else if(self->block != NULL) self->release(self->block);
+    Py_TYPE(obj)->tp_free(obj);
+}
+
+static PyBufferProcs buffer_procs = {
+    buffer_getbuffer, /* bf_getbuffer */
+    NULL              /* bf_releasebuffer, the data lives as long as the object */
+};
+
+static PyTypeObject BufferType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mysymnmfsp.Buffer",
+    .tp_basicsize = sizeof(BufferObject),
+    .tp_dealloc = buffer_dealloc,
+    .tp_as_buffer = &buffer_procs,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = PyDoc_STR("A matrix computed by the C engine, exposed through the buffer protocol (view it with numpy.asarray)"),
+};
+
+/**
+ * Release callbacks for the C allocations a BufferObject may own.
+ *
+ * @param block The allocation to free.
+ */
+static void release_matrix(void* block)
+{
+    matrix_free((matrix*)block);
+}
+
+static void release_csr(void* block)
+{
+    csr_free((csr_matrix*)block);
+}
+
+/**
+ * Create a BufferObject over C memory.
+ *
+ * @param data The first element.
+ * @param format The buffer format, "d" or "i".
+ * @param itemsize The size of an element.
+ * @param ndim The number of dimensions, 1 or 2.
+ * @param rows The number of rows (elements when ndim is 1).
+ * @param cols The number of columns (ignored when ndim is 1).
+ * @param row_stride The distance between rows in elements.
+ * @return A BufferObject with no owner set, or NULL if the allocation failed.
+ */
+static BufferObject* buffer_new(void* data, char* format, Py_ssize_t itemsize, int ndim, Py_ssize_t rows, Py_ssize_t cols, Py_ssize_t row_stride)
+{
+    BufferObject* self = PyObject_New(BufferObject, &BufferType);
+    if(self == NULL) return NULL;
+    self->block = NULL;
+    self->release = NULL;
+    self->base = NULL;
+    self->data = data;
+    self->ndim = ndim;
+    self->shape[0] = rows;
+    self->shape[1] = (ndim == 2) ? cols : 0;
+    self->strides[0] = row_stride * itemsize;
+    self->strides[1] = itemsize;
+    self->itemsize = itemsize;
+    self->format = format;
+    return self;
+}
+
+/**
+ * Hand a C matrix over to Python as a BufferObject, without copying it.
+ *
+ * @param mat The matrix, owned by the returned object (freed here on failure).
+ * @param ndim 2 for a rows*cols matrix, 1 for a vector of the rows of a single column matrix.
+ * @return A PyObject exposing the matrix through the buffer protocol, or NULL if an error occurs.
+ */
+PyObject* convert_carray2buffer(matrix* mat, int ndim)
+{
+    BufferObject* result = buffer_new(mat->data, "d", sizeof(double), ndim, mat->rows, mat->cols, mat->stride);
+    if(result == NULL)
+    {
+        matrix_free(mat);
+        return NULL;
+    }
+    result->block = mat;
+    result->release = release_matrix;
+    return (PyObject*)result;
+}
+
+/**
+ * Hand a CSR matrix over to Python as a tuple of three BufferObjects, without copying it.
+ *
+ * The data buffer owns the graph, the indptr and indices buffers keep it alive.
+ *
+ * @param graph The CSR matrix, owned by the returned objects (freed here on failure).
+ * @return A PyObject representing the (indptr, indices, data) tuple, or NULL if an error occurs.
+ */
+PyObject* convert_csr2buffers(csr_matrix* graph)
+{
+    BufferObject* data;
+    BufferObject* indptr;
+    BufferObject* indices;
+
+    if((data = buffer_new(graph->val, "d", sizeof(double), 1, graph->nnz, 0, 1)) == NULL)
+    {
+        csr_free(graph);
+        return NULL;
+    }
+    data->block = graph;
+    data->release = release_csr;
+    if((indptr = buffer_new(graph->row_ptr, "i", sizeof(int), 1, graph->n + 1, 0, 1)) == NULL)
+    {
+        Py_DECREF(data);
+        return NULL;
+    }
+    indptr->base = (PyObject*)data;
+    Py_INCREF(data);
+    if((indices = buffer_new(graph->col, "i", sizeof(int), 1, graph->nnz, 0, 1)) == NULL)
+    {
+        Py_DECREF(indptr);
+        Py_DECREF(data);
+        return NULL;
+    }
+    indices->base = (PyObject*)data;
+    Py_INCREF(data);
+
+    return Py_BuildValue("(NNN)", indptr, indices, data);
+}
+
+/**
+ * Check that a buffer holds elements of the given struct format code in native byte order.
+ *
+ * @param format The format of the buffer (NULL means unsigned bytes).
+ * @param code The expected format code, 'd' or 'i'.
+ * @return 1 if the format matches, 0 otherwise.
+ */
+static int buffer_format_is(const char* format, char code)
+{
+    if(format == NULL) return 0;
+    if(*format == '@' || *format == '=' || (*format == '<' && PY_LITTLE_ENDIAN) || (*format == '>' && PY_BIG_ENDIAN)) format++;
+    return format[0] == code && format[1] == '\0';
+}
 
 /**
  * Convert a Python list of lists to a C array.
  *
- * This function takes a Python list of lists (obj) and converts it into a C array (arr).
- * The dimensions of the array are specified by n (number of rows) and m (number of columns).
+ * This function takes a Python list of lists (obj) and converts it into a C matrix (arr).
+ * The dimensions of the list are taken from the matrix, which must already be allocated.
  * Each element in the Python list is converted to a double and stored in the corresponding
- * position in the C array.
+ * position in the C matrix.
  *
  * @param obj A PyObject representing a Python list of lists.
- * @param arr A double pointer representing the C array to be filled.
- * @param n An integer representing the number of rows in the array.
- * @param m An integer representing the number of columns in the array.
- * @return A double pointer representing the filled C array.
+ * @param arr A matrix pointer representing the C matrix to be filled.
+ * @return A matrix pointer representing the filled C matrix.
  */
-double** convert_pylist2carray(PyObject* obj, double** arr, int n, int m)
+matrix* convert_pylist2carray(PyObject* obj, matrix* arr)
 {
     int i,j;
     PyObject* row;
-    for (i=0;i<n;i++)
+    for (i=0;i<arr->rows;i++)
     {
         row = PyList_GetItem(obj, i);
-        for (j=0;j<m;j++)
+        for (j=0;j<arr->cols;j++)
         {
-            arr[i][j] = PyFloat_AsDouble(PyList_GetItem(row, j));
+            MATRIX_AT(arr, i, j) = PyFloat_AsDouble(PyList_GetItem(row, j));
         }
     }
     return arr;
 }
 
 /**
- * Convert a C array to a Python list of lists.
+ * View a Python matrix as a C matrix.
  *
- * This function takes a C array (received_matrix) and converts it into a Python list of lists.
- * The dimensions of the array are specified by n (number of rows) and m (number of columns).
- * Each element in the C array is converted to a Python float and stored in the corresponding
- * position in the Python list.
+ * Objects implementing the buffer protocol (row major 2-D float64 arrays, such as NumPy arrays,
+ * whose rows may be padded like the matrices returned here) are used in place with no copy;
+ * a Python list of lists is still accepted and read
+ * into a newly allocated matrix. Either way the result is released with release_pymatrix.
  *
- * @param received_matrix A double pointer representing the C array to be converted.
- * @param n An integer representing the number of rows in the array.
- * @param m An integer representing the number of columns in the array.
- * @return A PyObject representing the Python list of lists.
+ * @param obj A PyObject representing the matrix.
+ * @param view The Py_buffer filled for buffer objects, its obj is NULL for lists.
+ * @param header The matrix header describing a buffer object.
+ * @return A matrix pointer representing the C matrix, or NULL with a Python exception set.
  */
-PyObject* convert_carray2pylist(double** received_matrix, int n, int m)
+matrix* convert_pymatrix(PyObject* obj, Py_buffer* view, matrix* header)
 {
-    int i,j;
-    PyObject* final_matrix = PyList_New(n);
-    PyObject* final_row;
-    for (i=0;i<n;i++)
+    int rows, cols;
+    matrix* arr;
+
+    view->obj = NULL;
+    if(PyObject_CheckBuffer(obj))
+    {
+        if(PyObject_GetBuffer(obj, view, PyBUF_STRIDES | PyBUF_FORMAT) != 0) return NULL;
+        if(view->ndim != 2 || !buffer_format_is(view->format, 'd') || view->strides[1] != sizeof(double) ||
+           view->strides[0] < view->shape[1] * (Py_ssize_t)sizeof(double) || view->strides[0] % sizeof(double) != 0)
+        {
+            PyBuffer_Release(view);
+            view->obj = NULL;
+            PyErr_SetString(PyExc_TypeError, "expected a row major 2-D float64 array");
+            return NULL;
+        }
+        header->data = view->buf;
+        header->rows = (int)view->shape[0];
+        header->cols = (int)view->shape[1];
+        header->stride = (int)(view->strides[0] / sizeof(double));
+        return header;
+    }
+    if(!PyList_Check(obj) || PyList_Size(obj) == 0 || !PyList_Check(PyList_GetItem(obj, 0)))
+    {
+        PyErr_SetString(PyExc_TypeError, "expected a row major 2-D float64 array or a list of lists");
+        return NULL;
+    }
+    rows = (int)PyList_Size(obj);
+    cols = (int)PyList_Size(PyList_GetItem(obj, 0));
+    if((arr = matrix_malloc(rows, cols)) == NULL) /* Memory allocation failed */
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    return convert_pylist2carray(obj, arr);
+}
+
+/**
+ * Release a matrix obtained from convert_pymatrix.
+ *
+ * @param arr The matrix (may be NULL).
+ * @param view The Py_buffer filled by convert_pymatrix.
+ */
+void release_pymatrix(matrix* arr, Py_buffer* view)
+{
+    if(view->obj != NULL) PyBuffer_Release(view);
+    else matrix_free(arr);
+}
+
+/**
+ * Copy a Python matrix into a newly allocated C matrix, for inputs the engine overwrites.
+ *
+ * Buffer objects are copied row by row with memcpy, lists element by element.
+ *
+ * @param obj A PyObject representing the matrix.
+ * @return A matrix pointer representing the C matrix, or NULL with a Python exception set.
+ */
+matrix* copy_pymatrix(PyObject* obj)
+{
+    int i;
+    Py_buffer view;
+    matrix header;
+    matrix* src;
+    matrix* arr;
+
+    if((src = convert_pymatrix(obj, &view, &header)) == NULL) return NULL;
+    if(view.obj == NULL) return src; /* already a private copy */
+    if((arr = matrix_malloc(src->rows, src->cols)) == NULL) /* Memory allocation failed */
+    {
+        release_pymatrix(src, &view);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (i=0;i<src->rows;i++)
+    {
+        memcpy(MATRIX_ROW(arr, i), MATRIX_ROW(src, i), src->cols * sizeof(double));
+    }
+    release_pymatrix(src, &view);
+    return arr;
+}
+
+/**
+ * Copy a Python vector of ints or doubles into a C array.
+ *
+ * Buffer objects (C-contiguous 1-D int32 or float64 arrays) are copied with memcpy,
+ * lists element by element.
+ *
+ * @param obj A PyObject representing the vector.
+ * @param code The element type, 'i' for int or 'd' for double.
+ * @param dest The C array to fill.
+ * @param count The number of elements expected.
+ * @return 0 on success, -1 with a Python exception set if obj does not hold count elements of that type.
+ */
+int copy_pyvector(PyObject* obj, char code, void* dest, Py_ssize_t count)
+{
+    Py_ssize_t i;
+    Py_buffer view;
+
+    if(PyObject_CheckBuffer(obj))
     {
-        final_row = PyList_New(m);
-        for (j=0;j<m;j++)
+        if(PyObject_GetBuffer(obj, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) return -1;
+        if(view.ndim != 1 || view.shape[0] != count || !buffer_format_is(view.format, code))
         {
-            PyList_SetItem(final_row, j, PyFloat_FromDouble(received_matrix[i][j]));
+            PyBuffer_Release(&view);
+            PyErr_Format(PyExc_TypeError, "expected a C-contiguous 1-D %s array of %zd elements", code == 'i' ? "int32" : "float64", count);
+            return -1;
         }
-        PyList_SetItem(final_matrix, i, final_row);
+        memcpy(dest, view.buf, view.len);
+        PyBuffer_Release(&view);
+        return 0;
+    }
+    if(!PyList_Check(obj) || PyList_Size(obj) != count)
+    {
+        PyErr_Format(PyExc_TypeError, "expected a list or an array of %zd elements", count);
+        return -1;
+    }
+    for (i=0;i<count;i++)
+    {
+        if(code == 'i') ((int*)dest)[i] = (int)PyLong_AsLong(PyList_GetItem(obj, i));
+        else ((double*)dest)[i] = PyFloat_AsDouble(PyList_GetItem(obj, i));
     }
+    return 0;
+}
 
-    return final_matrix;
+/**
+ * Count the elements of a Python vector, a 1-D buffer object or a list.
+ *
+ * @param obj A PyObject representing the vector.
+ * @return The number of elements, or -1 with a Python exception set.
+ */
+Py_ssize_t pyvector_length(PyObject* obj)
+{
+    Py_ssize_t length;
+    Py_buffer view;
+
+    if(PyObject_CheckBuffer(obj))
+    {
+        if(PyObject_GetBuffer(obj, &view, PyBUF_ND) != 0) return -1;
+        length = (view.ndim == 1) ? view.shape[0] : -1;
+        PyBuffer_Release(&view);
+        if(length < 0) PyErr_SetString(PyExc_TypeError, "expected a 1-D array");
+        return length;
+    }
+    return PyList_Size(obj);
 }
 
 /**
- * Convert a Python list of vectors to a C array.
+ * Convert the Python vectors passed to a module function to a C matrix.
  *
- * This function takes a Python list of vectors (vec_arr_obj) and converts it into a C array (vec_arr).
- * It first parses the Python argument to get the list of vectors, then determines the dimensions
- * of the array (N and vecdim). It allocates memory for the C array and converts the Python list
- * into the C array.
+ * This function parses the Python arguments to get the vectors and the optional thread count,
+ * and views the vectors as a C matrix (in place for buffer objects), see convert_pymatrix.
  *
  * @param self A PyObject representing the module or class (not used).
  * @param args A PyObject representing the arguments passed to the function.
- * @return A double pointer representing the C array of vectors, or NULL if an error occurs.
+ * @param config A pointer to the engine settings, filled from the optional arguments.
+ * @param view The Py_buffer of the vectors, to be released with release_pymatrix.
+ * @param header The matrix header describing a buffer object.
+ * @return A matrix pointer representing the C matrix of vectors, or NULL if an error occurs.
  */
-double** convert_vectors(PyObject* self, PyObject* args)
+matrix* convert_vectors(PyObject* self, PyObject* args, symnmf_config* config, Py_buffer* view, matrix* header)
 {
     PyObject* vec_arr_obj;
-    double** vec_arr = NULL;
     
-    /* Parse Python argument: */
-    if(!PyArg_ParseTuple(args, "O", &vec_arr_obj)) return NULL; /* In the CPython API, a NULL value is never valid for a
-                                                                    PyObject* so it is used to signal that an error has occurred. */
-
-    /* Get N and vecdim from the python object */
-    N = PyList_Size(vec_arr_obj);
-    vecdim = PyList_Size(PyList_GetItem(vec_arr_obj, 0));
-
-    /* Allocate memory for C array */
-    if((vec_arr = matrix_malloc(vec_arr, N, vecdim)) == NULL) return NULL; /* Memory allocation failed */
+    /* Parse Python arguments: vectors and an optional thread count (0 for the OpenMP default) */
+    config->threads = 0;
+    config->sym_backend = SYM_BACKEND_SCALAR;
+    config->exp_mode = EXP_LIBM;
+    config->knn = 0;
+    config->epsilon = 0;
+    config->packed = 0;
+    config->single = 0;
+    if(!PyArg_ParseTuple(args, "O|i", &vec_arr_obj, &config->threads)) return NULL; /* In the CPython API, a NULL value is never valid for a
+                                                                                      PyObject* so it is used to signal that an error has occurred. */
 
-    /* Convert python list into C array */
-    vec_arr = convert_pylist2carray(vec_arr_obj, vec_arr, N, vecdim);
-    return vec_arr;
+    return convert_pymatrix(vec_arr_obj, view, header);
 }
 
 /**
- * Perform Symmetric Non-negative Matrix Factorization (SymNMF) on the given vectors.
+ * Perform Similarity Matrix calculation on the given vectors.
  *
- * This function takes a Python list of vectors, converts it to a C array, performs SymNMF,
- * and returns the resulting matrix as a Python list of lists. It handles memory allocation
- * and deallocation for the C arrays.
+ * This function takes the vectors as a float64 array (or a list of lists), performs the similarity
+ * calculation, and returns the resulting matrix as a buffer object, without per-element conversions.
  *
  * @param self A PyObject representing the module or class (not used).
  * @param args A PyObject representing the arguments passed to the function.
- * @return A PyObject representing the resulting matrix as a Python list of lists, or NULL if an error occurs.
+ * @return A PyObject exposing the resulting matrix through the buffer protocol, or NULL if an error occurs.
  */
 static PyObject* symmodule(PyObject* self, PyObject* args)
 {
-    double** vectors_matrix = convert_vectors(self, args);
+    symnmf_config config;
+    Py_buffer view;
+    matrix header;
+    matrix* sym_matrix;
+    matrix* vectors_matrix = convert_vectors(self, args, &config, &view, &header);
     if(vectors_matrix == NULL) return NULL; /* Failure occured */
-    
-    double** sym_matrix = sym(vectors_matrix, N, vecdim);
-    if(sym_matrix == NULL) /* Memory allocation failed */
-    {
-        matrix_free(vectors_matrix, N);
-        return NULL;
-    }
 
-    /* Convert our C double** to a python list of lists */
-    PyObject* final_sym = convert_carray2pylist(sym_matrix, N, N);
-
-    /* Free all allocated memory */
-    matrix_free(vectors_matrix, N);
-    matrix_free(sym_matrix, N);
+    /* The vectors are pinned by the buffer (or copied from a list), so the GIL is not needed */
+    Py_BEGIN_ALLOW_THREADS
+    sym_matrix = sym(vectors_matrix, &config);
+    Py_END_ALLOW_THREADS
+    release_pymatrix(vectors_matrix, &view);
+    if(sym_matrix == NULL) return PyErr_NoMemory(); /* Memory allocation failed */
 
-    return Py_BuildValue("O", final_sym);
+    /* Hand our C matrix over to python */
+    return convert_carray2buffer(sym_matrix, 2);
 }
 
 /**
  * Perform Degree Diagonal Matrix (DDG) calculation on the given vectors.
  *
- * This function takes a Python list of vectors, converts it to a C array, performs the DDG calculation,
- * and returns the resulting matrix as a Python list of lists. It handles memory allocation
- * and deallocation for the C arrays.
+ * This function takes the vectors as a float64 array (or a list of lists), performs the DDG calculation,
+ * and returns the resulting matrix as a buffer object, without per-element conversions.
  *
  * @param self A PyObject representing the module or class (not used).
  * @param args A PyObject representing the arguments passed to the function.
- * @return A PyObject representing the resulting matrix as a Python list of lists, or NULL if an error occurs.
+ * @return A PyObject exposing the resulting matrix through the buffer protocol, or NULL if an error occurs.
  */
 static PyObject* ddgmodule(PyObject* self, PyObject* args)
 {
-    double** vectors_matrix = convert_vectors(self, args);
+    symnmf_config config;
+    Py_buffer view;
+    matrix header;
+    matrix* ddg_matrix;
+    matrix* vectors_matrix = convert_vectors(self, args, &config, &view, &header);
     if(vectors_matrix == NULL) return NULL; /* Failure occured */
 
-    double** ddg_matrix = ddg(vectors_matrix, N, vecdim);
-    if(ddg_matrix == NULL) /* Memory allocation failed */
-    {
-        matrix_free(vectors_matrix, N);
-        return NULL;
-    }
+    /* The vectors are pinned by the buffer (or copied from a list), so the GIL is not needed */
+    Py_BEGIN_ALLOW_THREADS
+    ddg_matrix = ddg(vectors_matrix, &config);
+    Py_END_ALLOW_THREADS
+    release_pymatrix(vectors_matrix, &view);
+    if(ddg_matrix == NULL) return PyErr_NoMemory(); /* Memory allocation failed */
 
-    /* Convert our C double** to a python list of lists */
-    PyObject* final_ddg = convert_carray2pylist(ddg_matrix, N, N);
+    /* Hand our C matrix over to python */
+    return convert_carray2buffer(ddg_matrix, 2);
+}
 
-    /* Free all allocated memory */
-    matrix_free(vectors_matrix, N);
-    matrix_free(ddg_matrix, N);
+/**
+ * Calculate only the diagonal of the Degree Diagonal Matrix (DDG) of the given vectors.
+ *
+ * This function takes the vectors as a float64 array (or a list of lists), computes the degree
+ * of every vector without materializing any N*N matrix, and returns the degrees as a 1-D
+ * buffer object of N doubles, so only N values cross into Python instead of N*N.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function.
+ * @return A PyObject exposing the degrees through the buffer protocol, or NULL if an error occurs.
+ */
+static PyObject* ddgdiagmodule(PyObject* self, PyObject* args)
+{
+    symnmf_config config;
+    Py_buffer view;
+    matrix header;
+    matrix* degrees;
+    matrix* vectors_matrix = convert_vectors(self, args, &config, &view, &header);
+    if(vectors_matrix == NULL) return NULL; /* Failure occured */
 
-    return Py_BuildValue("O", final_ddg);
+    /* The vectors are pinned by the buffer (or copied from a list), so the GIL is not needed */
+    Py_BEGIN_ALLOW_THREADS
+    degrees = ddg_diagonal(vectors_matrix, &config);
+    Py_END_ALLOW_THREADS
+    release_pymatrix(vectors_matrix, &view);
+    if(degrees == NULL) return PyErr_NoMemory(); /* Memory allocation failed */
+
+    /* Hand the degrees over to python */
+    return convert_carray2buffer(degrees, 1);
 }
 
 /**
  * Perform Normalization on the given vectors.
  *
- * This function takes a Python list of vectors, converts it to a C array, performs normalization,
- * and returns the resulting matrix as a Python list of lists. It handles memory allocation
- * and deallocation for the C arrays.
+ * This function takes the vectors as a float64 array (or a list of lists), performs normalization,
+ * and returns the resulting matrix as a buffer object, without per-element conversions.
  *
  * @param self A PyObject representing the module or class (not used).
  * @param args A PyObject representing the arguments passed to the function.
- * @return A PyObject representing the resulting matrix as a Python list of lists, or NULL if an error occurs.
+ * @return A PyObject exposing the resulting matrix through the buffer protocol, or NULL if an error occurs.
  */
 static PyObject* normmodule(PyObject* self, PyObject* args)
 {
-    double** vectors_matrix = convert_vectors(self, args);
+    symnmf_config config;
+    Py_buffer view;
+    matrix header;
+    matrix* norm_matrix;
+    matrix* vectors_matrix = convert_vectors(self, args, &config, &view, &header);
     if(vectors_matrix == NULL) return NULL; /* Failure occured */
 
-    double** norm_matrix = norm(vectors_matrix, N, vecdim);
-    if(norm_matrix == NULL) /* Memory allocation failed */
+    /* The vectors are pinned by the buffer (or copied from a list), so the GIL is not needed */
+    Py_BEGIN_ALLOW_THREADS
+    norm_matrix = norm(vectors_matrix, &config);
+    Py_END_ALLOW_THREADS
+    release_pymatrix(vectors_matrix, &view);
+    if(norm_matrix == NULL) return PyErr_NoMemory(); /* Memory allocation failed */
+
+    /* Hand our C matrix over to python */
+    return convert_carray2buffer(norm_matrix, 2);
+}
+
+/**
+ * Calculate the normalized sparse similarity graph of the given vectors.
+ *
+ * This function takes the vectors, the number of neighbours kept per point (knn)
+ * or, when knn is 0, the radius of the kept neighbourhoods (epsilon), and an optional thread
+ * count. The graph is returned in CSR form as a tuple of three 1-D buffer objects
+ * (indptr and indices of int32, data of float64), the layout used by scipy.sparse.csr_matrix.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function.
+ * @return A PyObject representing the (indptr, indices, data) tuple, or NULL if an error occurs.
+ */
+static PyObject* snormmodule(PyObject* self, PyObject* args)
+{
+    PyObject* vec_arr_obj;
+    Py_buffer view;
+    matrix header;
+    matrix* vectors_matrix;
+    csr_matrix* graph;
+    symnmf_config config = {0, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+
+    /* Parse Python arguments: vectors, knn, epsilon and an optional thread count */
+    if(!PyArg_ParseTuple(args, "Oid|i", &vec_arr_obj, &config.knn, &config.epsilon, &config.threads)) return NULL;
+    if((vectors_matrix = convert_pymatrix(vec_arr_obj, &view, &header)) == NULL) return NULL; /* Failure occured */
+
+    Py_BEGIN_ALLOW_THREADS
+    graph = norm_sparse(vectors_matrix, &config);
+    Py_END_ALLOW_THREADS
+    release_pymatrix(vectors_matrix, &view);
+    if(graph == NULL) return PyErr_NoMemory(); /* Memory allocation failed */
+
+    /* Hand the three CSR arrays over to python */
+    return convert_csr2buffers(graph);
+}
+
+/**
+ * Check the solver options parsed from the optional arguments of a symnmf function.
+ *
+ * @param options The options, filled with symnmf_default_options before parsing.
+ * @return 0 if the options are valid, -1 with a ValueError set otherwise.
+ */
+static int check_options(const symnmf_options* options)
+{
+    if(options->solver < SOLVER_MU || options->solver > SOLVER_PG)
+    {
+        PyErr_SetString(PyExc_ValueError, "solver must be 0 (multiplicative), 1 (nesterov) or 2 (projected gradient)");
+        return -1;
+    }
+    if(options->max_iter < 0 || !(options->eps >= 0) || !(options->beta > 0 && options->beta <= 1))
+    {
+        PyErr_SetString(PyExc_ValueError, "max_iter and eps must not be negative and beta must be in (0, 1]");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Check the arrays of a CSR matrix copied from Python, which csr_multiply indexes without bounds checks.
+ *
+ * @param graph The CSR matrix, its row_ptr and col filled from the Python arrays.
+ * @return 0 if the offsets and columns are consistent, -1 with a ValueError set otherwise.
+ */
+static int check_csr(const csr_matrix* graph)
+{
+    int i, j;
+
+    if(graph->row_ptr[0] != 0 || graph->row_ptr[graph->n] != graph->nnz)
+    {
+        PyErr_SetString(PyExc_ValueError, "indptr must start at 0 and end at the number of entries");
+        return -1;
+    }
+    for(i = 0; i < graph->n; i++)
+    {
+        if(graph->row_ptr[i + 1] < graph->row_ptr[i])
+        {
+            PyErr_SetString(PyExc_ValueError, "indptr must not decrease");
+            return -1;
+        }
+    }
+    for(j = 0; j < graph->nnz; j++)
+    {
+        if(graph->col[j] < 0 || graph->col[j] >= graph->n)
+        {
+            PyErr_SetString(PyExc_ValueError, "indices must be columns in [0, N)");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Perform SymNMF with a sparse W given in CSR form.
+ *
+ * This function takes W as the (indptr, indices, data) arrays returned by snorm (or lists), the initial
+ * H matrix, k, an optional thread count and solver options (see convert_symnmf), and runs the factorization
+ * with the sparse times dense W*H product,
+ * so W is never densified. The resulting H matrix is returned as a buffer object.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function.
+ * @return A PyObject exposing the resulting H matrix through the buffer protocol, or NULL if an error occurs.
+ */
+static PyObject* ssymnmfmodule(PyObject* self, PyObject* args)
+{
+    int N, k;
+    Py_ssize_t n_plus_one, nnz;
+    PyObject* indptr;
+    PyObject* indices;
+    PyObject* data;
+    PyObject* h_mat_obj;
+    csr_matrix* w_sparse;
+    matrix* h_mat;
+    matrix* final_h;
+    w_operator w_op;
+    symnmf_options options;
+    int threads = 0;
+
+    /* Parse Python arguments: the three CSR arrays of W, H, k, an optional thread count and solver options */
+    symnmf_default_options(&options);
+    if(!PyArg_ParseTuple(args, "OOOOi|iiidd", &indptr, &indices, &data, &h_mat_obj, &k, &threads,
+                         &options.solver, &options.max_iter, &options.eps, &options.beta) || check_options(&options) != 0) return NULL;
+    if((n_plus_one = pyvector_length(indptr)) < 1 || (nnz = pyvector_length(indices)) < 0)
     {
-        matrix_free(vectors_matrix, N);
+        if(!PyErr_Occurred()) PyErr_SetString(PyExc_ValueError, "indptr must hold N+1 offsets");
         return NULL;
     }
+    N = (int)n_plus_one - 1;
 
-    /* Convert our C double** to a python list of lists */
-    PyObject* final_norm = convert_carray2pylist(norm_matrix, N, N);
+    /* Allocate memory for C arrays and check if allocation failed */
+    if((w_sparse = csr_malloc(N, (int)nnz)) == NULL) return PyErr_NoMemory(); /* Memory allocation failed */
 
-    /* Free all allocated memory */
-    matrix_free(vectors_matrix, N);
-    matrix_free(norm_matrix, N);
+    /* Copy the python arrays into C arrays */
+    if(copy_pyvector(indptr, 'i', w_sparse->row_ptr, N + 1) != 0 ||
+       copy_pyvector(indices, 'i', w_sparse->col, nnz) != 0 ||
+       copy_pyvector(data, 'd', w_sparse->val, nnz) != 0 ||
+       check_csr(w_sparse) != 0 ||
+       (h_mat = copy_pymatrix(h_mat_obj)) == NULL)
+    {
+        csr_free(w_sparse);
+        return NULL;
+    }
+    if(h_mat->rows != N || h_mat->cols != k)
+    {
+        csr_free(w_sparse);
+        matrix_free(h_mat);
+        PyErr_SetString(PyExc_ValueError, "H must be an N*k matrix");
+        return NULL;
+    }
+    w_op.kind = W_SPARSE;
+    w_op.dense = NULL;
+    w_op.packed = NULL;
+    w_op.sparse = w_sparse;
+    w_op.stream = NULL;
+    w_op.dense_f32 = NULL;
+    w_op.packed_f32 = NULL;
 
-    return Py_BuildValue("O", final_norm);
+    /* Call the symnmf function, every input has been copied so the GIL is not needed */
+    Py_BEGIN_ALLOW_THREADS
+    final_h = symnmf_solve(&w_op, h_mat, threads, &options, NULL);
+    Py_END_ALLOW_THREADS
+    csr_free(w_sparse);
+    matrix_free(h_mat);
+    if(final_h == NULL) return PyErr_NoMemory(); /* Memory allocation failed */
+
+    return convert_carray2buffer(final_h, 2);
+}
+
+/**
+ * Perform SymNMF on the given vectors without ever storing W.
+ *
+ * This function takes the vectors, a matrix U of uniform [0, 1) samples, k, the tile cache budget
+ * in megabytes, the thread count and solver options (see convert_symnmf). W is kept as a streaming operator that recomputes its tiles
+ * from the vectors on every product, caching as many tiles as the budget allows, and H is
+ * initialized here as 2*sqrt(m/k)*U where m is the average entry of W, which is the value
+ * numpy's uniform(0, 2*sqrt(m/k)) draws from the same samples.
+ * The resulting H matrix is returned as a buffer object.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function.
+ * @return A PyObject exposing the resulting H matrix through the buffer protocol, or NULL if an error occurs.
+ */
+static PyObject* streamsymnmfmodule(PyObject* self, PyObject* args)
+{
+    int i,j,N,k;
+    int cache_mb = 0;
+    int failed = 0;
+    double m;
+    PyObject* vec_arr_obj;
+    PyObject* u_mat_obj;
+    Py_buffer view;
+    matrix header;
+    matrix* vec_arr;
+    matrix* h_mat;
+    matrix* final_h;
+    stream_operator* stream;
+    w_operator w_op;
+    symnmf_options options;
+    symnmf_config config = {0, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+
+    /* Parse Python arguments: vectors, U, k, an optional cache size in MB, thread count and solver options */
+    symnmf_default_options(&options);
+    if(!PyArg_ParseTuple(args, "OOi|iiiidd", &vec_arr_obj, &u_mat_obj, &k, &cache_mb, &config.threads,
+                         &options.solver, &options.max_iter, &options.eps, &options.beta) || check_options(&options) != 0) return NULL;
+    if((vec_arr = convert_pymatrix(vec_arr_obj, &view, &header)) == NULL) return NULL; /* Failure occured */
+    N = vec_arr->rows;
+    if((h_mat = copy_pymatrix(u_mat_obj)) == NULL)
+    {
+        release_pymatrix(vec_arr, &view);
+        return NULL;
+    }
+    if(h_mat->rows != N || h_mat->cols != k)
+    {
+        release_pymatrix(vec_arr, &view);
+        matrix_free(h_mat);
+        PyErr_SetString(PyExc_ValueError, "U must be an N*k matrix");
+        return NULL;
+    }
+
+    /* The vectors are pinned by the buffer (or copied from a list) and U is copied, so the GIL is not needed */
+    Py_BEGIN_ALLOW_THREADS
+    final_h = NULL;
+    if((stream = stream_create(vec_arr, &config, (size_t)cache_mb << 20)) == NULL ||
+       (m = stream_mean(stream, config_threads(&config))) < 0) /* Memory allocation failed */
+    {
+        failed = 1;
+    }
+    else
+    {
+        /* H = 2*sqrt(m/k)*U */
+        for (i=0;i<N;i++)
+        {
+            for (j=0;j<k;j++)
+            {
+                MATRIX_AT(h_mat, i, j) *= 2 * sqrt(m / k);
+            }
+        }
+        w_op.kind = W_STREAM;
+        w_op.dense = NULL;
+        w_op.packed = NULL;
+        w_op.sparse = NULL;
+        w_op.stream = stream;
+        w_op.dense_f32 = NULL;
+        w_op.packed_f32 = NULL;
+
+        /* Call the symnmf function */
+        final_h = symnmf_solve(&w_op, h_mat, config.threads, &options, NULL);
+        failed = (final_h == NULL);
+    }
+    stream_free(stream);
+    Py_END_ALLOW_THREADS
+    release_pymatrix(vec_arr, &view);
+    matrix_free(h_mat);
+    if(failed) return PyErr_NoMemory(); /* Memory allocation failed */
+
+    return convert_carray2buffer(final_h, 2);
+}
+
+/**
+ * Copy the upper triangle of a symmetric C matrix to a packed C matrix.
+ *
+ * Only the elements (i,j) with j >= i are read, the lower triangle is assumed to mirror them.
+ *
+ * @param mat A matrix pointer representing the symmetric C matrix.
+ * @param arr A packed_matrix pointer representing the packed C matrix to be filled.
+ * @return A packed_matrix pointer representing the filled packed C matrix.
+ */
+packed_matrix* convert_carray2packed(const matrix* mat, packed_matrix* arr)
+{
+    int i;
+    for (i=0;i<arr->n;i++)
+    {
+        memcpy(PACKED_ROW(arr, i), MATRIX_ROW(mat, i) + i, (arr->n - i) * sizeof(double));
+    }
+    return arr;
 }
 
 /**
  * Perform Symmetric Non-negative Matrix Factorization (SymNMF) on the given vectors.
  *
- * This function takes a Python list of vectors, converts it to a C array, performs SymNMF,
- * and returns the resulting matrix as a Python list of lists. It handles memory allocation
- * and deallocation for the C arrays.
+ * This function takes W and the initial H as float64 arrays (or lists of lists), performs SymNMF,
+ * and returns the resulting matrix as a C matrix. W is used in place, H is copied since the
+ * iterations overwrite it.
+ * With the optional packed flag set, the upper triangle of W is copied into packed storage and
+ * multiplied with symm_packed; since the caller already holds the dense W this saves no memory,
+ * symnmf_from_vectors with its packed flag builds W packed from the start. The optional thread count (0 for all available cores)
+ * splits every iteration between threads; the result is reproducible for a given count.
+ * The optional solver (0 multiplicative, 1 nesterov, 2 projected gradient), iteration limit,
+ * tolerance and beta select how W is factorized, see symnmf_solve; they default to 0, 300, 1e-4 and 0.5.
  *
  * @param self A PyObject representing the module or class (not used).
  * @param args A PyObject representing the arguments passed to the function.
- * @return A double pointer representing the resulting matrix as a C array, or NULL if an error occurs.
+ * @return A matrix pointer representing the resulting matrix as a C matrix, or NULL if an error occurs.
  */
-double** convert_symnmf(PyObject* self, PyObject* args)
+matrix* convert_symnmf(PyObject* self, PyObject* args)
 {
     PyObject* w_mat_obj;
     PyObject* h_mat_obj;
-    double** w_mat = NULL;
-    double** h_mat = NULL;
+    Py_buffer view;
+    matrix header;
+    matrix* w_mat;
+    packed_matrix* w_packed = NULL;
+    matrix* h_mat;
+    matrix* final_h;
+    w_operator w_op;
+    symnmf_options options;
+    int N, k;
+    int packed = 0;
+    int threads = 0;
     
-    /* Parse Python arguments: */
-    if(!PyArg_ParseTuple(args, "OOi", &w_mat_obj, &h_mat_obj, &k)) return NULL; /* In the CPython API, a NULL value is never valid for a
-                                                                                                    PyObject* so it is used to signal that an error has occurred. */
+    /* Parse Python arguments: W, H, k, an optional packed flag, thread count and solver options */
+    symnmf_default_options(&options);
+    if(!PyArg_ParseTuple(args, "OOi|iiiidd", &w_mat_obj, &h_mat_obj, &k, &packed, &threads,
+                         &options.solver, &options.max_iter, &options.eps, &options.beta) || check_options(&options) != 0) return NULL; /* In the CPython API, a NULL value is never valid for a
+                                                                                                                                           PyObject* so it is used to signal that an error has occurred. */
     
-    /* Get N and vecdim from the python object */
-    N = PyList_Size(w_mat_obj);
-
-    /* Allocate memory for C arrays and check if allocation failed */
-    if((w_mat = matrix_malloc(w_mat, N, N)) == NULL) return NULL; /* Memory allocation failed */
-    if((h_mat = matrix_malloc(h_mat, N, k)) == NULL) /* Memory allocation failed */
+    /* View W and copy H */
+    if((w_mat = convert_pymatrix(w_mat_obj, &view, &header)) == NULL) return NULL;
+    N = w_mat->rows;
+    if((h_mat = copy_pymatrix(h_mat_obj)) == NULL)
     {
-        matrix_free(w_mat, N);
+        release_pymatrix(w_mat, &view);
         return NULL;
     }
-
-    /* Convert python lists into C arrays */
-    w_mat = convert_pylist2carray(w_mat_obj, w_mat, N, N);
-    h_mat = convert_pylist2carray(h_mat_obj, h_mat, N, k);
-
-    /* Call the symnmf function */
-    double** final_h = symnmf(w_mat, h_mat, N, k);
-    if(final_h == NULL) /* Memory allocation failed*/
+    if(w_mat->cols != N || h_mat->rows != N || h_mat->cols != k)
     {
-        matrix_free(w_mat, N);
-        matrix_free(h_mat, N);
+        release_pymatrix(w_mat, &view);
+        matrix_free(h_mat);
+        PyErr_SetString(PyExc_ValueError, "W must be an N*N matrix and H an N*k matrix");
         return NULL;
     }
+    if(packed && (w_packed = packed_malloc(N)) == NULL) /* Memory allocation failed */
+    {
+        release_pymatrix(w_mat, &view);
+        matrix_free(h_mat);
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    /* W is pinned by the buffer (or copied from a list) and H is copied, so the GIL is not needed */
+    Py_BEGIN_ALLOW_THREADS
+    w_op.kind = packed ? W_PACKED : W_DENSE;
+    w_op.dense = packed ? NULL : w_mat;
+    w_op.packed = packed ? convert_carray2packed(w_mat, w_packed) : NULL;
+    w_op.sparse = NULL;
+    w_op.stream = NULL;
+    w_op.dense_f32 = NULL;
+    w_op.packed_f32 = NULL;
+
+    /* Call the symnmf function */
+    final_h = symnmf_solve(&w_op, h_mat, threads, &options, NULL);
+    Py_END_ALLOW_THREADS
 
     /* Free all allocated memory */
-    matrix_free(w_mat, N);
-    matrix_free(h_mat, N);
+    release_pymatrix(w_mat, &view);
+    packed_free(w_packed);
+    matrix_free(h_mat);
+    if(final_h == NULL) PyErr_NoMemory(); /* Memory allocation failed */
 
     return final_h;
 }
@@ -254,44 +924,442 @@ double** convert_symnmf(PyObject* self, PyObject* args)
 /**
  * Perform Symmetric Non-negative Matrix Factorization (SymNMF) on the given vectors.
  *
- * This function takes a Python list of vectors, converts it to a C array, performs SymNMF,
- * and returns the resulting H matrix as a Python list of lists. It handles memory allocation
- * and deallocation for the C arrays.
+ * This function takes W and the initial H, performs SymNMF, and returns the resulting
+ * H matrix as a buffer object, see convert_symnmf.
  *
  * @param self A PyObject representing the module or class (not used).
  * @param args A PyObject representing the arguments passed to the function.
- * @return A PyObject representing the resulting H matrix as a Python list of lists, or NULL if an error occurs.
+ * @return A PyObject exposing the resulting H matrix through the buffer protocol, or NULL if an error occurs.
  */
 static PyObject* symnmfmodule(PyObject* self, PyObject* args)
 {    
-    double** h_matrix = convert_symnmf(self, args);
+    matrix* h_matrix = convert_symnmf(self, args);
     if(h_matrix == NULL) return NULL; /* Failure occured */
 
-    PyObject* final_h = convert_carray2pylist(h_matrix, N, k);
+    return convert_carray2buffer(h_matrix, 2);
+}
+
+/**
+ * Perform the whole SymNMF pipeline on the given vectors in C.
+ *
+ * This function takes the vectors, k, the seed of the random generator and an optional thread
+ * count, solver options (see convert_symnmf), restart count, packed flag and single flag, and builds W, initializes H
+ * and factorizes W without W ever crossing into Python. With the packed flag W is built and kept in
+ * packed storage, so no N*N matrix is allocated and the peak memory is about half the dense one. With the
+ * single flag W is stored as float32, halving its memory again, and every product W*H is summed in float32
+ * while H stays float64, see symnmf_from_vectors. With several restarts, W is built once and
+ * factorized from the H of the seeds seed, seed + 1, ... side by side, restarts that fall clearly
+ * behind are abandoned, and the H with the lowest ||W - H*H^T|| is returned, see symnmf_restarts.
+ * H is drawn from the same MT19937 stream numpy.random.seed(seed) sets up, so the result
+ * matches initializing H with numpy after seeding it with the same seed.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function.
+ * @return A PyObject exposing the resulting H matrix through the buffer protocol, or NULL if an error occurs.
+ */
+static PyObject* symnmffromvectorsmodule(PyObject* self, PyObject* args)
+{
+    int k;
+    int restarts = 1;
+    unsigned long seed;
+    PyObject* vec_arr_obj;
+    Py_buffer view;
+    matrix header;
+    matrix* vec_arr;
+    matrix* final_h;
+    symnmf_options options;
+    symnmf_config config = {0, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+
+    /* Parse Python arguments: vectors, k, the seed, an optional thread count, solver options, restart count, packed and single flags */
+    symnmf_default_options(&options);
+    if(!PyArg_ParseTuple(args, "Oik|iiiddipp", &vec_arr_obj, &k, &seed, &config.threads,
+                         &options.solver, &options.max_iter, &options.eps, &options.beta, &restarts, &config.packed,
+                         &config.single) ||
+       check_options(&options) != 0) return NULL;
+    if(restarts < 1)
+    {
+        PyErr_SetString(PyExc_ValueError, "restarts must be at least 1");
+        return NULL;
+    }
+    if((vec_arr = convert_pymatrix(vec_arr_obj, &view, &header)) == NULL) return NULL; /* Failure occured */
+    if(k < 1 || k > vec_arr->rows)
+    {
+        release_pymatrix(vec_arr, &view);
+        PyErr_SetString(PyExc_ValueError, "k must be between 1 and the number of vectors");
+        return NULL;
+    }
+
+    /* The vectors are pinned by the buffer (or copied from a list), so the GIL is not needed */
+    Py_BEGIN_ALLOW_THREADS
+    final_h = symnmf_from_vectors(vec_arr, k, seed, &config, &options, restarts);
+    Py_END_ALLOW_THREADS
+    release_pymatrix(vec_arr, &view);
+    if(final_h == NULL) return PyErr_NoMemory(); /* Memory allocation failed */
+
+    return convert_carray2buffer(final_h, 2);
+}
 
-    return Py_BuildValue("O", final_h);;
+/**
+ * Copy a Python vector of degrees into a newly allocated N*1 C matrix.
+ *
+ * @param obj A PyObject representing the degrees, a 1-D float64 array or a list.
+ * @param N The number of degrees expected.
+ * @return A matrix pointer representing the degrees, or NULL with a Python exception set.
+ */
+matrix* copy_pydegrees(PyObject* obj, int N)
+{
+    matrix* degrees;
+
+    if((degrees = matrix_malloc(N, 1)) == NULL) /* Memory allocation failed */
+    {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    if(copy_pyvector(obj, 'd', degrees->data, N) != 0)
+    {
+        matrix_free(degrees);
+        return NULL;
+    }
+    return degrees;
+}
+
+/**
+ * Extend the normalized similarity matrix of N points with M appended points.
+ *
+ * This function takes W and the degrees (as ddgdiag returns them) of the first N points, the vectors
+ * of all N+M points (the old ones first) and an optional thread count, and computes only the similarities
+ * of the pairs with a new point, rescaling the old entries by the grown degrees, see norm_extend.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function.
+ * @return A PyObject representing the (W, degrees) tuple of all the points, or NULL if an error occurs.
+ */
+static PyObject* normextendmodule(PyObject* self, PyObject* args)
+{
+    int N;
+    PyObject* w_mat_obj;
+    PyObject* degrees_obj;
+    PyObject* vec_arr_obj;
+    Py_buffer w_view, vec_view;
+    matrix w_header, vec_header;
+    matrix* w_mat;
+    matrix* vec_arr;
+    matrix* degrees;
+    matrix* new_degrees = NULL;
+    matrix* extended;
+    PyObject* w_obj;
+    PyObject* degrees_out;
+    symnmf_config config = {0, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+
+    /* Parse Python arguments: W, the degrees, the vectors and an optional thread count */
+    if(!PyArg_ParseTuple(args, "OOO|i", &w_mat_obj, &degrees_obj, &vec_arr_obj, &config.threads)) return NULL;
+    if((w_mat = convert_pymatrix(w_mat_obj, &w_view, &w_header)) == NULL) return NULL; /* Failure occured */
+    N = w_mat->rows;
+    if((vec_arr = convert_pymatrix(vec_arr_obj, &vec_view, &vec_header)) == NULL)
+    {
+        release_pymatrix(w_mat, &w_view);
+        return NULL;
+    }
+    if(w_mat->cols != N || vec_arr->rows < N)
+    {
+        release_pymatrix(w_mat, &w_view);
+        release_pymatrix(vec_arr, &vec_view);
+        PyErr_SetString(PyExc_ValueError, "W must be an N*N matrix and the vectors hold its N points first");
+        return NULL;
+    }
+    if((degrees = copy_pydegrees(degrees_obj, N)) == NULL)
+    {
+        release_pymatrix(w_mat, &w_view);
+        release_pymatrix(vec_arr, &vec_view);
+        return NULL;
+    }
+
+    /* W and the vectors are pinned by their buffers (or copied from lists), so the GIL is not needed */
+    Py_BEGIN_ALLOW_THREADS
+    extended = norm_extend(w_mat, degrees, vec_arr, &new_degrees, &config);
+    Py_END_ALLOW_THREADS
+    release_pymatrix(w_mat, &w_view);
+    release_pymatrix(vec_arr, &vec_view);
+    matrix_free(degrees);
+    if(extended == NULL) return PyErr_NoMemory(); /* Memory allocation failed */
+
+    /* Hand W and the degrees over to python, each object owning its matrix once built */
+    if((w_obj = convert_carray2buffer(extended, 2)) == NULL)
+    {
+        matrix_free(new_degrees);
+        return NULL;
+    }
+    if((degrees_out = convert_carray2buffer(new_degrees, 1)) == NULL)
+    {
+        Py_DECREF(w_obj);
+        return NULL;
+    }
+
+    return Py_BuildValue("(NN)", w_obj, degrees_out);
+}
+
+/**
+ * Build the initial H of the points added by norm_extend from the H of the old points.
+ *
+ * This function takes the extended W, the degrees of the N old points, the degrees of all the points
+ * and the H of the old points, and returns the warm start H of all the points to pass to symnmf:
+ * the old rows rescaled by their grown degrees and the row of every new point averaged from its
+ * most similar old points, see warm_start_H.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function.
+ * @return A PyObject exposing the initial H matrix through the buffer protocol, or NULL if an error occurs.
+ */
+static PyObject* warmstarthmodule(PyObject* self, PyObject* args)
+{
+    int N, total;
+    int threads = 0;
+    PyObject* w_mat_obj;
+    PyObject* degrees_obj;
+    PyObject* new_degrees_obj;
+    PyObject* h_mat_obj;
+    Py_buffer w_view, h_view;
+    matrix w_header, h_header;
+    matrix* w_mat;
+    matrix* h_mat;
+    matrix* degrees = NULL;
+    matrix* new_degrees = NULL;
+    matrix* warm_h = NULL;
+
+    /* Parse Python arguments: the extended W, the old and new degrees, the old H and an optional thread count */
+    if(!PyArg_ParseTuple(args, "OOOO|i", &w_mat_obj, &degrees_obj, &new_degrees_obj, &h_mat_obj, &threads)) return NULL;
+    if((w_mat = convert_pymatrix(w_mat_obj, &w_view, &w_header)) == NULL) return NULL; /* Failure occured */
+    total = w_mat->rows;
+    if((h_mat = convert_pymatrix(h_mat_obj, &h_view, &h_header)) == NULL)
+    {
+        release_pymatrix(w_mat, &w_view);
+        return NULL;
+    }
+    N = h_mat->rows;
+    if(w_mat->cols != total || N < 1 || N > total)
+    {
+        PyErr_SetString(PyExc_ValueError, "W must be an N*N matrix and H a matrix of its first rows");
+    }
+    else if((degrees = copy_pydegrees(degrees_obj, N)) != NULL && (new_degrees = copy_pydegrees(new_degrees_obj, total)) != NULL)
+    {
+        /* W and H are pinned by their buffers (or copied from lists), so the GIL is not needed */
+        Py_BEGIN_ALLOW_THREADS
+        warm_h = warm_start_H(w_mat, degrees, new_degrees, h_mat, threads);
+        Py_END_ALLOW_THREADS
+        if(warm_h == NULL) PyErr_NoMemory(); /* Memory allocation failed */
+    }
+    release_pymatrix(w_mat, &w_view);
+    release_pymatrix(h_mat, &h_view);
+    matrix_free(degrees);
+    matrix_free(new_degrees);
+    if(warm_h == NULL) return NULL; /* Failure occured */
+
+    return convert_carray2buffer(warm_h, 2);
+}
+
+/**
+ * Read a binary matrix file, see matfile.h for the format.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function.
+ * @return A PyObject exposing the matrix through the buffer protocol, or NULL if an error occurs.
+ */
+static PyObject* loadmodule(PyObject* self, PyObject* args)
+{
+    const char* filename;
+    matrix* mat;
+
+    if(!PyArg_ParseTuple(args, "s", &filename)) return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    mat = matfile_read(filename);
+    Py_END_ALLOW_THREADS
+    if(mat == NULL) return PyErr_Format(PyExc_OSError, "could not read a binary matrix file from %s", filename);
+
+    return convert_carray2buffer(mat, 2);
+}
+
+/**
+ * Write a matrix to a binary matrix file, replacing the file only once it is complete, see matfile_save.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function.
+ * @return None, or NULL if an error occurs.
+ */
+static PyObject* savemodule(PyObject* self, PyObject* args)
+{
+    int failed;
+    const char* filename;
+    PyObject* mat_obj;
+    Py_buffer view;
+    matrix header;
+    matrix* mat;
+
+    if(!PyArg_ParseTuple(args, "sO", &filename, &mat_obj)) return NULL;
+    if((mat = convert_pymatrix(mat_obj, &view, &header)) == NULL) return NULL; /* Failure occured */
+    Py_BEGIN_ALLOW_THREADS
+    failed = matfile_save(filename, mat);
+    Py_END_ALLOW_THREADS
+    release_pymatrix(mat, &view);
+    if(failed) return PyErr_Format(PyExc_OSError, "could not write a binary matrix file to %s", filename);
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * Report the timers and counters of the engine, see stats.h.
+ *
+ * The counters are shared by the whole process. The engine releases the GIL, so calls made at the
+ * same time from several Python threads add into the same totals and their numbers are mixed together;
+ * reset and read the stats around a call that runs alone to measure it.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function (none).
+ * @return A dict with "enabled", "phases" mapping every phase name to its "seconds" and "calls",
+ *         "bytes_allocated", "allocations", and the "iterations" and "delta" of the last
+ *         factorization (None before any), or NULL if an error occurs.
+ */
+static PyObject* statsmodule(PyObject* self, PyObject* args)
+{
+    int phase;
+    symnmf_stats stats;
+    PyObject* phases;
+    PyObject* entry;
+
+    stats_get(&stats);
+    if((phases = PyDict_New()) == NULL) return NULL;
+    for(phase = 0; phase < STATS_PHASES; phase++)
+    {
+        entry = Py_BuildValue("{s:d,s:l}", "seconds", stats.seconds[phase], "calls", stats.calls[phase]);
+        if(entry == NULL || PyDict_SetItemString(phases, stats_phase_name(phase), entry) < 0)
+        {
+            Py_XDECREF(entry);
+            Py_DECREF(phases);
+            return NULL;
+        }
+        Py_DECREF(entry);
+    }
+    if(stats.iterations < 0)
+    {
+        return Py_BuildValue("{s:O,s:N,s:d,s:l,s:O,s:O}", "enabled", stats_enabled() ? Py_True : Py_False,
+                             "phases", phases, "bytes_allocated", stats.bytes_allocated,
+                             "allocations", stats.allocations, "iterations", Py_None, "delta", Py_None);
+    }
+    return Py_BuildValue("{s:O,s:N,s:d,s:l,s:i,s:d}", "enabled", stats_enabled() ? Py_True : Py_False,
+                         "phases", phases, "bytes_allocated", stats.bytes_allocated,
+                         "allocations", stats.allocations, "iterations", stats.iterations, "delta", stats.delta);
+}
+
+/**
+ * Enable or disable the timers and counters of the engine, the counters are kept.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function (a truth value).
+ * @return None, or NULL if an error occurs.
+ */
+static PyObject* enablestatsmodule(PyObject* self, PyObject* args)
+{
+    int on;
+
+    if(!PyArg_ParseTuple(args, "p", &on)) return NULL;
+    stats_enable(on);
+
+    Py_RETURN_NONE;
+}
+
+/**
+ * Clear the timers and counters of the engine.
+ *
+ * @param self A PyObject representing the module or class (not used).
+ * @param args A PyObject representing the arguments passed to the function (none).
+ * @return None.
+ */
+static PyObject* resetstatsmodule(PyObject* self, PyObject* args)
+{
+    stats_reset();
+
+    Py_RETURN_NONE;
 }
 
 static PyMethodDef symnmfMethods[] = {
     {"sym",                   /* the Python method name that will be used */
       (PyCFunction) symmodule, /* the C-function that implements the Python function and returns static PyObject*  */
       METH_VARARGS,           /* flags indicating parameters accepted for this function */
-      PyDoc_STR("Calculates similarity matrix from given vectors")}, /*  The docstring for the function */
+      PyDoc_STR("Calculates similarity matrix from given vectors, optionally with the given number of threads")}, /*  The docstring for the function */
 
     {"ddg",
       (PyCFunction) ddgmodule,
       METH_VARARGS,
-      PyDoc_STR("Calculates diagonal degree matrix from given vectors")},
+      PyDoc_STR("Calculates diagonal degree matrix from given vectors, optionally with the given number of threads")},
+
+    {"ddgdiag",
+      (PyCFunction) ddgdiagmodule,
+      METH_VARARGS,
+      PyDoc_STR("Calculates the diagonal of the degree matrix as a 1-D array of N degrees, optionally with the given number of threads")},
     
     {"norm",
       (PyCFunction) normmodule,
       METH_VARARGS,
-      PyDoc_STR("Calculates normalized similarity matrix from given vectors")},
+      PyDoc_STR("Calculates normalized similarity matrix from given vectors, optionally with the given number of threads")},
+
+    {"snorm",
+      (PyCFunction) snormmodule,
+      METH_VARARGS,
+      PyDoc_STR("Calculates the normalized sparse similarity graph keeping knn neighbours per point (or, with knn 0, those within epsilon) as (indptr, indices, data) arrays")},
+
+    {"ssymnmf",
+      (PyCFunction) ssymnmfmodule,
+      METH_VARARGS,
+      PyDoc_STR("Calculates the association matrix (H) for a sparse W given as (indptr, indices, data) arrays, optionally with the given number of threads")},
+
+    {"streamsymnmf",
+      (PyCFunction) streamsymnmfmodule,
+      METH_VARARGS,
+      PyDoc_STR("Calculates the association matrix (H) from given vectors and uniform samples U without storing W, recomputing its tiles and caching up to the given megabytes of them")},
 
     {"symnmf",
       (PyCFunction) symnmfmodule,
       METH_VARARGS,
-      PyDoc_STR("Calculates and updates the association matrix (H) matrix from given vectors until convergence or max iterations")},
+      PyDoc_STR("Calculates and updates the association matrix (H) matrix from given vectors until convergence or max iterations, optionally storing W packed and with the given number of threads")},
+
+    {"symnmf_from_vectors",
+      (PyCFunction) symnmffromvectorsmodule,
+      METH_VARARGS,
+      PyDoc_STR("Calculates the association matrix (H) from given vectors with W and the initial H built in C, H drawn like numpy.random.uniform after numpy.random.seed(seed), optionally with the given number of threads, solver options, number of restarts to keep the best of, a packed flag building W in packed storage (half the memory) and a single flag storing W in float32 (half the memory again)")},
+
+    {"norm_extend",
+      (PyCFunction) normextendmodule,
+      METH_VARARGS,
+      PyDoc_STR("Extends the normalized similarity matrix and degrees of N points to the given vectors (the N points followed by new ones), computing only the similarities with the new points, and returns (W, degrees)")},
+
+    {"warm_start_H",
+      (PyCFunction) warmstarthmodule,
+      METH_VARARGS,
+      PyDoc_STR("Builds the initial H of the points added by norm_extend from the H of the old points, for a warm started symnmf")},
+
+    {"load",
+      (PyCFunction) loadmodule,
+      METH_VARARGS,
+      PyDoc_STR("Reads a matrix from a binary matrix file")},
+
+    {"save",
+      (PyCFunction) savemodule,
+      METH_VARARGS,
+      PyDoc_STR("Writes a matrix to a binary matrix file, replacing it only once complete (for checkpoints)")},
+
+    {"stats",
+      (PyCFunction) statsmodule,
+      METH_NOARGS,
+      PyDoc_STR("Returns the per-phase timers and the counters of the engine as a dict (process-wide: concurrent calls are mixed together)")},
+
+    {"enable_stats",
+      (PyCFunction) enablestatsmodule,
+      METH_VARARGS,
+      PyDoc_STR("Enables or disables the timers and counters of the engine (also enabled by the SYMNMF_STATS environment variable)")},
+
+    {"reset_stats",
+      (PyCFunction) resetstatsmodule,
+      METH_NOARGS,
+      PyDoc_STR("Clears the timers and counters of the engine")},
 
     {NULL, NULL, 0, NULL}     /* The last entry must be all NULL as shown to act as a
                                  sentinel. Python looks for this entry to know that all
@@ -309,9 +1377,20 @@ static struct PyModuleDef moduledef = {
 PyMODINIT_FUNC PyInit_mysymnmfsp(void)
 {
     PyObject *m;
+    simd_level(); /* detect the instruction set once, before calls without the GIL can race on it */
+    stats_from_env();
+    if (PyType_Ready(&BufferType) < 0) {
+        return NULL;
+    }
     m = PyModule_Create(&moduledef);
     if (!m) {
         return NULL;
     }
+    Py_INCREF(&BufferType);
+    if (PyModule_AddObject(m, "Buffer", (PyObject*)&BufferType) < 0) {
+        Py_DECREF(&BufferType);
+        Py_DECREF(m);
+        return NULL;
+    }
     return m;
 }
@@ -0,0 +1,1574 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "symnmf.h"
+#include "gemm.h"
+#include "simd.h"
+#include "sparse.h"
+#include "stream.h"
+#include "prng.h"
+#include "csv.h"
+#include "matfile.h"
+#include "output.h"
+#include "incremental.h"
+#include "stats.h"
+
+/*
+unit tests for the symnmf engine
+built and run with: make test
+*/
+
+static int failures = 0;
+static unsigned long allocation_count = 0;
+static double allocation_bytes = 0;
+
+/*
+the test is linked with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc so that every heap
+allocation made by the engine objects goes through these wrappers and can be counted
+*/
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* p, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    allocation_count++;
+    allocation_bytes += (double)size;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+    allocation_count++;
+    allocation_bytes += (double)count * size;
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* p, size_t size)
+{
+    allocation_count++;
+    allocation_bytes += (double)size;
+    return __real_realloc(p, size);
+}
+
+/*
+reports the result of a single check
+@param name: the name of the check
+@param passed: non zero if the check passed
+@return void
+*/
+static void check(const char* name, int passed)
+{
+    printf("%-60s %s\n", name, passed ? "PASS" : "FAIL");
+    if(!passed) failures++;
+}
+
+/*
+allocates a matrix filled with uniform random values in [low, high)
+@param n: the number of rows
+@param m: the number of columns
+@param low: the lower bound of the values
+@param high: the upper bound of the values
+@return matrix*: the allocated matrix
+*/
+static matrix* random_matrix(int n, int m, double low, double high)
+{
+    int i,j;
+    matrix* mat;
+    if((mat = matrix_malloc(n, m)) == NULL) return NULL; /* Memory allocation failed */
+    for(i=0;i<n;i++)
+    {
+        for(j=0;j<m;j++)
+        {
+            MATRIX_AT(mat, i, j) = low + (high - low) * (rand() / (RAND_MAX + 1.0));
+        }
+    }
+    return mat;
+}
+
+/*
+copies a matrix into a newly allocated one
+@param mat: the matrix to be copied
+@return matrix*: the copy
+*/
+static matrix* matrix_copy(const matrix* mat)
+{
+    int i;
+    matrix* copy;
+    if((copy = matrix_malloc(mat->rows, mat->cols)) == NULL) return NULL; /* Memory allocation failed */
+    for(i=0;i<mat->rows;i++)
+    {
+        memcpy(MATRIX_ROW(copy, i), MATRIX_ROW(mat, i), mat->cols * sizeof(double));
+    }
+    return copy;
+}
+
+/*
+calculates the largest absolute difference between two matrices of the same dimensions
+@param matrix1: the first matrix
+@param matrix2: the second matrix
+@return double: the largest absolute difference
+*/
+static double max_abs_diff(const matrix* matrix1, const matrix* matrix2)
+{
+    int i,j;
+    double diff, max = 0;
+    for(i=0;i<matrix1->rows;i++)
+    {
+        for(j=0;j<matrix1->cols;j++)
+        {
+            diff = fabs(MATRIX_AT(matrix1, i, j) - MATRIX_AT(matrix2, i, j));
+            if(diff > max) max = diff;
+        }
+    }
+    return max;
+}
+
+/*
+naive C = A*B used as the reference for the optimized kernels
+@param A: the first matrix (n*m)
+@param B: the second matrix (m*p)
+@param C: the result matrix (n*p)
+@return void
+*/
+static void reference_multiplication(const matrix* A, const matrix* B, matrix* C)
+{
+    int i,j,k;
+    double sum;
+    for(i=0;i<A->rows;i++)
+    {
+        for(j=0;j<B->cols;j++)
+        {
+            sum = 0;
+            for(k=0;k<A->cols;k++)
+            {
+                sum += MATRIX_AT(A, i, k) * MATRIX_AT(B, k, j);
+            }
+            MATRIX_AT(C, i, j) = sum;
+        }
+    }
+}
+
+/*
+the original symnmf iteration, with the N*N helper matrix H*H^T, used as the reference
+@param W: the norm matrix (N*N)
+@param H: the initial H matrix (N*k), overwritten
+@param result: the final H matrix (N*k)
+@return int: 0 on success, 1 if memory allocation failed
+*/
+static int reference_symnmf(const matrix* W, matrix* H, matrix* result)
+{
+    int it,i,j,l;
+    int N = H->rows, k = H->cols;
+    double delta, diff;
+    matrix* nom = matrix_malloc(N, k);
+    matrix* transposed = matrix_malloc(k, N);
+    matrix* helper = matrix_malloc(N, N);
+    matrix* denom = matrix_malloc(N, k);
+    int status = (nom == NULL || transposed == NULL || helper == NULL || denom == NULL);
+
+    for(it=0;it<300 && !status;it++)
+    {
+        reference_multiplication(W, H, nom);
+        for(i=0;i<N;i++)
+        {
+            for(l=0;l<k;l++)
+            {
+                MATRIX_AT(transposed, l, i) = MATRIX_AT(H, i, l);
+            }
+        }
+        reference_multiplication(H, transposed, helper);
+        reference_multiplication(helper, H, denom);
+
+        delta = 0;
+        for(i=0;i<N;i++)
+        {
+            for(j=0;j<k;j++)
+            {
+                MATRIX_AT(result, i, j) = MATRIX_AT(H, i, j) * (0.5 + 0.5 * MATRIX_AT(nom, i, j) / MATRIX_AT(denom, i, j));
+                diff = MATRIX_AT(result, i, j) - MATRIX_AT(H, i, j);
+                delta += diff * diff;
+            }
+        }
+        if(delta < 0.0001) break;
+        for(i=0;i<N;i++)
+        {
+            memcpy(MATRIX_ROW(H, i), MATRIX_ROW(result, i), k * sizeof(double));
+        }
+    }
+
+    matrix_free(nom);
+    matrix_free(transposed);
+    matrix_free(helper);
+    matrix_free(denom);
+    return status;
+}
+
+/*
+rounds a matrix of doubles to a matrix of floats
+@param mat: the matrix
+@return matrix_f32*: the rounded matrix
+*/
+static matrix_f32* round_f32(const matrix* mat)
+{
+    int i,j;
+    matrix_f32* result = matrix_malloc_f32(mat->rows, mat->cols);
+    for(i=0;i<mat->rows;i++)
+    {
+        for(j=0;j<mat->cols;j++)
+        {
+            MATRIX_AT(result, i, j) = (float)MATRIX_AT(mat, i, j);
+        }
+    }
+    return result;
+}
+
+/*
+checks gemm, its float version and gram against the naive multiplication on odd shapes that exercise every edge tile
+@param label: the name of the instruction set level being tested
+@return void
+*/
+static void test_kernels(const char* label)
+{
+    char name[80];
+    static const int shapes[][3] = {{1, 1, 1}, {7, 3, 5}, {65, 257, 9}, {300, 300, 2}, {130, 17, 2049}};
+    int s;
+    double gemm_err = 0, f32_err = 0, gram_err = 0, err;
+
+    for(s=0;s<(int)(sizeof(shapes)/sizeof(shapes[0]));s++)
+    {
+        int n = shapes[s][0], m = shapes[s][1], p = shapes[s][2];
+        matrix* A = random_matrix(n, m, -1, 1);
+        matrix* B = random_matrix(m, p, -1, 1);
+        matrix* C = matrix_malloc(n, p);
+        matrix* C_ref = matrix_malloc(n, p);
+        matrix* At = matrix_malloc(m, n);
+        matrix* G = matrix_malloc(m, m);
+        matrix* G_ref = matrix_malloc(m, m);
+        matrix_f32* A_f32 = round_f32(A);
+        matrix_f32* B_f32 = round_f32(B);
+        float* buffer = malloc(gemm_buffer_size(p) * sizeof(float));
+        int i,j;
+
+        gemm(A, B, C, NULL);
+        reference_multiplication(A, B, C_ref);
+        if((err = max_abs_diff(C, C_ref)) > gemm_err) gemm_err = err;
+
+        for(i=0;i<n;i++)
+        {
+            memset(MATRIX_ROW(C, i), 0, p * sizeof(double));
+        }
+        gemm_accumulate_f32(A_f32, B_f32, C, buffer);
+        if((err = max_abs_diff(C, C_ref)) > f32_err) f32_err = err;
+
+        for(i=0;i<n;i++)
+        {
+            for(j=0;j<m;j++)
+            {
+                MATRIX_AT(At, j, i) = MATRIX_AT(A, i, j);
+            }
+        }
+        gram(A, G);
+        reference_multiplication(At, A, G_ref);
+        if((err = max_abs_diff(G, G_ref)) > gram_err) gram_err = err;
+
+        matrix_free(A);
+        matrix_free(B);
+        matrix_free(C);
+        matrix_free(C_ref);
+        matrix_free(At);
+        matrix_free(G);
+        matrix_free(G_ref);
+        matrix_free_f32(A_f32);
+        matrix_free_f32(B_f32);
+        free(buffer);
+    }
+    sprintf(name, "gemm matches the naive multiplication (%s)", label);
+    check(name, gemm_err < 1e-9);
+    sprintf(name, "float gemm matches it within float rounding (%s)", label);
+    check(name, f32_err < 1e-4);
+    sprintf(name, "gram matches A^T*A (%s)", label);
+    check(name, gram_err < 1e-9);
+}
+
+/*
+checks the gram trick sym backend against the per pair distance loop,
+including duplicated points whose distance cancels to (almost) zero
+the cancellation error of ||x||^2 + ||y||^2 - 2x.y grows with the squared norms,
+so the error is measured relative to the largest of them
+@param label: the name of the instruction set level being tested
+@return void
+*/
+static void test_sym_backends(const char* label)
+{
+    static const int sizes[][2] = {{10, 5}, {300, 3}, {600, 40}};
+    int s,i,j;
+    double err = 0, diff, max_sq_norm, sq_norm;
+    char name[80];
+    symnmf_config scalar_config = {0, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+    symnmf_config gram_config = {0, SYM_BACKEND_GRAM, EXP_LIBM, 0, 0, 0, 0};
+
+    for(s=0;s<(int)(sizeof(sizes)/sizeof(sizes[0]));s++)
+    {
+        int N = sizes[s][0], vecdim = sizes[s][1];
+        matrix* vectors = random_matrix(N, vecdim, -2, 2);
+        matrix* scalar_sym;
+        matrix* gram_sym;
+
+        for(i=1;i<N;i+=7) /* duplicates, shifted far from the origin to provoke cancellation */
+        {
+            for(j=0;j<vecdim;j++)
+            {
+                MATRIX_AT(vectors, i - 1, j) += 100;
+                MATRIX_AT(vectors, i, j) = MATRIX_AT(vectors, i - 1, j);
+            }
+        }
+        max_sq_norm = 1;
+        for(i=0;i<N;i++)
+        {
+            sq_norm = 0;
+            for(j=0;j<vecdim;j++)
+            {
+                sq_norm += MATRIX_AT(vectors, i, j) * MATRIX_AT(vectors, i, j);
+            }
+            if(sq_norm > max_sq_norm) max_sq_norm = sq_norm;
+        }
+        scalar_sym = sym(vectors, &scalar_config);
+        gram_sym = sym(vectors, &gram_config);
+        if((diff = max_abs_diff(scalar_sym, gram_sym) / max_sq_norm) > err) err = diff;
+        for(i=0;i<N;i++)
+        {
+            for(j=0;j<N;j++)
+            {
+                if(MATRIX_AT(gram_sym, i, j) > 1 || MATRIX_AT(gram_sym, i, j) != MATRIX_AT(gram_sym, j, i)) err = 1;
+            }
+        }
+
+        matrix_free(vectors);
+        matrix_free(scalar_sym);
+        matrix_free(gram_sym);
+    }
+    sprintf(name, "gram sym backend matches the scalar one (%s)", label);
+    check(name, err < 8 * DBL_EPSILON);
+}
+
+/*
+checks the batched exp of both accuracy modes against libm, including the vector tails
+and arguments outside the range of the polynomial
+@param label: the name of the instruction set level being tested
+@return void
+*/
+static void test_exp(const char* label)
+{
+    static const double special[] = {0, -1e-300, -708.3, -708.5, -745, -1000, 1, 709.5};
+    enum { COUNT = 1003 };
+    int i,mode;
+    double args[COUNT], values[COUNT];
+    double err, limit;
+    char name[80];
+
+    for(i=0;i<COUNT;i++)
+    {
+        args[i] = (i < (int)(sizeof(special)/sizeof(special[0]))) ? special[i] : -700 * (rand() / (RAND_MAX + 1.0));
+    }
+    for(mode=EXP_PRECISE;mode<=EXP_FAST;mode++)
+    {
+        err = 0;
+        limit = (mode == EXP_PRECISE) ? 1e-12 : 1e-7;
+        memcpy(values, args, sizeof(args));
+        simd_exp(values, COUNT, mode);
+        for(i=0;i<COUNT;i++)
+        {
+            double expected = exp(args[i]);
+            double diff = (expected > 0) ? fabs(values[i] - expected) / expected : fabs(values[i]);
+            if(!(diff <= err)) err = diff;
+        }
+        sprintf(name, "%s exp within %g of libm (%s)", (mode == EXP_PRECISE) ? "precise" : "fast", limit, label);
+        check(name, err < limit);
+    }
+}
+
+/*
+checks that the streamed degrees equal the row sums of the symilarity matrix with both backends,
+over several tiles and threads
+@return void
+*/
+static void test_ddg_diagonal(void)
+{
+    int i,j,backend;
+    int N = 600;
+    double sum, err = 0;
+    matrix* vectors = random_matrix(N, 6, -1, 1);
+
+    for(backend=SYM_BACKEND_SCALAR;backend<=SYM_BACKEND_GRAM;backend++)
+    {
+        symnmf_config config = {3, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+        matrix* sym_matrix;
+        matrix* degrees;
+
+        config.sym_backend = backend;
+        sym_matrix = sym(vectors, &config);
+        degrees = ddg_diagonal(vectors, &config);
+        for(i=0;i<N;i++)
+        {
+            sum = 0;
+            for(j=0;j<N;j++)
+            {
+                sum += MATRIX_AT(sym_matrix, i, j);
+            }
+            if(fabs(sum - MATRIX_AT(degrees, i, 0)) > err * sum) err = fabs(sum - MATRIX_AT(degrees, i, 0)) / sum;
+        }
+        check("ddg diagonal has one degree per point", degrees->rows == N && degrees->cols == 1);
+        matrix_free(sym_matrix);
+        matrix_free(degrees);
+    }
+    check("ddg diagonal equals the row sums of sym within 1e-13", err < 1e-13);
+
+    matrix_free(vectors);
+}
+
+/*
+checks the packed storage against the dense one: norm_packed against norm, symm_packed
+against gemm (sizes around the SYMM_BLOCK boundary) and a packed factorization against a dense one
+@return void
+*/
+static void test_packed(void)
+{
+    static const int sizes[][3] = {{2, 2, 1}, {63, 3, 2}, {65, 4, 3}, {150, 5, 6}};
+    int s,i,j;
+    double norm_err = 0, symm_err = 0, symnmf_err = 0, diff;
+
+    for(s=0;s<(int)(sizeof(sizes)/sizeof(sizes[0]));s++)
+    {
+        int N = sizes[s][0], vecdim = sizes[s][1], k = sizes[s][2];
+        matrix* vectors = random_matrix(N, vecdim, -2, 2);
+        matrix* W = norm(vectors, NULL);
+        packed_matrix* P = norm_packed(vectors, NULL);
+        matrix* H = random_matrix(N, k, 0, 1);
+        matrix* H_copy = matrix_copy(H);
+        matrix* dense_product = matrix_malloc(N, k);
+        matrix* packed_product = matrix_malloc(N, k);
+        matrix* dense_result;
+        matrix* packed_result;
+        w_operator op;
+
+        for(i=0;i<N;i++)
+        {
+            for(j=0;j<N;j++)
+            {
+                if((diff = fabs(MATRIX_AT(W, i, j) - PACKED_AT(P, i, j))) > norm_err) norm_err = diff;
+            }
+        }
+        gemm(W, H, dense_product, NULL);
+        symm_packed(P, H, packed_product, NULL, 1);
+        if((diff = max_abs_diff(dense_product, packed_product)) > symm_err) symm_err = diff;
+
+        op.kind = W_PACKED;
+        op.dense = NULL;
+        op.packed = P;
+        op.sparse = NULL;
+        op.stream = NULL;
+        op.dense_f32 = NULL;
+        op.packed_f32 = NULL;
+        dense_result = symnmf(W, H, 1);
+        packed_result = symnmf_operator(&op, H_copy, 1);
+        if((diff = max_abs_diff(dense_result, packed_result)) > symnmf_err) symnmf_err = diff;
+
+        matrix_free(vectors);
+        matrix_free(W);
+        packed_free(P);
+        matrix_free(H);
+        matrix_free(H_copy);
+        matrix_free(dense_product);
+        matrix_free(packed_product);
+        matrix_free(dense_result);
+        matrix_free(packed_result);
+    }
+    check("packed norm matches the dense one within 1e-12", norm_err < 1e-12);
+    check("symm_packed matches gemm within 1e-12", symm_err < 1e-12);
+    check("packed symnmf matches the dense one within 1e-9", symnmf_err < 1e-9);
+}
+
+/*
+checks that symnmf_from_vectors with a packed W, with one and with several restarts, matches the dense pipeline
+@return void
+*/
+static void test_packed_pipeline(void)
+{
+    int restarts;
+    int N = 120, k = 3;
+    double err = 0, diff;
+    symnmf_config dense_config = {1, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+    symnmf_config packed_config = {1, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 1, 0};
+    matrix* vectors = random_matrix(N, 3, -1, 1);
+
+    for(restarts=1;restarts<=3;restarts+=2)
+    {
+        matrix* dense = symnmf_from_vectors(vectors, k, 1234, &dense_config, NULL, restarts);
+        matrix* packed = symnmf_from_vectors(vectors, k, 1234, &packed_config, NULL, restarts);
+        if((diff = max_abs_diff(dense, packed)) > err) err = diff;
+        matrix_free(dense);
+        matrix_free(packed);
+    }
+    check("packed symnmf_from_vectors matches the dense one within 1e-9", err < 1e-9);
+
+    matrix_free(vectors);
+}
+
+/*
+expands a sparse matrix into a dense one
+@param A: the sparse matrix (n*n)
+@return matrix*: the dense matrix (n*n)
+*/
+static matrix* csr_to_dense(const csr_matrix* A)
+{
+    int i,p;
+    matrix* dense = matrix_malloc(A->n, A->n);
+    for(i=0;i<A->n;i++)
+    {
+        memset(MATRIX_ROW(dense, i), 0, A->n * sizeof(double));
+        for(p=A->row_ptr[i];p<A->row_ptr[i + 1];p++)
+        {
+            MATRIX_AT(dense, i, A->col[p]) = A->val[p];
+        }
+    }
+    return dense;
+}
+
+/*
+checks the sparse graphs: with knn = N-1 the sparse norm is the dense one, a knn graph is
+symmetric with at least knn entries per row, an epsilon graph keeps exactly the pairs within
+epsilon, and csr_multiply matches gemm on the expanded matrix
+@return void
+*/
+static void test_sparse(void)
+{
+    int i,j,p;
+    int N = 80, k = 3;
+    int knn_ok = 1, epsilon_ok = 1;
+    double err;
+    symnmf_config config = {0, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+    matrix* vectors = random_matrix(N, 3, -1, 1);
+    matrix* dense_norm = norm(vectors, NULL);
+    matrix* H = random_matrix(N, k, 0, 1);
+    matrix* dense_product = matrix_malloc(N, k);
+    matrix* sparse_product = matrix_malloc(N, k);
+    matrix* expanded;
+    csr_matrix* graph;
+
+    config.knn = N - 1;
+    graph = norm_sparse(vectors, &config);
+    expanded = csr_to_dense(graph);
+    check("sparse norm with knn = N-1 matches the dense one", max_abs_diff(expanded, dense_norm) < 1e-15);
+    matrix_free(expanded);
+    csr_free(graph);
+
+    config.knn = 5;
+    graph = sym_sparse(vectors, &config);
+    expanded = csr_to_dense(graph);
+    for(i=0;i<N;i++)
+    {
+        if(graph->row_ptr[i + 1] - graph->row_ptr[i] < config.knn) knn_ok = 0;
+        for(j=0;j<N;j++)
+        {
+            if(MATRIX_AT(expanded, i, j) != MATRIX_AT(expanded, j, i)) knn_ok = 0;
+        }
+    }
+    check("knn graph is symmetric with at least knn entries per row", knn_ok);
+    gemm(expanded, H, dense_product, NULL);
+    csr_multiply(graph, H, sparse_product, 1);
+    err = max_abs_diff(dense_product, sparse_product);
+    check("csr_multiply matches gemm within 1e-12", err < 1e-12);
+    matrix_free(expanded);
+    csr_free(graph);
+
+    config.knn = 0;
+    config.epsilon = 0.5;
+    graph = sym_sparse(vectors, &config);
+    for(i=0;i<N;i++)
+    {
+        p = graph->row_ptr[i];
+        for(j=0;j<N;j++)
+        {
+            int within = (j != i && euclidean_distance(MATRIX_ROW(vectors, i), MATRIX_ROW(vectors, j), 3, 1) <= 0.25);
+            int kept = (p < graph->row_ptr[i + 1] && graph->col[p] == j);
+            if(within != kept) epsilon_ok = 0;
+            if(kept) p++;
+        }
+    }
+    check("epsilon graph keeps exactly the pairs within epsilon", epsilon_ok);
+    csr_free(graph);
+
+    /* no point and a single point have no neighbours, whatever knn asks for */
+    config.knn = 5;
+    for(vectors->rows=0;vectors->rows<2;vectors->rows++)
+    {
+        graph = sym_sparse(vectors, &config);
+        if(graph == NULL || graph->n != vectors->rows || graph->nnz != 0) knn_ok = 0;
+        csr_free(graph);
+    }
+    check("knn graph of fewer than two points is empty", knn_ok);
+    vectors->rows = N;
+
+    matrix_free(vectors);
+    matrix_free(dense_norm);
+    matrix_free(H);
+    matrix_free(dense_product);
+    matrix_free(sparse_product);
+}
+
+/*
+checks the streaming operator against gemm on the stored norm matrix, with no tile cached,
+with part of the tiles cached and with all of them, and with the gram backend
+@return void
+*/
+static void test_stream(void)
+{
+    int N = 600, k = 4; /* three block rows of STREAM_TILE, the last one partial */
+    size_t tile_bytes = (size_t)STREAM_TILE * STREAM_TILE * sizeof(double);
+    size_t budgets[3];
+    int b;
+    double err = 0, gram_err;
+    symnmf_config config = {0, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+    matrix* vectors = random_matrix(N, 3, -1, 1);
+    matrix* dense_norm = norm(vectors, NULL);
+    matrix* H = random_matrix(N, k, 0, 1);
+    matrix* dense_product = matrix_malloc(N, k);
+    matrix* stream_product = matrix_malloc(N, k);
+    stream_operator* op;
+
+    budgets[0] = 0;
+    budgets[1] = 2 * tile_bytes;
+    budgets[2] = 100 * tile_bytes;
+    gemm(dense_norm, H, dense_product, NULL);
+    for(b=0;b<3;b++)
+    {
+        op = stream_create(vectors, &config, budgets[b]);
+        stream_multiply(op, H, stream_product, NULL, 1);
+        if(max_abs_diff(dense_product, stream_product) > err) err = max_abs_diff(dense_product, stream_product);
+        stream_free(op);
+    }
+    check("stream_multiply matches gemm for every cache size", err < 1e-12);
+
+    config.sym_backend = SYM_BACKEND_GRAM;
+    op = stream_create(vectors, &config, 0);
+    stream_multiply(op, H, stream_product, NULL, 1);
+    gram_err = max_abs_diff(dense_product, stream_product);
+    stream_free(op);
+    check("stream_multiply with the gram backend matches gemm", gram_err < 1e-9);
+
+    matrix_free(vectors);
+    matrix_free(dense_norm);
+    matrix_free(H);
+    matrix_free(dense_product);
+    matrix_free(stream_product);
+}
+
+/*
+checks that the H*(H^T*H) update produces the same factorization as the (H*H^T)*H one
+@return void
+*/
+static void test_symnmf_associativity(void)
+{
+    static const int sizes[][3] = {{10, 5, 2}, {60, 4, 3}, {200, 8, 7}};
+    int s;
+    double err = 0, diff;
+
+    for(s=0;s<(int)(sizeof(sizes)/sizeof(sizes[0]));s++)
+    {
+        int N = sizes[s][0], vecdim = sizes[s][1], k = sizes[s][2];
+        matrix* vectors = random_matrix(N, vecdim, -2, 2);
+        matrix* W = norm(vectors, NULL);
+        matrix* H = random_matrix(N, k, 0, 2 * sqrt(1.0 / N / k));
+        matrix* H_ref = matrix_copy(H);
+        matrix* result_ref = matrix_malloc(N, k);
+        matrix* result;
+
+        reference_symnmf(W, H_ref, result_ref);
+        result = symnmf(W, H, 1);
+        if((diff = max_abs_diff(result, result_ref)) > err) err = diff;
+
+        matrix_free(vectors);
+        matrix_free(W);
+        matrix_free(H);
+        matrix_free(H_ref);
+        matrix_free(result_ref);
+        matrix_free(result);
+    }
+    check("symnmf H*(H^T*H) matches (H*H^T)*H within 1e-9", err < 1e-9);
+}
+
+/*
+calculates the squared forbius norm of W - H*H^T
+@param W: the norm matrix (N*N)
+@param H: the H matrix (N*k)
+@return double: the objective symnmf minimizes
+*/
+static double factorization_error(const matrix* W, const matrix* H)
+{
+    int i,j,l;
+    double product, diff, sum = 0;
+    for(i=0;i<W->rows;i++)
+    {
+        for(j=0;j<W->cols;j++)
+        {
+            product = 0;
+            for(l=0;l<H->cols;l++)
+            {
+                product += MATRIX_AT(H, i, l) * MATRIX_AT(H, j, l);
+            }
+            diff = MATRIX_AT(W, i, j) - product;
+            sum += diff * diff;
+        }
+    }
+    return sum;
+}
+
+/*
+checks that the default options of symnmf_solve reproduce symnmf, and that every solver
+converges from the same start to a nonnegative H with a lower objective, on 3 separated clusters
+@return void
+*/
+static void test_solvers(void)
+{
+    int i,j,solver,iterations;
+    int N = 150, k = 3;
+    int converged = 1, nonnegative = 1, descends = 1;
+    double start_error;
+    matrix* vectors = random_matrix(N, 4, -1, 1);
+    matrix* W;
+    matrix* H;
+    matrix* H_copy;
+    matrix* expected;
+    matrix* result;
+    symnmf_options options;
+    w_operator op;
+
+    for(i=0;i<N;i++)
+    {
+        for(j=0;j<4;j++)
+        {
+            MATRIX_AT(vectors, i, j) += (j == i % k) ? 6 : 0;
+        }
+    }
+    W = norm(vectors, NULL);
+    H = random_matrix(N, k, 0, 2 * sqrt(1.0 / N / k));
+    op.kind = W_DENSE;
+    op.dense = W;
+    op.packed = NULL;
+    op.sparse = NULL;
+    op.stream = NULL;
+    op.dense_f32 = NULL;
+    op.packed_f32 = NULL;
+    start_error = factorization_error(W, H);
+
+    H_copy = matrix_copy(H);
+    expected = symnmf(W, H_copy, 1);
+    matrix_free(H_copy);
+    H_copy = matrix_copy(H);
+    result = symnmf_solve(&op, H_copy, 1, NULL, &iterations);
+    check("symnmf_solve with the default options matches symnmf", max_abs_diff(expected, result) == 0 &&
+          iterations >= 1 && iterations <= SYMNMF_DEFAULT_MAX_ITER);
+    matrix_free(H_copy);
+    matrix_free(expected);
+    matrix_free(result);
+
+    symnmf_default_options(&options);
+    options.max_iter = 20000;
+    options.eps = 1e-10;
+    for(solver=SOLVER_MU;solver<=SOLVER_PG;solver++)
+    {
+        options.solver = solver;
+        H_copy = matrix_copy(H);
+        result = symnmf_solve(&op, H_copy, 2, &options, &iterations);
+        if(iterations >= options.max_iter) converged = 0;
+        if(factorization_error(W, result) >= start_error) descends = 0;
+        for(i=0;i<N;i++)
+        {
+            for(j=0;j<k;j++)
+            {
+                if(!(MATRIX_AT(result, i, j) >= 0)) nonnegative = 0;
+            }
+        }
+        matrix_free(H_copy);
+        matrix_free(result);
+    }
+    check("mu, nesterov and pg solvers converge to a nonnegative H", converged && nonnegative);
+    check("mu, nesterov and pg solvers lower ||W - H*H^T||_F", descends);
+
+    /* the gradient assumes a symmetric W, a skew-symmetric one makes every trial step go uphill */
+    for(i=0;i<N;i++)
+    {
+        for(j=i;j<N;j++)
+        {
+            MATRIX_AT(W, i, j) = (i == j) ? 0 : 100 * (rand() / (RAND_MAX + 1.0));
+            MATRIX_AT(W, j, i) = -MATRIX_AT(W, i, j);
+        }
+    }
+    options.solver = SOLVER_PG;
+    H_copy = matrix_copy(H);
+    result = symnmf_solve(&op, H_copy, 1, &options, &iterations);
+    check("pg keeps H when no step descends", iterations == 0 && max_abs_diff(result, H) == 0);
+    matrix_free(H_copy);
+    matrix_free(result);
+
+    matrix_free(vectors);
+    matrix_free(W);
+    matrix_free(H);
+}
+
+/*
+checks that symnmf_restarts returns the factorization of one of its seeds, reports its objective,
+does not depend on the thread count, and reduces to symnmf_from_vectors for a single restart
+@return void
+*/
+static void test_restarts(void)
+{
+    int r, abandoned, found = 0;
+    int N = 120, k = 3, restarts = 5;
+    double objective, objective_threads;
+    symnmf_config config = {1, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+    matrix* vectors = random_matrix(N, 4, -1, 1);
+    matrix* W = norm(vectors, NULL);
+    matrix* single = symnmf_from_vectors(vectors, k, 1234, &config, NULL, 1);
+    matrix* result = symnmf_restarts(W, k, 1234, 1, 1, NULL, NULL, NULL);
+    matrix* result_threads;
+
+    check("symnmf_restarts with one restart matches symnmf_from_vectors", max_abs_diff(single, result) == 0);
+    matrix_free(single);
+    matrix_free(result);
+
+    result = symnmf_restarts(W, k, 1234, restarts, 1, NULL, &objective, &abandoned);
+    result_threads = symnmf_restarts(W, k, 1234, restarts, 3, NULL, &objective_threads, NULL);
+    for(r=0;r<restarts;r++)
+    {
+        single = symnmf_from_vectors(vectors, k, 1234 + r, &config, NULL, 1);
+        if(max_abs_diff(single, result) == 0) found = 1;
+        matrix_free(single);
+    }
+    check("symnmf_restarts returns one of its restarts and its objective", found && abandoned < restarts &&
+          fabs(objective - factorization_error(W, result)) < 1e-9 * factorization_error(W, result));
+    check("symnmf_restarts does not depend on the thread count", max_abs_diff(result, result_threads) == 0 &&
+          objective == objective_threads);
+
+    matrix_free(vectors);
+    matrix_free(W);
+    matrix_free(result);
+    matrix_free(result_threads);
+}
+
+/*
+checks that extending the norm matrix of some points matches the norm matrix of all of them, and that
+a factorization warm started from the previous H converges in fewer iterations than a cold one
+@return void
+*/
+static void test_incremental(void)
+{
+    int i, iterations_warm, iterations_cold;
+    int N = 150, M = 15, k = 3;
+    double mean = 0;
+    symnmf_config config = {1, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+    matrix* vectors = random_matrix(N + M, 3, -0.5, 0.5);
+    matrix old;
+    matrix* W_all;
+    matrix* degrees_all;
+    matrix* W_old;
+    matrix* degrees_old;
+    matrix* W_new;
+    matrix* degrees_new;
+    matrix* W_same;
+    matrix* degrees_same;
+    matrix* H_old;
+    matrix* H_start;
+    matrix* H_cold;
+    matrix* warm;
+    matrix* cold;
+    w_operator op;
+
+    for(i=0;i<N+M;i++) /* three clusters, the new points spread over all of them */
+    {
+        MATRIX_AT(vectors, i, 0) += 3 * (i % 3);
+    }
+    old = *vectors;
+    old.rows = N;
+    W_all = norm(vectors, NULL);
+    degrees_all = ddg_diagonal(vectors, NULL);
+    W_old = norm(&old, NULL);
+    degrees_old = ddg_diagonal(&old, NULL);
+    W_new = norm_extend(W_old, degrees_old, vectors, &degrees_new, &config);
+    W_same = norm_extend(W_old, degrees_old, &old, &degrees_same, &config);
+    check("norm_extend matches norm on all the points", W_new != NULL && max_abs_diff(W_new, W_all) < 1e-12 &&
+          max_abs_diff(degrees_new, degrees_all) < 1e-9);
+    check("norm_extend without new points keeps W", W_same != NULL && max_abs_diff(W_same, W_old) == 0 &&
+          max_abs_diff(degrees_same, degrees_old) == 0);
+
+    H_old = symnmf_from_vectors(&old, k, 1234, &config, NULL, 1);
+    H_start = warm_start_H(W_new, degrees_old, degrees_new, H_old, 1);
+    for(i=0;i<(N+M)*(N+M);i++)
+    {
+        mean += MATRIX_AT(W_all, i / (N + M), i % (N + M));
+    }
+    mean /= (N + M) * (N + M);
+    H_cold = random_matrix(N + M, k, 0, 2 * sqrt(mean / k));
+    op.kind = W_DENSE;
+    op.dense = W_new;
+    op.packed = NULL;
+    op.sparse = NULL;
+    op.stream = NULL;
+    op.dense_f32 = NULL;
+    op.packed_f32 = NULL;
+    warm = symnmf_solve(&op, H_start, 1, NULL, &iterations_warm);
+    cold = symnmf_solve(&op, H_cold, 1, NULL, &iterations_cold);
+    check("warm started symnmf converges faster to a residual as low", iterations_warm < iterations_cold &&
+          factorization_error(W_new, warm) <= 1.01 * factorization_error(W_new, cold));
+
+    matrix_free(vectors);
+    matrix_free(W_all);
+    matrix_free(degrees_all);
+    matrix_free(W_old);
+    matrix_free(degrees_old);
+    matrix_free(W_new);
+    matrix_free(degrees_new);
+    matrix_free(W_same);
+    matrix_free(degrees_same);
+    matrix_free(H_old);
+    matrix_free(H_start);
+    matrix_free(H_cold);
+    matrix_free(warm);
+    matrix_free(cold);
+}
+
+/*
+checks the single precision pipeline: W is within float rounding of the engine's with both sym backends, the
+packed W holds the upper triangle of the dense one, symm_packed_f32 matches the naive product and every solver,
+with restarts and packed storage, assigns every point the cluster the double precision engine assigns it
+@return void
+*/
+static void test_precision(void)
+{
+    int i,j,c,v,same;
+    int N = 150, k = 3;
+    double err = 0, diff, largest = 0, packed_err = 0;
+    symnmf_config config = {1, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+    symnmf_config gram_config = {1, SYM_BACKEND_GRAM, EXP_LIBM, 0, 0, 0, 0};
+    symnmf_options options;
+    matrix* vectors = random_matrix(N, 3, -0.5, 0.5);
+    matrix* W;
+    matrix_f32* W_f32;
+    matrix_f32* W_gram;
+    packed_matrix_f32* P_f32;
+    matrix* B = random_matrix(N, k, 0, 1);
+    matrix_f32* B_f32 = round_f32(B);
+    matrix* C = matrix_malloc(N, k);
+    matrix* C_ref = matrix_malloc(N, k);
+    matrix* W_wide = matrix_malloc(N, N);
+    matrix* H;
+    matrix* H_single;
+
+    for(i=0;i<N;i++) /* three clusters */
+    {
+        MATRIX_AT(vectors, i, 0) += 3 * (i % 3);
+    }
+    W = norm(vectors, NULL);
+    W_f32 = norm_f32(vectors, &config);
+    W_gram = norm_f32(vectors, &gram_config);
+    P_f32 = norm_packed_f32(vectors, &config);
+    for(i=0;i<N;i++)
+    {
+        for(j=0;j<N;j++)
+        {
+            if((diff = fabs(MATRIX_AT(W_f32, i, j) - MATRIX_AT(W, i, j))) > err) err = diff;
+            if((diff = fabs(MATRIX_AT(W_gram, i, j) - MATRIX_AT(W, i, j))) > err) err = diff;
+            if(j >= i && PACKED_AT(P_f32, i, j) != MATRIX_AT(W_f32, i, j)) packed_err = 1;
+            if(MATRIX_AT(W, i, j) > largest) largest = MATRIX_AT(W, i, j);
+            MATRIX_AT(W_wide, i, j) = MATRIX_AT(W_f32, i, j);
+        }
+    }
+    check("norm_f32 matches norm within float rounding with both backends", err <= 1e-6 * largest);
+    check("norm_packed_f32 holds the upper triangle of norm_f32", packed_err == 0);
+
+    symm_packed_f32(P_f32, B_f32, C, NULL, 3);
+    for(i=0;i<N;i++)
+    {
+        for(j=0;j<k;j++)
+        {
+            MATRIX_AT(B, i, j) = MATRIX_AT(B_f32, i, j);
+        }
+    }
+    reference_multiplication(W_wide, B, C_ref);
+    check("symm_packed_f32 matches the naive multiplication within float rounding", max_abs_diff(C, C_ref) < 1e-4);
+
+    symnmf_default_options(&options);
+    same = 1;
+    for(v=0;v<5;v++) /* every solver, then restarts, then packed storage */
+    {
+        config.packed = (v == 4);
+        options.solver = (v < 3) ? v : SOLVER_MU;
+        config.single = 0;
+        H = symnmf_from_vectors(vectors, k, 1234, &config, &options, (v == 3) ? 3 : 1);
+        config.single = 1;
+        H_single = symnmf_from_vectors(vectors, k, 1234, &config, &options, (v == 3) ? 3 : 1);
+        for(i=0;i<N && H != NULL && H_single != NULL;i++)
+        {
+            int label = 0, label_single = 0;
+            for(c=1;c<k;c++)
+            {
+                if(MATRIX_AT(H, i, c) > MATRIX_AT(H, i, label)) label = c;
+                if(MATRIX_AT(H_single, i, c) > MATRIX_AT(H_single, i, label_single)) label_single = c;
+            }
+            if(label != label_single) same = 0;
+        }
+        if(H == NULL || H_single == NULL) same = 0;
+        matrix_free(H);
+        matrix_free(H_single);
+    }
+    check("single precision gives every point the cluster double does with every solver, restarts and packed W", same);
+
+    matrix_free(vectors);
+    matrix_free(W);
+    matrix_free_f32(W_f32);
+    matrix_free_f32(W_gram);
+    packed_free_f32(P_f32);
+    matrix_free(B);
+    matrix_free_f32(B_f32);
+    matrix_free(C);
+    matrix_free(C_ref);
+    matrix_free(W_wide);
+}
+
+/*
+checks that a threaded factorization is reproducible bit for bit at a fixed thread count and
+matches the single threaded one, for every storage of W
+@return void
+*/
+static void test_symnmf_threads(void)
+{
+    int i,kind;
+    int N = 300, k = 5, threads = 3;
+    int reproducible = 1;
+    double err = 0, diff;
+    symnmf_config config = {0, SYM_BACKEND_SCALAR, EXP_LIBM, 10, 0, 0, 0};
+    matrix* vectors = random_matrix(N, 3, -1, 1);
+    matrix* W = norm(vectors, NULL);
+    packed_matrix* P = norm_packed(vectors, NULL);
+    csr_matrix* graph = norm_sparse(vectors, &config);
+    stream_operator* stream = stream_create(vectors, &config, 0);
+    matrix* H = random_matrix(N, k, 0, 2 * sqrt(1.0 / N / k));
+    w_operator op;
+
+    op.dense = W;
+    op.packed = P;
+    op.sparse = graph;
+    op.stream = stream;
+    op.dense_f32 = NULL;
+    op.packed_f32 = NULL;
+    for(kind=W_DENSE;kind<=W_STREAM;kind++)
+    {
+        matrix* H_serial = matrix_copy(H);
+        matrix* H_first = matrix_copy(H);
+        matrix* H_second = matrix_copy(H);
+        matrix* serial;
+        matrix* first;
+        matrix* second;
+
+        op.kind = kind;
+        serial = symnmf_operator(&op, H_serial, 1);
+        first = symnmf_operator(&op, H_first, threads);
+        second = symnmf_operator(&op, H_second, threads);
+        for(i=0;i<N;i++)
+        {
+            if(memcmp(MATRIX_ROW(first, i), MATRIX_ROW(second, i), k * sizeof(double)) != 0) reproducible = 0;
+        }
+        if((diff = max_abs_diff(first, serial)) > err) err = diff;
+
+        matrix_free(H_serial);
+        matrix_free(H_first);
+        matrix_free(H_second);
+        matrix_free(serial);
+        matrix_free(first);
+        matrix_free(second);
+    }
+    check("threaded symnmf is reproducible at a fixed thread count", reproducible);
+    check("threaded symnmf matches the serial one within 1e-9", err < 1e-9);
+
+    matrix_free(vectors);
+    matrix_free(W);
+    packed_free(P);
+    csr_free(graph);
+    stream_free(stream);
+    matrix_free(H);
+}
+
+/*
+checks the generator against the reference MT19937 and numpy.random streams, and that
+symnmf_from_vectors matches building W and H by hand and calling symnmf
+@return void
+*/
+static void test_symnmf_from_vectors(void)
+{
+    int i,j;
+    int N = 90, k = 3;
+    int in_range = 1;
+    double sum = 0, upper_bound, first, second;
+    mt19937 mt;
+    matrix* vectors = random_matrix(N, 4, -2, 2);
+    matrix* W = norm(vectors, NULL);
+    matrix* H;
+    matrix* expected;
+    matrix* result;
+
+    mt_seed(&mt, 5489);
+    check("mt_next matches the reference MT19937 output", mt_next(&mt) == 3499211612UL);
+    mt_seed(&mt, 1234);
+    first = mt_uniform(&mt);
+    second = mt_uniform(&mt);
+    check("mt_uniform matches numpy.random after seeding", first == 0.1915194503788923 && second == 0.6221087710398319);
+
+    for(i=0;i<N;i++)
+    {
+        for(j=0;j<N;j++)
+        {
+            sum += MATRIX_AT(W, i, j);
+        }
+    }
+    H = symnmf_init_H(sum / N / N, N, k, 1234);
+    upper_bound = 2 * sqrt(sum / N / N / k);
+    for(i=0;i<N;i++)
+    {
+        for(j=0;j<k;j++)
+        {
+            if(MATRIX_AT(H, i, j) < 0 || MATRIX_AT(H, i, j) >= upper_bound) in_range = 0;
+        }
+    }
+    check("symnmf_init_H draws from [0, 2*sqrt(m/k))", in_range);
+    expected = symnmf(W, H, 1);
+    result = symnmf_from_vectors(vectors, k, 1234, NULL, NULL, 1);
+    check("symnmf_from_vectors matches symnmf on norm and symnmf_init_H", max_abs_diff(expected, result) < 1e-9);
+
+    matrix_free(vectors);
+    matrix_free(W);
+    matrix_free(H);
+    matrix_free(expected);
+    matrix_free(result);
+}
+
+/*
+checks csv_parse_double against strtod on values printed in several formats (bit for bit),
+and csv_parse on CRLF and blank lines, rows wider than the old 1024 byte line buffer,
+rows of different lengths and data large enough to be split between threads
+@return void
+*/
+static void test_csv(void)
+{
+    static const char* formats[] = {"%.4f", "%.17g", "%.6e", "%.20f", "%.0f", "%.3g"};
+    static const char* specials[] = {"0", "-0.0", "1e400", "-1e-400", "4.9406564584124654e-324", "123456789012345678901234567890",
+                                     "0.000000000000000000000000001", " 7.5 ", "inf", "-nan", "0x1p3", "1e", "12abc", ""};
+    char token[128];
+    char* data;
+    const char* end;
+    size_t size, length;
+    int i,j,f,t;
+    int exact = 1, layout, ragged, chunked = 1;
+    double value, expected, scale;
+    matrix* parsed;
+    matrix* reference;
+
+    for(f=0;f<(int)(sizeof(formats)/sizeof(formats[0]));f++)
+    {
+        for(i=0;i<20000;i++)
+        {
+            scale = pow(10, rand() % 40 - 20);
+            sprintf(token, formats[f], ((double)rand() / RAND_MAX - 0.5) * scale);
+            expected = strtod(token, NULL);
+            end = csv_parse_double(token, token + strlen(token), &value);
+            if(end != token + strlen(token) || memcmp(&value, &expected, sizeof(double)) != 0) exact = 0;
+        }
+    }
+    for(i=0;i<(int)(sizeof(specials)/sizeof(specials[0]));i++)
+    {
+        expected = strtod(specials[i], NULL);
+        csv_parse_double(specials[i], specials[i] + strlen(specials[i]), &value);
+        if(memcmp(&value, &expected, sizeof(double)) != 0 && !(value != value && expected != expected)) exact = 0;
+    }
+    check("csv_parse_double matches strtod bit for bit", exact);
+
+    /* CRLF line ends, a blank line, no final newline and a 300 column row */
+    data = malloc(300 * 32 + 64);
+    strcpy(data, "\r\n1.5, -2\r\n\r\n3e2,0.25\n");
+    parsed = csv_parse(data, strlen(data), 1);
+    layout = parsed != NULL && parsed->rows == 2 && parsed->cols == 2 && MATRIX_AT(parsed, 0, 1) == -2 && MATRIX_AT(parsed, 1, 0) == 300;
+    matrix_free(parsed);
+    length = 0;
+    for(j=0;j<300;j++)
+    {
+        length += sprintf(data + length, j ? ",%.17g" : "%.17g", 1.0 / (j + 1));
+    }
+    parsed = csv_parse(data, length, 1);
+    layout = layout && parsed != NULL && parsed->rows == 1 && parsed->cols == 300 && MATRIX_AT(parsed, 0, 299) == 1.0 / 300;
+    matrix_free(parsed);
+    check("csv_parse handles CRLF, blank lines and rows over 1024 bytes", layout);
+
+    strcpy(data, "1,2\n3\n");
+    ragged = (csv_parse(data, strlen(data), 1) == NULL);
+    strcpy(data, "1,2\n3,4,5\n");
+    ragged = ragged && (csv_parse(data, strlen(data), 1) == NULL);
+    printf("\n"); /* after the error messages of the rejected rows */
+    check("csv_parse rejects rows of different lengths", ragged);
+    free(data);
+
+    /* about 4 MB, split into chunks of at least 1 MB */
+    reference = random_matrix(40000, 5, -10, 10);
+    data = malloc(40000 * 5 * 24);
+    size = 0;
+    for(i=0;i<reference->rows;i++)
+    {
+        for(j=0;j<reference->cols;j++)
+        {
+            size += sprintf(data + size, j ? ",%.17g" : "%.17g", MATRIX_AT(reference, i, j));
+        }
+        data[size++] = '\n';
+    }
+    for(t=1;t<=4;t++)
+    {
+        parsed = csv_parse(data, size, t);
+        chunked = chunked && parsed != NULL && max_abs_diff(parsed, reference) == 0;
+        matrix_free(parsed);
+    }
+    check("csv_parse on 1 to 4 threads reads every row in order", chunked);
+    free(data);
+    matrix_free(reference);
+}
+
+/*
+reads a whole file into memory
+@param filename: the name of the file
+@param size: set to the size of the file
+@return unsigned char*: the contents (to be freed by the caller), NULL on failure
+*/
+static unsigned char* read_file(const char* filename, long* size)
+{
+    unsigned char* contents;
+    FILE* file = fopen(filename, "rb");
+    if(file == NULL) return NULL;
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+    if((contents = malloc(*size + 1)) != NULL && fread(contents, 1, *size, file) != (size_t)*size)
+    {
+        free(contents);
+        contents = NULL;
+    }
+    fclose(file);
+    return contents;
+}
+
+/*
+checks that a matrix with padded rows survives a round trip through a binary matrix file bit for bit,
+that the header is laid out as matfile.h documents, that a packed matrix is written like its
+dense copy, and that truncated files and files of another format are rejected
+@return void
+*/
+static void test_matfile(void)
+{
+    static const char* filename = "tests/matfile_test.tmp";
+    static const unsigned char header[40] = {0x89, 'S', 'Y', 'M', 'N', 'M', 'F', '\n', 1, 0, 0, 0, 1, 0, 0, 0,
+                                             7, 0, 0, 0, 0, 0, 0, 0, 13, 0, 0, 0, 0, 0, 0, 0, 64, 0, 0, 0, 0, 0, 0, 0};
+    int round_trip, rejected;
+    long size, packed_size;
+    unsigned char* dense_bytes;
+    unsigned char* packed_bytes;
+    FILE* file;
+    matrix* mat = random_matrix(7, 13, -1e3, 1e3);
+    matrix* vectors = random_matrix(20, 3, -1, 1);
+    matrix* W = norm(vectors, NULL);
+    packed_matrix* P = norm_packed(vectors, NULL);
+    matrix* read;
+
+    file = fopen(filename, "wb");
+    matfile_write(file, mat);
+    fclose(file);
+    dense_bytes = read_file(filename, &size);
+    read = matfile_read(filename);
+    round_trip = dense_bytes != NULL && size == 64 + 7 * 13 * 8 && !memcmp(dense_bytes, header, sizeof(header)) &&
+                 read != NULL && read->rows == 7 && read->cols == 13 && max_abs_diff(mat, read) == 0;
+    check("matfile round trip keeps every value and the header layout", round_trip);
+    matrix_free(read);
+
+    /* a truncated payload, then a CSV file */
+    file = fopen(filename, "wb");
+    fwrite(dense_bytes, 1, size - 8, file);
+    fclose(file);
+    free(dense_bytes);
+    rejected = (matfile_read(filename) == NULL);
+    file = fopen(filename, "wb");
+    fputs("1.0,2.0\n", file);
+    fclose(file);
+    rejected = rejected && (matfile_read(filename) == NULL);
+    printf("\n"); /* after the error messages of the rejected files */
+    check("matfile_read rejects truncated and foreign files", rejected);
+
+    file = fopen(filename, "wb");
+    matfile_write(file, W);
+    fclose(file);
+    dense_bytes = read_file(filename, &size);
+    file = fopen(filename, "wb");
+    matfile_write_packed(file, P);
+    fclose(file);
+    packed_bytes = read_file(filename, &packed_size);
+    check("matfile_write_packed writes the same file as the dense matrix", dense_bytes != NULL && packed_bytes != NULL &&
+          size == packed_size && !memcmp(dense_bytes, packed_bytes, size));
+    free(dense_bytes);
+    free(packed_bytes);
+    remove(filename);
+
+    read = (matfile_save(filename, mat) == 0) ? matfile_read(filename) : NULL;
+    file = fopen("tests/matfile_test.tmp.tmp", "rb");
+    check("matfile_save writes the matrix and leaves no temporary file", read != NULL && max_abs_diff(mat, read) == 0 &&
+          file == NULL);
+    if(file != NULL) fclose(file);
+    matrix_free(read);
+    remove(filename);
+
+    matrix_free(mat);
+    matrix_free(vectors);
+    matrix_free(W);
+    packed_free(P);
+}
+
+/*
+reads back everything written to a temporary file
+@param file: the file
+@param size: set to the number of bytes
+@return char*: the contents (to be freed by the caller), NULL on failure
+*/
+static char* read_back(FILE* file, long* size)
+{
+    char* contents;
+    fflush(file);
+    *size = ftell(file);
+    rewind(file);
+    if((contents = malloc(*size + 1)) != NULL && fread(contents, 1, *size, file) != (size_t)*size)
+    {
+        free(contents);
+        contents = NULL;
+    }
+    return contents;
+}
+
+/*
+checks format_fixed4 against sprintf("%.4f") on random values of every magnitude, exact ties,
+signed zeros and special values, and the buffered fprint_matrix (serial and parallel) against
+the printf loop it replaced, byte for byte
+@return void
+*/
+static void test_output(void)
+{
+    static const double specials[] = {0.0, -0.0, -1e-5, 0.00005, -0.00015, 1.03125, 2.5e-5, 0.99995, 9.99995,
+                                      999999999.99995, 1e9, -1e9, 123456789.123456789, 1e300, -1e-300, DBL_MAX, -DBL_MAX};
+    char expected[FIXED4_MAX_LENGTH + 1];
+    char formatted[FIXED4_MAX_LENGTH + 1];
+    double value, zero = 0;
+    int i,j,t;
+    int exact = 1, identical = 1;
+    long legacy_size, size;
+    char* legacy_text;
+    char* text;
+    FILE* file;
+    matrix* mat = random_matrix(600, 500, -2, 2);
+
+    for(i=0;i<400000;i++)
+    {
+        if(i % 4 == 0) value = (rand() % 2000000 - 1000000) / 64.0 / pow(2, rand() % 12); /* ties and near ties */
+        else value = ((double)rand() / RAND_MAX - 0.5) * pow(10, rand() % 24 - 12);
+        sprintf(expected, "%.4f", value);
+        if(format_fixed4(value, formatted) != strlen(expected) || strcmp(formatted, expected) != 0) exact = 0;
+    }
+    for(i=0;i<(int)(sizeof(specials)/sizeof(specials[0])) + 3;i++)
+    {
+        if(i < (int)(sizeof(specials)/sizeof(specials[0]))) value = specials[i];
+        else value = (i % 2) ? 1 / zero : ((i % 3) ? -1 / zero : zero / zero);
+        sprintf(expected, "%.4f", value);
+        if(format_fixed4(value, formatted) != strlen(expected) || strcmp(formatted, expected) != 0) exact = 0;
+    }
+    check("format_fixed4 matches sprintf(\"%.4f\") byte for byte", exact);
+
+    /* the printf loop print_matrix used to be */
+    file = tmpfile();
+    for(i=0;i<mat->rows;i++)
+    {
+        for(j=0;j<mat->cols;j++)
+        {
+            fprintf(file, "%.4f ", MATRIX_AT(mat, i, j));
+            if(j != mat->cols-1)
+            {
+                fprintf(file, ",");
+            }
+        }
+        fprintf(file, "\n");
+    }
+    legacy_text = read_back(file, &legacy_size);
+    fclose(file);
+    for(t=1;t<=4;t+=3)
+    {
+        file = tmpfile();
+        identical = identical && fprint_matrix(file, mat, t) == 0;
+        text = read_back(file, &size);
+        identical = identical && text != NULL && legacy_text != NULL && size == legacy_size && !memcmp(text, legacy_text, size);
+        free(text);
+        fclose(file);
+    }
+    check("fprint_matrix on 1 and 4 threads matches the printf loop", identical);
+    free(legacy_text);
+    matrix_free(mat);
+}
+
+/*
+checks that once the workspace exists, symnmf iterations perform no heap allocation
+and that a whole factorization allocates the same number of blocks regardless of its length
+@return void
+*/
+static void test_symnmf_allocations(void)
+{
+    int i;
+    int N = 120, k = 4;
+    unsigned long before, short_run, long_run;
+    matrix* swap;
+    matrix* vectors = random_matrix(N, 3, -2, 2);
+    matrix* W = norm(vectors, NULL);
+    matrix* H = random_matrix(N, k, 0, 0.5);
+    matrix* H_copy = matrix_copy(H);
+    matrix* result;
+    w_operator op;
+    symnmf_workspace* ws;
+
+    op.kind = W_DENSE;
+    op.dense = W;
+    op.packed = NULL;
+    op.sparse = NULL;
+    op.stream = NULL;
+    op.dense_f32 = NULL;
+    op.packed_f32 = NULL;
+    ws = symnmf_workspace_malloc(&op, N, k, 1);
+    before = allocation_count;
+    for(i=0;i<50;i++)
+    {
+        symnmf_iterate(&op, H, ws->new_H, ws);
+        swap = H;
+        H = ws->new_H;
+        ws->new_H = swap;
+    }
+    check("steady-state symnmf iterations allocate nothing", allocation_count == before);
+    symnmf_workspace_free(ws);
+
+    /* H has already been iterated and converges quickly, its untouched copy runs much longer */
+    before = allocation_count;
+    result = symnmf(W, H, 1);
+    short_run = allocation_count - before;
+    matrix_free(result);
+    before = allocation_count;
+    result = symnmf(W, H_copy, 1);
+    long_run = allocation_count - before;
+    matrix_free(result);
+    check("symnmf allocations do not depend on the iteration count", short_run == long_run);
+
+    matrix_free(vectors);
+    matrix_free(W);
+    matrix_free(H);
+    matrix_free(H_copy);
+}
+
+/*
+checks the statistics: a factorization enters every phase, counts every byte it allocates and records its
+iterations, and nothing is counted while the statistics are disabled
+@return void
+*/
+static void test_stats(void)
+{
+    int N = 90, k = 3;
+    double before;
+    symnmf_config config = {1, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 0, 0};
+    symnmf_config gram_config = {2, SYM_BACKEND_GRAM, EXP_LIBM, 0, 0, 0, 0};
+    symnmf_config single_config = {2, SYM_BACKEND_GRAM, EXP_LIBM, 0, 0, 0, 1};
+    symnmf_config packed_single_config = {2, SYM_BACKEND_SCALAR, EXP_LIBM, 0, 0, 1, 1};
+    symnmf_stats stats;
+    matrix* vectors = random_matrix(N, 3, -1, 1);
+    matrix* H;
+    matrix* H_single;
+    matrix* H_packed;
+
+    stats_enable(1);
+    stats_reset();
+    H = symnmf_from_vectors(vectors, k, 1234, &config, NULL, 1);
+    stats_get(&stats);
+    check("stats count one sym, norm and solve", stats.calls[STATS_SYM] == 1 && stats.calls[STATS_NORM] == 1 &&
+          stats.calls[STATS_SOLVE] == 1);
+    check("stats count a product per iteration", stats.iterations > 0 && stats.calls[STATS_PRODUCT] == stats.iterations);
+    check("stats phases include the phases they call", stats.seconds[STATS_NORM] >= stats.seconds[STATS_SYM] &&
+          stats.seconds[STATS_SOLVE] >= stats.seconds[STATS_PRODUCT]);
+    check("stats count at least W and H", stats.allocations >= 2 &&
+          stats.bytes_allocated >= (double)N * (N + k) * sizeof(double));
+    matrix_free(H);
+
+    stats_reset();
+    before = allocation_bytes;
+    H = symnmf_from_vectors(vectors, k, 1234, &gram_config, NULL, 3);
+    H_single = symnmf_from_vectors(vectors, k, 1234, &single_config, NULL, 3);
+    H_packed = symnmf_from_vectors(vectors, k, 1234, &packed_single_config, NULL, 1);
+    stats_get(&stats);
+    check("stats count every byte the engine allocates", stats.bytes_allocated == allocation_bytes - before);
+    matrix_free(H);
+    matrix_free(H_single);
+    matrix_free(H_packed);
+
+    stats_enable(0);
+    stats_reset();
+    H = symnmf_from_vectors(vectors, k, 1234, &config, NULL, 1);
+    stats_get(&stats);
+    check("disabled stats count nothing", stats.calls[STATS_SOLVE] == 0 && stats.allocations == 0 &&
+          stats.iterations == -1);
+
+    matrix_free(H);
+    matrix_free(vectors);
+}
+
+int main(void)
+{
+    int level;
+
+    srand(1234);
+    for(level=simd_level();level>=SIMD_SCALAR;level--)
+    {
+        simd_set_level(level);
+        test_kernels(simd_level_name(level));
+        test_sym_backends(simd_level_name(level));
+        test_exp(simd_level_name(level));
+    }
+    simd_set_level(-1);
+    test_ddg_diagonal();
+    test_packed();
+    test_packed_pipeline();
+    test_sparse();
+    test_stream();
+    test_symnmf_associativity();
+    test_symnmf_threads();
+    test_solvers();
+    test_restarts();
+    test_incremental();
+    test_precision();
+    test_symnmf_from_vectors();
+    test_csv();
+    test_matfile();
+    test_output();
+    test_symnmf_allocations();
+    test_stats();
+
+    if(failures != 0)
+    {
+        printf("%d test(s) failed\n", failures);
+        return 1;
+    }
+    printf("all tests passed\n");
+    return 0;
+}